@@ -0,0 +1,237 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: AlarmTable.cpp
+ * Desc: Per-scan limit checking for driver-side interlocks
+ * Note: Built without the precompiled header so that it stays portable
+**/
+
+// Class header file
+#include "AlarmTable.h"
+
+/**
+ * Name: AlarmTable()
+ * Desc: Creates an inactive table
+**/
+AlarmTable::AlarmTable()
+{
+	active = false;
+	numRules = 0;
+	totalEvents = 0;
+	detectBoundMs = 0;
+	lateEvents = 0;
+	worstDetectMs = 0;
+	worstWriteMs = 0;
+}
+
+/**
+ * Name: Configure(const AlarmRule * newRules, int count, double boundMs)
+ * Desc: Compiles the rules and clears their states and the log. An event
+ *		 whose scan took longer than boundMs to be checked counts as late.
+ *		 Everything is allocated here, nothing while scans are checked.
+**/
+void AlarmTable::Configure(const AlarmRule * newRules, int count, double boundMs)
+{
+	int r;
+
+	numRules = count;
+	rules.assign(newRules, newRules + count);
+	source.resize(count);
+	low.resize(count);
+	high.resize(count);
+	clearLow.resize(count);
+	clearHigh.resize(count);
+	tripped.assign(count, 0);
+	trips.reserve(count);
+	trips.clear();
+
+	for (r = 0; r < count; r++)
+	{
+		source[r] = rules[r].source;
+		low[r] = rules[r].low;
+		high[r] = rules[r].high;
+		clearLow[r] = rules[r].low + rules[r].hysteresis;
+		clearHigh[r] = rules[r].high - rules[r].hysteresis;
+	}
+
+	events.reserve(MAX_EVENTS);
+	events.clear();
+	totalEvents = 0;
+	detectBoundMs = boundMs;
+	lateEvents = 0;
+	worstDetectMs = 0;
+	worstWriteMs = 0;
+	active = count > 0;
+}
+
+/**
+ * Name: Disable()
+ * Desc: Stops checking
+**/
+void AlarmTable::Disable()
+{
+	active = false;
+}
+
+/**
+ * Name: IsActive()
+ * Desc: Returns true between Configure with at least one rule and Disable
+**/
+bool AlarmTable::IsActive()
+{
+	return active;
+}
+
+/**
+ * Name: Check(const double * scan)
+ * Desc: Checks every rule against one device scan
+ * Retn: The number of rules that tripped on this scan, read with GetTrip
+**/
+int AlarmTable::Check(const double * scan)
+{
+	double value;
+	int r, changed = 0;
+	bool outside, inside;
+
+	for (r = 0; r < numRules; r++)
+	{
+		value = scan[source[r]];
+		outside = (value < low[r]) | (value > high[r]);
+		inside = (value >= clearLow[r]) & (value <= clearHigh[r]);
+		changed |= (outside & !tripped[r]) | (inside & (tripped[r] != 0));
+	}
+
+	trips.clear();
+	if (!changed)
+		return 0;
+
+	for (r = 0; r < numRules; r++)
+	{
+		value = scan[source[r]];
+		if (!tripped[r] && (value < low[r] || value > high[r]))
+		{
+			tripped[r] = 1;
+			trips.push_back(r);
+		}
+		else if (tripped[r] && value >= clearLow[r] && value <= clearHigh[r])
+			tripped[r] = 0;
+	}
+
+	return (int)trips.size();
+}
+
+/**
+ * Name: GetTrip(int index)
+ * Desc: Returns the rule of trip index of the last Check
+**/
+int AlarmTable::GetTrip(int index)
+{
+	return trips[index];
+}
+
+/**
+ * Name: GetRule(int rule)
+ * Desc: Returns a rule as it was configured
+**/
+const AlarmRule * AlarmTable::GetRule(int rule)
+{
+	return &rules[rule];
+}
+
+/**
+ * Name: Log(int rule, unsigned long scanIndex, double value,
+ *			 double detectMs, double writeMs)
+ * Desc: Records an alarm once its output was written, keeping the first
+ *		 MAX_EVENTS and the worst latencies of all of them. detectMs runs
+ *		 from the scan being acquired to the alarm being detected, writeMs
+ *		 from there to the output being written.
+**/
+void AlarmTable::Log(int rule, unsigned long scanIndex, double value, double detectMs, double writeMs)
+{
+	AlarmEvent event;
+
+	totalEvents++;
+	if (detectMs > detectBoundMs)
+		lateEvents++;
+	if (detectMs > worstDetectMs)
+		worstDetectMs = detectMs;
+	if (writeMs > worstWriteMs)
+		worstWriteMs = writeMs;
+
+	if ((int)events.size() >= MAX_EVENTS)
+		return;
+
+	event.scanIndex = scanIndex;
+	event.rule = rule;
+	event.value = value;
+	event.detectMs = detectMs;
+	event.writeMs = writeMs;
+	events.push_back(event);
+}
+
+/**
+ * Name: GetNumEvents()
+ * Desc: Returns the number of events kept in the log
+**/
+int AlarmTable::GetNumEvents()
+{
+	return (int)events.size();
+}
+
+/**
+ * Name: GetEvent(int index)
+ * Desc: Returns event index of the log, oldest first
+**/
+const AlarmEvent * AlarmTable::GetEvent(int index)
+{
+	return &events[index];
+}
+
+/**
+ * Name: GetTotalEvents()
+ * Desc: Returns every alarm since Configure, logged or not
+**/
+unsigned long AlarmTable::GetTotalEvents()
+{
+	return totalEvents;
+}
+
+/**
+ * Name: GetLateEvents()
+ * Desc: Returns the alarms whose scan took longer than the bound given to
+ *		 Configure to be checked
+**/
+unsigned long AlarmTable::GetLateEvents()
+{
+	return lateEvents;
+}
+
+/**
+ * Name: GetDetectBoundMs()
+ * Desc: Returns the bound given to Configure (ms)
+**/
+double AlarmTable::GetDetectBoundMs()
+{
+	return detectBoundMs;
+}
+
+/**
+ * Name: GetWorstDetectMs()
+ * Desc: Returns the longest time from a scan being acquired to its alarm
+ *		 being detected (ms)
+**/
+double AlarmTable::GetWorstDetectMs()
+{
+	return worstDetectMs;
+}
+
+/**
+ * Name: GetWorstWriteMs()
+ * Desc: Returns the longest time from an alarm being detected to its
+ *		 outputs being written (ms)
+**/
+double AlarmTable::GetWorstWriteMs()
+{
+	return worstWriteMs;
+}
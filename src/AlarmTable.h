@@ -0,0 +1,104 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: AlarmTable.h
+ * Desc: Header file for AlarmTable object class
+**/
+
+#ifndef ALARMTABLE_H
+#define ALARMTABLE_H
+
+//	Compiler
+#include <vector>
+
+/**
+ * Name: AlarmRule
+ * Desc: Limits on one value of the device scan and the output driven when
+ *		 the value leaves them
+**/
+struct AlarmRule {
+	int source;										// Position of the value in the device scan
+	double low;										// Lowest value allowed (V)
+	double high;									// Highest value allowed (V)
+	double hysteresis;								// How far back inside the limits clears the alarm (V)
+	int action;										// AlarmTable::ACTION_
+	long channel;									// Digital line or DAC driven
+	double value;									// State of the line or volts of the DAC
+};
+
+/**
+ * Name: AlarmEvent
+ * Desc: One alarm as it was logged
+**/
+struct AlarmEvent {
+	unsigned long scanIndex;						// Scan of the experiment that tripped it, from 0
+	int rule;
+	double value;									// The value out of limits
+	double detectMs;								// Scan acquired to alarm detected
+	double writeMs;									// Alarm detected to output written
+};
+
+/**
+ * Name: AlarmTable
+ * Desc: Limit rules checked on every scan. The rules are kept as arrays
+ *		 of their fields, with the clearing limits worked out in Configure,
+ *		 and the check is one pass of comparisons combined without
+ *		 branching on their outcome. Only when some rule changes state does
+ *		 a second pass find which ones tripped. A tripped rule stays
+ *		 tripped, and is not reported again, until its value is back
+ *		 inside the limits by the hysteresis.
+ *
+ *		 Each event is logged with two latencies: how long its scan took
+ *		 from acquisition to being checked, which is held against a bound
+ *		 given to Configure, and how long the outputs took to write.
+ *
+ *		 The class has no Windows or DASYLab dependencies and is not thread
+ *		 safe, so it can be exercised off target, as AlarmTableTest.cpp
+ *		 does.
+**/
+class AlarmTable {
+
+		// Constants
+		const static int MAX_EVENTS = 32;				// Events kept for the log
+
+		// Instance variables
+		bool active;
+		int numRules;
+		std::vector<AlarmRule> rules;
+		std::vector<int> source;
+		std::vector<double> low;
+		std::vector<double> high;
+		std::vector<double> clearLow;					// low + hysteresis
+		std::vector<double> clearHigh;					// high - hysteresis
+		std::vector<unsigned char> tripped;
+		std::vector<int> trips;							// Rules tripped by the last Check
+		std::vector<AlarmEvent> events;					// The first MAX_EVENTS events
+		unsigned long totalEvents;
+		double detectBoundMs;							// Longest a scan should take to be checked
+		unsigned long lateEvents;						// Events whose scan took longer than detectBoundMs
+		double worstDetectMs;
+		double worstWriteMs;
+
+	public:
+		const static int ACTION_NONE = 0;
+		const static int ACTION_DIGITAL = 1;
+		const static int ACTION_DAC = 2;
+
+		AlarmTable();
+		void Configure(const AlarmRule * newRules, int count, double boundMs);
+		void Disable();
+		bool IsActive();
+		int Check(const double * scan);
+		int GetTrip(int index);
+		const AlarmRule * GetRule(int rule);
+		void Log(int rule, unsigned long scanIndex, double value, double detectMs, double writeMs);
+		int GetNumEvents();
+		const AlarmEvent * GetEvent(int index);
+		unsigned long GetTotalEvents();
+		unsigned long GetLateEvents();
+		double GetDetectBoundMs();
+		double GetWorstDetectMs();
+		double GetWorstWriteMs();
+};
+#endif
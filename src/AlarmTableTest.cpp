@@ -0,0 +1,188 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: AlarmTableTest.cpp
+ * Desc: Off target check of AlarmTable: trip detection, latching with
+ *		 hysteresis, several rules tripping on one scan and the latencies
+ *		 logged for each alarm. Not part of the driver project; build and
+ *		 run it anywhere with:
+ *
+ *		 g++ -o AlarmTableTest AlarmTableTest.cpp AlarmTable.cpp
+ *		 ./AlarmTableTest
+ *
+ * Retn: 0 if every check passed, 1 otherwise
+ * Note: Built without the precompiled header so that it stays portable
+**/
+
+// Compiler
+#include <stdio.h>
+
+// Application
+#include "AlarmTable.h"
+
+/** Test settings **/
+static const double BOUND_MS = 10;				// Detection bound given to Configure
+static const int NUM_VALUES = 3;				// Values in a simulated scan
+
+static int failures = 0;
+
+/**
+ * Name: Expect(bool passed, const char * what)
+ * Desc: Counts and prints a failed check
+**/
+static void Expect(bool passed, const char * what)
+{
+	if (passed)
+		return;
+	printf("FAIL: %s\n", what);
+	failures++;
+}
+
+/**
+ * Name: MakeRule(int source, double low, double high, double hysteresis)
+ * Desc: Returns a rule driving digital line source to 1
+**/
+static AlarmRule MakeRule(int source, double low, double high, double hysteresis)
+{
+	AlarmRule rule;
+
+	rule.source = source;
+	rule.low = low;
+	rule.high = high;
+	rule.hysteresis = hysteresis;
+	rule.action = AlarmTable::ACTION_DIGITAL;
+	rule.channel = source;
+	rule.value = 1;
+	return rule;
+}
+
+/**
+ * Name: CheckValue(AlarmTable * table, double value)
+ * Desc: Checks a scan holding value in every position
+ * Retn: The number of rules that tripped
+**/
+static int CheckValue(AlarmTable * table, double value)
+{
+	double scan[NUM_VALUES];
+	int n;
+
+	for (n = 0; n < NUM_VALUES; n++)
+		scan[n] = value;
+	return table->Check(scan);
+}
+
+/**
+ * Name: TestTripAndLatch()
+ * Desc: One rule within [0, 5] V clearing 0.5 V inside its limits
+**/
+static void TestTripAndLatch()
+{
+	AlarmTable table;
+	AlarmRule rule = MakeRule(0, 0, 5, 0.5);
+
+	Expect(!table.IsActive(), "table active before Configure");
+	table.Configure(&rule, 1, BOUND_MS);
+	Expect(table.IsActive(), "table inactive after Configure");
+
+	Expect(CheckValue(&table, 2.5) == 0, "tripped inside the limits");
+	Expect(CheckValue(&table, 5) == 0, "tripped on the high limit itself");
+	Expect(CheckValue(&table, 5.1) == 1, "no trip above the high limit");
+	Expect(table.GetTrip(0) == 0, "wrong rule reported");
+
+	Expect(CheckValue(&table, 6) == 0, "reported again while still outside");
+	Expect(CheckValue(&table, 4.8) == 0, "reported again inside the hysteresis");
+	Expect(CheckValue(&table, 5.2) == 0, "cleared inside the hysteresis");
+	Expect(CheckValue(&table, 4.4) == 0, "reported while clearing");
+	Expect(CheckValue(&table, -0.1) == 1, "no trip below the low limit after clearing");
+	Expect(CheckValue(&table, 0.3) == 0, "reported again inside the low hysteresis");
+	Expect(CheckValue(&table, -1) == 0, "cleared inside the low hysteresis");
+
+	table.Disable();
+	Expect(!table.IsActive(), "table active after Disable");
+
+	table.Configure(&rule, 1, BOUND_MS);
+	Expect(CheckValue(&table, 6) == 1, "Configure did not clear the latch");
+}
+
+/**
+ * Name: TestSeveralRules()
+ * Desc: Rules on different values trip on the same scan or alone
+**/
+static void TestSeveralRules()
+{
+	AlarmTable table;
+	AlarmRule rules[3];
+	double scan[NUM_VALUES] = { 1, 1, 1 };
+
+	rules[0] = MakeRule(0, 0, 2, 0.1);
+	rules[1] = MakeRule(1, 0, 2, 0.1);
+	rules[2] = MakeRule(2, 0, 2, 0.1);
+	table.Configure(rules, 3, BOUND_MS);
+
+	Expect(table.Check(scan) == 0, "tripped inside the limits");
+
+	scan[0] = 3;
+	scan[2] = -1;
+	Expect(table.Check(scan) == 2, "two rules did not trip together");
+	Expect(table.GetTrip(0) == 0 && table.GetTrip(1) == 2, "wrong rules reported");
+	Expect(table.GetRule(2)->channel == 2, "wrong rule returned");
+
+	scan[1] = 2.5;
+	Expect(table.Check(scan) == 1, "third rule did not trip alone");
+	Expect(table.GetTrip(0) == 1, "wrong rule reported");
+}
+
+/**
+ * Name: TestLog()
+ * Desc: The latencies kept against the bound and the log's length
+**/
+static void TestLog()
+{
+	AlarmTable table;
+	AlarmRule rule = MakeRule(0, 0, 5, 0.5);
+	const AlarmEvent * event;
+	int n;
+
+	table.Configure(&rule, 1, BOUND_MS);
+	Expect(table.GetDetectBoundMs() == BOUND_MS, "bound not kept");
+
+	table.Log(0, 100, 5.5, 4, 1.5);
+	table.Log(0, 200, -0.5, 12, 0.5);
+	table.Log(0, 300, 6.5, BOUND_MS, 3);
+
+	Expect(table.GetTotalEvents() == 3, "events not counted");
+	Expect(table.GetLateEvents() == 1, "only detection over the bound is late");
+	Expect(table.GetWorstDetectMs() == 12, "worst detection latency");
+	Expect(table.GetWorstWriteMs() == 3, "worst write latency");
+	Expect(table.GetNumEvents() == 3, "events not kept");
+
+	event = table.GetEvent(1);
+	Expect(event->rule == 0 && event->scanIndex == 200 && event->value == -0.5,
+		   "event fields");
+	Expect(event->detectMs == 12 && event->writeMs == 0.5, "event latencies");
+
+	for (n = 0; n < 100; n++)
+		table.Log(0, 400 + n, 7, 1, 1);
+	Expect(table.GetTotalEvents() == 103, "events past the log not counted");
+	Expect(table.GetNumEvents() < 103, "log not limited");
+	Expect(table.GetEvent(0)->scanIndex == 100, "log does not keep the first events");
+
+	table.Configure(&rule, 1, BOUND_MS);
+	Expect(table.GetTotalEvents() == 0 && table.GetNumEvents() == 0 && table.GetLateEvents() == 0
+		   && table.GetWorstDetectMs() == 0 && table.GetWorstWriteMs() == 0, "Configure did not clear the log");
+}
+
+/**
+ * Name: main()
+ * Desc: Runs every check
+**/
+int main()
+{
+	TestTripAndLatch();
+	TestSeveralRules();
+	TestLog();
+
+	printf(failures ? "FAILED\n" : "PASSED\n");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,261 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: AutoRanger.cpp
+ * Desc: Range selection with hysteresis for auto-ranged analog inputs
+ * Note: Built without the precompiled header so that it stays portable
+**/
+
+// Class header file
+#include "AutoRanger.h"
+
+/** Hysteresis settings, as fractions of a range's limits **/
+static const double CLIP_FRACTION = 0.995;		// Readings this close to a limit may be clipped
+static const double UP_FRACTION = 0.9;			// Widen when a reading passes this
+static const double DOWN_FRACTION = 0.7;		// Narrow only when every reading stays inside this
+
+/**
+ * Name: AutoRanger()
+ * Desc: Creates an auto-ranger without ranges, which never switches
+**/
+AutoRanger::AutoRanger()
+{
+	numRanges = 0;
+	Reset(0, 0);
+}
+
+/**
+ * Name: SetRanges(const AutoRange * newRanges, int count)
+ * Desc: Sets the ranges of the device, ordered from widest to narrowest
+**/
+void AutoRanger::SetRanges(const AutoRange * newRanges, int count)
+{
+	int n;
+
+	if (count > MAX_RANGES)
+		count = MAX_RANGES;
+
+	for (n = 0; n < count; n++)
+		ranges[n] = newRanges[n];
+	numRanges = count;
+}
+
+/**
+ * Name: Reset(int channels, double holdMs)
+ * Desc: Disables every channel and puts it on the widest range at the
+ *		 start of an experiment
+**/
+void AutoRanger::Reset(int channels, double holdMs)
+{
+	int n;
+
+	numChannels = channels > MAX_CHANNELS ? MAX_CHANNELS : channels;
+	holdTime = holdMs;
+
+	for (n = 0; n < MAX_CHANNELS; n++)
+	{
+		enabled[n] = false;
+		current[n] = 0;
+		seen[n] = false;
+		low[n] = 0;
+		high[n] = 0;
+		fitSince[n] = -1;
+		fitRange[n] = 0;
+		changed[n] = false;
+	}
+
+	switches = 0;
+}
+
+/**
+ * Name: Enable(int channel)
+ * Desc: Lets the auto-ranger choose the range of a scan list entry
+**/
+void AutoRanger::Enable(int channel)
+{
+	if (channel >= 0 && channel < numChannels && numRanges > 1)
+		enabled[channel] = true;
+}
+
+/**
+ * Name: IsEnabled(int channel)
+ * Desc: Returns true if the range of the scan list entry is auto-ranged
+**/
+bool AutoRanger::IsEnabled(int channel)
+{
+	return channel >= 0 && channel < numChannels && enabled[channel];
+}
+
+/**
+ * Name: IsActive()
+ * Desc: Returns true if any channel is auto-ranged
+**/
+bool AutoRanger::IsActive()
+{
+	int n;
+
+	for (n = 0; n < numChannels; n++)
+	{
+		if (enabled[n])
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Name: Observe(int channel, double volts)
+ * Desc: Takes a reading of a scan list entry into account
+**/
+void AutoRanger::Observe(int channel, double volts)
+{
+	if (!IsEnabled(channel))
+		return;
+
+	if (!seen[channel])
+	{
+		seen[channel] = true;
+		low[channel] = volts;
+		high[channel] = volts;
+	}
+	else if (volts < low[channel])
+		low[channel] = volts;
+	else if (volts > high[channel])
+		high[channel] = volts;
+}
+
+/**
+ * Name: Update(double hostTime)
+ * Desc: Decides the range of every channel from the readings observed
+ *		 since the last call, at the given host time (ms)
+ * Retn: TRUE if any channel changed range and FALSE otherwise
+**/
+bool AutoRanger::Update(double hostTime)
+{
+	bool anyChanged = false;
+	int n, target;
+
+	for (n = 0; n < numChannels; n++)
+	{
+		changed[n] = false;
+		if (!enabled[n] || !seen[n])
+			continue;
+		seen[n] = false;
+
+		target = current[n];
+
+		if (!Fits(current[n], low[n], high[n], CLIP_FRACTION))
+		{
+			// Clipped, the real amplitude is unknown
+			target = 0;
+			fitSince[n] = -1;
+		}
+		else if (!Fits(current[n], low[n], high[n], UP_FRACTION))
+		{
+			// About to clip, go at least one range wider
+			target = FindNarrowest(low[n], high[n], DOWN_FRACTION);
+			if (target >= current[n])
+				target = current[n] > 0 ? current[n] - 1 : 0;
+			fitSince[n] = -1;
+		}
+		else
+		{
+			// Narrow only once the signal fitted for the whole hold time
+			target = FindNarrowest(low[n], high[n], DOWN_FRACTION);
+			if (target <= current[n])
+			{
+				fitSince[n] = -1;
+				target = current[n];
+			}
+			else if (fitSince[n] < 0)
+			{
+				fitSince[n] = hostTime;
+				fitRange[n] = target;
+				target = current[n];
+			}
+			else
+			{
+				if (target < fitRange[n])
+					fitRange[n] = target;
+
+				if (hostTime - fitSince[n] >= holdTime)
+				{
+					target = fitRange[n];
+					fitSince[n] = -1;
+				}
+				else
+					target = current[n];
+			}
+		}
+
+		if (target != current[n])
+		{
+			current[n] = target;
+			changed[n] = true;
+			anyChanged = true;
+			switches++;
+		}
+	}
+
+	return anyChanged;
+}
+
+/**
+ * Name: GetRange(int channel)
+ * Desc: Returns the LJ_rg the scan list entry should use
+**/
+long AutoRanger::GetRange(int channel)
+{
+	if (numRanges == 0 || channel < 0 || channel >= numChannels)
+		return 0;
+
+	return ranges[current[channel]].udRange;
+}
+
+/**
+ * Name: HasChanged(int channel)
+ * Desc: Returns true if the last Update changed the range of the entry
+**/
+bool AutoRanger::HasChanged(int channel)
+{
+	return channel >= 0 && channel < numChannels && changed[channel];
+}
+
+/**
+ * Name: GetSwitches()
+ * Desc: Returns the number of range changes since Reset
+**/
+unsigned long AutoRanger::GetSwitches()
+{
+	return switches;
+}
+
+/**
+ * Name: Fits(int range, double lowVolts, double highVolts, double fraction)
+ * Desc: (private) Returns true if the readings stay within the given
+ *		 fraction of the range's limits
+**/
+bool AutoRanger::Fits(int range, double lowVolts, double highVolts, double fraction)
+{
+	return lowVolts >= ranges[range].minVolts * fraction &&
+		   highVolts <= ranges[range].maxVolts * fraction;
+}
+
+/**
+ * Name: FindNarrowest(double lowVolts, double highVolts, double fraction)
+ * Desc: (private) Returns the index of the narrowest range the readings
+ *		 fit, or the widest range if none does
+**/
+int AutoRanger::FindNarrowest(double lowVolts, double highVolts, double fraction)
+{
+	int n;
+
+	for (n = numRanges - 1; n > 0; n--)
+	{
+		if (Fits(n, lowVolts, highVolts, fraction))
+			return n;
+	}
+
+	return 0;
+}
@@ -0,0 +1,73 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: AutoRanger.h
+ * Desc: Header file for AutoRanger object class
+**/
+
+#ifndef AUTORANGER_H
+#define AUTORANGER_H
+
+/**
+ * Name: AutoRange
+ * Desc: One input range a channel can be switched to
+**/
+struct AutoRange {
+	long udRange;									// LJ_rg of the range
+	double minVolts;								// Lowest input the range reads
+	double maxVolts;								// Highest input the range reads
+};
+
+/**
+ * Name: AutoRanger
+ * Desc: Picks the narrowest input range of each auto-ranged analog input
+ *		 that will not clip. The lowest and highest reading of every channel
+ *		 is collected while a batch of data is processed; Update then widens
+ *		 a channel as soon as it nears the limits of its range, straight to
+ *		 the widest range if it already clipped, and narrows it only after
+ *		 the signal fitted well inside a narrower range for a hold time.
+ *
+ *		 The class has no Windows or DASYLab dependencies and is not thread
+ *		 safe; the caller serializes Observe and Update. Host times are
+ *		 passed in, so signals can be simulated off target.
+**/
+class AutoRanger {
+
+		// Constants
+		const static int MAX_CHANNELS = 32;				// Entries in the analog input scan list
+		const static int MAX_RANGES = 8;
+
+		// Instance variables
+		AutoRange ranges[MAX_RANGES];					// Ranges of the device, widest first
+		int numRanges;
+		int numChannels;
+		double holdTime;								// Time a narrower range must fit before switching (ms)
+		bool enabled[MAX_CHANNELS];
+		int current[MAX_CHANNELS];						// Index into ranges of each channel
+		bool seen[MAX_CHANNELS];						// Readings were observed since the last Update
+		double low[MAX_CHANNELS];						// Lowest reading since the last Update (V)
+		double high[MAX_CHANNELS];						// Highest reading since the last Update (V)
+		double fitSince[MAX_CHANNELS];					// Time a narrower range started to fit, < 0 if none
+		int fitRange[MAX_CHANNELS];						// Widest narrower range that fitted since then
+		bool changed[MAX_CHANNELS];						// current changed in the last Update
+		unsigned long switches;							// Range changes since Reset
+
+	public:
+		AutoRanger();
+		void SetRanges(const AutoRange * newRanges, int count);
+		void Reset(int channels, double holdMs);
+		void Enable(int channel);
+		bool IsEnabled(int channel);
+		bool IsActive();
+		void Observe(int channel, double volts);
+		bool Update(double hostTime);
+		long GetRange(int channel);
+		bool HasChanged(int channel);
+		unsigned long GetSwitches();
+
+	private:
+		bool Fits(int range, double lowVolts, double highVolts, double fraction);
+		int FindNarrowest(double lowVolts, double highVolts, double fraction);
+};
+#endif
@@ -0,0 +1,162 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: BurstCapture.cpp
+ * Desc: Capture of a whole stop-after-N experiment into memory
+**/
+
+/** Includes **/
+
+// Windows
+#include "stdafx.h"
+#include <windows.h>
+#include <string.h>
+
+// Class header file
+#include "BurstCapture.h"
+
+// Application
+#include "Stopwatch.h"
+
+/**
+ * Name: BurstCapture()
+ * Desc: Creates an inactive capture
+**/
+BurstCapture::BurstCapture()
+{
+	active = FALSE;
+	buffer = NULL;
+	capacity = 0;
+	stored = 0;
+	delivered = 0;
+	startMs = 0;
+	capturedMs = 0;
+	deliveredMs = 0;
+}
+
+/**
+ * Name: Configure(LPSAMPLE newBuffer, DWORD samples)
+ * Desc: Starts capturing samples into newBuffer, which must hold them all
+ *		 and stay allocated until Disable. Called by DASYLab's thread
+ *		 before acquisition starts.
+**/
+void BurstCapture::Configure(LPSAMPLE newBuffer, DWORD samples)
+{
+	buffer = newBuffer;
+	capacity = samples;
+	InterlockedExchange(&stored, 0);
+	InterlockedExchange(&delivered, 0);
+	startMs = Stopwatch::GetTimeMs();
+	capturedMs = 0;
+	deliveredMs = 0;
+	active = TRUE;
+}
+
+/**
+ * Name: Disable()
+ * Desc: Stops capturing; samples go to the FIFO again. Called by DASYLab's
+ *		 thread once acquisition has stopped, before the buffer is freed.
+**/
+void BurstCapture::Disable()
+{
+	active = FALSE;
+}
+
+/**
+ * Name: IsActive()
+ * Desc: Returns true between Configure and Disable
+**/
+bool BurstCapture::IsActive()
+{
+	return active;
+}
+
+/**
+ * Name: Store(const SAMPLE * samples, int count)
+ * Desc: Appends the samples of one scan, called by the acquiring thread.
+ *		 Scans after the buffer is full are dropped.
+ * Retn: FALSE once the buffer is full
+**/
+bool BurstCapture::Store(const SAMPLE * samples, int count)
+{
+	DWORD used = (DWORD)stored;
+
+	if (used >= capacity)
+		return FALSE;
+
+	if ((DWORD)count > capacity - used)
+		count = (int)(capacity - used);
+	memcpy(buffer + used, samples, sizeof(SAMPLE) * count);
+
+	// Publish the samples only after they are written
+	InterlockedExchange(&stored, (LONG)(used + count));
+	if (used + count < capacity)
+		return TRUE;
+
+	capturedMs = Stopwatch::GetTimeMs() - startMs;
+	return FALSE;
+}
+
+/**
+ * Name: GetAvailable()
+ * Desc: Returns the samples stored but not yet taken out, called by
+ *		 DASYLab's thread
+**/
+DWORD BurstCapture::GetAvailable()
+{
+	return (DWORD)stored - (DWORD)delivered;
+}
+
+/**
+ * Name: GetNext()
+ * Desc: Returns the first sample not yet taken out, called by DASYLab's
+ *		 thread
+**/
+const SAMPLE * BurstCapture::GetNext()
+{
+	return buffer + delivered;
+}
+
+/**
+ * Name: Consume(DWORD count)
+ * Desc: Marks count samples from GetNext as taken out, called by DASYLab's
+ *		 thread once it has copied them
+**/
+void BurstCapture::Consume(DWORD count)
+{
+	DWORD taken = (DWORD)delivered + count;
+
+	// Publish the count only after the samples were read
+	InterlockedExchange(&delivered, (LONG)taken);
+	if (taken >= capacity && deliveredMs == 0)
+		deliveredMs = Stopwatch::GetTimeMs() - startMs;
+}
+
+/**
+ * Name: GetCapacity()
+ * Desc: Returns the samples the experiment captures
+**/
+DWORD BurstCapture::GetCapacity()
+{
+	return capacity;
+}
+
+/**
+ * Name: GetCapturedMs()
+ * Desc: Returns how long capturing took, or 0 if it is not complete (ms)
+**/
+double BurstCapture::GetCapturedMs()
+{
+	return capturedMs;
+}
+
+/**
+ * Name: GetDeliveredMs()
+ * Desc: Returns how long it took until DASYLab had every sample, or 0 if
+ *		 it does not yet (ms)
+**/
+double BurstCapture::GetDeliveredMs()
+{
+	return deliveredMs;
+}
@@ -0,0 +1,63 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: BurstCapture.h
+ * Desc: Header file for BurstCapture object class
+**/
+
+#ifndef BURSTCAPTURE_H
+#define BURSTCAPTURE_H
+
+//	Windows
+#include "stdafx.h"
+#include <windows.h>
+
+//	DASYLab driver interface
+#include "treiber.h"
+
+/**
+ * Name: BurstCapture
+ * Desc: Records a stop-after-N experiment into a buffer large enough for
+ *		 all of it instead of DASYLab's FIFO, so a short burst at the full
+ *		 stream rate cannot overrun DASYLab. The acquiring thread appends
+ *		 converted scans; DASYLab's thread takes them out at its own pace.
+ *		 They share the counts of samples stored and delivered, each
+ *		 written by one thread only and published with an interlocked
+ *		 exchange.
+ *
+ *		 Store runs on the acquiring thread, which also checks IsActive.
+ *		 Every other method runs on DASYLab's thread, Configure and Disable
+ *		 only while no stream or timer is running.
+ *
+ *		 Configured in the driver INI file:
+ *
+ *		 [Burst]
+ *		 Enabled=0				; capture DRV_AQM_STOP experiments in a burst
+**/
+class BurstCapture {
+
+		// Instance variables
+		bool active;
+		LPSAMPLE buffer;								// Locked memory owned by the device layer
+		DWORD capacity;									// Samples the experiment captures
+		volatile LONG stored;							// Samples written by the acquiring thread
+		volatile LONG delivered;						// Samples taken out by DASYLab's thread
+		double startMs;									// When Configure was called
+		double capturedMs;								// Time from Configure until the buffer was full
+		double deliveredMs;								// Time from Configure until everything was taken
+
+	public:
+		BurstCapture();
+		void Configure(LPSAMPLE newBuffer, DWORD samples);
+		void Disable();
+		bool IsActive();
+		bool Store(const SAMPLE * samples, int count);
+		DWORD GetAvailable();
+		const SAMPLE * GetNext();
+		void Consume(DWORD count);
+		DWORD GetCapacity();
+		double GetCapturedMs();
+		double GetDeliveredMs();
+};
+#endif
@@ -0,0 +1,274 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: CalibrationCache.cpp
+ * Desc: Per device calibration constants cached in the driver INI file
+**/
+
+/** Includes **/
+
+// Windows
+#include "stdafx.h"
+#include <windows.h>
+#include <stdio.h>
+#include <math.h>
+
+//	LabJack
+#include "c:\program files\labjack\drivers\LabJackUD.h" // TODO: needs to be flexible
+
+// Class header file
+#include "CalibrationCache.h"
+
+// Application
+#include "DriverSettings.h"
+#include "DeviceModel.h"
+
+/**
+ * Calibration memory layouts, as indices into the doubles returned for
+ * LJ_chCAL_CONSTANTS, which come in the order of the calibration memory.
+ * From the "Calibration Constants" tables of section 5.4 of the U6 and
+ * UE9 User's Guides. Only the default resolution constants are used;
+ * the high resolution ADC of the Pro models has its own blocks.
+**/
+
+// U6, blocks 0 and 1: the positive slope of each range at 0-7, then the
+// negative slope and center count of each range at 8-15
+static const CalibrationRange U6_RANGES[] = {
+	{ LJ_rgBIP10V,   0,  9,  8 },
+	{ LJ_rgBIP1V,    2, 11, 10 },
+	{ LJ_rgBIPP1V,   4, 13, 12 },
+	{ LJ_rgBIPP01V,  6, 15, 14 }
+};
+
+// UE9, blocks 0 and 1: slope and offset of the unipolar gains 1, 2, 4
+// and 8 at 0-7, then of the bipolar gain 1 at 8-9
+static const CalibrationRange UE9_RANGES[] = {
+	{ LJ_rgBIP5V,     8,  9, -1 },
+	{ LJ_rgUNI5V,     0,  1, -1 },
+	{ LJ_rgUNI2P5V,   2,  3, -1 },
+	{ LJ_rgUNI1P25V,  4,  5, -1 },
+	{ LJ_rgUNIP625V,  6,  7, -1 }
+};
+
+// The U3 has a single range per channel and its high voltage channels use
+// per channel constants, so its limits stay nominal
+
+/** Largest share of the nominal span a calibrated limit may differ by **/
+static const double MAX_DEVIATION = 0.1;
+
+/**
+ * Name: CalibrationCache()
+ * Desc: Creates an empty cache
+**/
+CalibrationCache::CalibrationCache()
+{
+	Clear();
+}
+
+/**
+ * Name: Clear()
+ * Desc: Forgets the constants and the compiled table
+**/
+void CalibrationCache::Clear()
+{
+	int n;
+
+	for (n = 0; n < MAX_CONSTANTS; n++)
+		constants[n] = 0;
+
+	serialNumber = 0;
+	cached = FALSE;
+	numRanges = 0;
+}
+
+/**
+ * Name: Load(long handle, long deviceType, long newSerialNumber)
+ * Desc: Gets the constants of the open device, from the INI file if this
+ *		 serial number and firmware version were seen before and from the
+ *		 device otherwise, then compiles the range table
+ * Retn: TRUE if the device is calibrated and FALSE if nominal limits
+ *		 must be used
+**/
+bool CalibrationCache::Load(long handle, long deviceType, long newSerialNumber)
+{
+	double firmwareVersion = 0;
+	char section[32];
+	char firmware[16];
+
+	Clear();
+
+	if (newSerialNumber == 0)
+		return FALSE;
+
+	if (eGet(handle, LJ_ioGET_CONFIG, LJ_chFIRMWARE_VERSION, &firmwareVersion, 0) != LJE_NOERROR)
+		return FALSE;
+
+	sprintf(section, "Calibration%ld", newSerialNumber);
+	sprintf(firmware, "%.3f", firmwareVersion);
+
+	cached = ReadCache(section, firmware);
+	if (!cached)
+	{
+		if (eGet(handle, LJ_ioGET_CONFIG, LJ_chCAL_CONSTANTS, 0, (long)&constants[0]) != LJE_NOERROR)
+		{
+			Clear();
+			return FALSE;
+		}
+		WriteCache(section, firmware);
+	}
+
+	serialNumber = newSerialNumber;
+	Compile(deviceType);
+
+	return IsCalibrated();
+}
+
+/**
+ * Name: ReadCache(const char * section, const char * firmware)
+ * Desc: (private) Reads the constants from the INI file
+ * Retn: TRUE if they were there for this firmware version and FALSE otherwise
+**/
+bool CalibrationCache::ReadCache(const char * section, const char * firmware)
+{
+	char key[8];
+	int n;
+
+	if (DriverSettings::GetString(section, "Firmware", "") != firmware)
+		return FALSE;
+
+	for (n = 0; n < MAX_CONSTANTS; n++)
+	{
+		sprintf(key, "C%d", n);
+		constants[n] = DriverSettings::GetDouble(section, key, 0);
+	}
+
+	return TRUE;
+}
+
+/**
+ * Name: WriteCache(const char * section, const char * firmware)
+ * Desc: (private) Writes the constants to the INI file. The firmware
+ *		 version goes last so a partly written section is never used.
+**/
+void CalibrationCache::WriteCache(const char * section, const char * firmware)
+{
+	char key[8];
+	char value[32];
+	int n;
+
+	DriverSettings::PutString(section, "Firmware", NULL);
+	for (n = 0; n < MAX_CONSTANTS; n++)
+	{
+		sprintf(key, "C%d", n);
+		sprintf(value, "%.10e", constants[n]);
+		DriverSettings::PutString(section, key, value);
+	}
+	DriverSettings::PutString(section, "Firmware", firmware);
+}
+
+/**
+ * Name: Compile(long deviceType)
+ * Desc: (private) Works out the calibrated lowest and highest input of
+ *		 every range of the model. Ranges whose constants are blank, or
+ *		 give limits more than MAX_DEVIATION of the span from the nominal
+ *		 ones (as constants read from the wrong place would), are left out
+ *		 so they fall back to nominal limits.
+**/
+void CalibrationCache::Compile(long deviceType)
+{
+	const CalibrationRange * layout;
+	const InputRange * nominal;
+	int n, count;
+	double slope, offset, low, high, tolerance;
+
+	switch (deviceType)
+	{
+	case LJ_dtU6:
+		layout = U6_RANGES;
+		count = sizeof(U6_RANGES) / sizeof(U6_RANGES[0]);
+		break;
+	case LJ_dtUE9:
+		layout = UE9_RANGES;
+		count = sizeof(UE9_RANGES) / sizeof(UE9_RANGES[0]);
+		break;
+	default:
+		return;
+	}
+
+	numRanges = 0;
+	for (n = 0; n < count && numRanges < MAX_RANGES; n++)
+	{
+		slope = constants[layout[n].slopeIndex];
+		offset = constants[layout[n].offsetIndex];
+
+		if (layout[n].negSlopeIndex >= 0)
+		{
+			// offset is the center count
+			high = (MAX_COUNT - offset) * slope;
+			low = -offset * constants[layout[n].negSlopeIndex];
+		}
+		else
+		{
+			low = offset;
+			high = MAX_COUNT * slope + offset;
+		}
+
+		if (slope <= 0 || high <= low)
+			continue;
+
+		nominal = DeviceModels::FindRange(layout[n].udRange);
+		if (nominal == NULL)
+			continue;
+		tolerance = (nominal->maxVolts - nominal->minVolts) * MAX_DEVIATION;
+		if (fabs(low - nominal->minVolts) > tolerance || fabs(high - nominal->maxVolts) > tolerance)
+			continue;
+
+		rangeCodes[numRanges] = layout[n].udRange;
+		rangeMin[numRanges] = low;
+		rangeMax[numRanges] = high;
+		numRanges++;
+	}
+}
+
+/**
+ * Name: GetRange(long udRange, double * minVolts, double * maxVolts)
+ * Desc: Gets the calibrated limits of a range
+ * Retn: TRUE if the range is calibrated and FALSE otherwise (the limits
+ *		 are left unchanged)
+**/
+bool CalibrationCache::GetRange(long udRange, double * minVolts, double * maxVolts)
+{
+	int n;
+
+	for (n = 0; n < numRanges; n++)
+	{
+		if (rangeCodes[n] == udRange)
+		{
+			*minVolts = rangeMin[n];
+			*maxVolts = rangeMax[n];
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/**
+ * Name: IsCalibrated()
+ * Desc: Returns true if any range has calibrated limits
+**/
+bool CalibrationCache::IsCalibrated()
+{
+	return numRanges > 0;
+}
+
+/**
+ * Name: WasCached()
+ * Desc: Returns true if the constants came from the INI file rather
+ *		 than the device
+**/
+bool CalibrationCache::WasCached()
+{
+	return cached;
+}
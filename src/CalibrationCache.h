@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: CalibrationCache.h
+ * Desc: Header file for CalibrationCache object class
+**/
+
+#ifndef CALIBRATIONCACHE_H
+#define CALIBRATIONCACHE_H
+
+//	Windows
+#include "stdafx.h"
+#include <windows.h>
+
+/**
+ * Name: CalibrationRange
+ * Desc: Where a model keeps the constants of one input range in its
+ *		 calibration memory. Models calibrated around a center point give
+ *		 negSlopeIndex; models with a plain slope and offset give -1.
+**/
+struct CalibrationRange {
+	long udRange;									// LJ_rg the constants apply to
+	int slopeIndex;									// Volts per count (above center)
+	int offsetIndex;								// Volts at count 0, or the center count
+	int negSlopeIndex;								// Volts per count below center, -1 if none
+};
+
+/**
+ * Name: CalibrationCache
+ * Desc: The calibration constants of one device, read once and kept in the
+ *		 driver INI file under the device's serial number and firmware
+ *		 version so that reopening a known device skips the read. The
+ *		 constants are compiled into a flat table of the calibrated input
+ *		 limits of each range. The UD driver applies the constants itself
+ *		 and returns calibrated volts, so they do not change readings; they
+ *		 only make the input limits reported to DASYLab those of this
+ *		 device rather than the nominal ones.
+ *
+ *		 [Calibration360012345]
+ *		 Firmware=1.150
+ *		 C0=3.1580578e-004
+ *		 ...
+**/
+class CalibrationCache {
+
+		// Constants
+		const static int MAX_CONSTANTS = 64;			// Doubles returned for LJ_chCAL_CONSTANTS
+		const static int MAX_RANGES = 8;
+		const static int MAX_COUNT = 65535;				// Largest 16 bit reading the constants apply to
+
+		// Instance variables
+		double constants[MAX_CONSTANTS];				// Raw calibration memory
+		long serialNumber;								// Device the constants belong to, 0 if none
+		bool cached;									// The constants came from the INI file
+		long rangeCodes[MAX_RANGES];					// Compiled table: LJ_rg of each calibrated range
+		double rangeMin[MAX_RANGES];					// Calibrated lowest input (V)
+		double rangeMax[MAX_RANGES];					// Calibrated highest input (V)
+		int numRanges;
+
+	public:
+		CalibrationCache();
+		bool Load(long handle, long deviceType, long newSerialNumber);
+		void Clear();
+		bool GetRange(long udRange, double * minVolts, double * maxVolts);
+		bool IsCalibrated();
+		bool WasCached();
+
+	private:
+		bool ReadCache(const char * section, const char * firmware);
+		void WriteCache(const char * section, const char * firmware);
+		void Compile(long deviceType);
+};
+#endif
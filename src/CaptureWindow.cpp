@@ -0,0 +1,202 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: CaptureWindow.cpp
+ * Desc: Block mode capture windows over a running stream
+**/
+
+/** Includes **/
+
+// Windows
+#include "stdafx.h"
+#include <windows.h>
+
+// Class header file
+#include "CaptureWindow.h"
+
+// Application
+#include "Stopwatch.h"
+
+/**
+ * Name: CaptureWindow()
+ * Desc: Creates an inactive gate that lets everything through
+**/
+CaptureWindow::CaptureWindow()
+{
+	active = FALSE;
+	blockSamples = 0;
+	minBlocks = 0;
+	windowSamples = 0;
+	windowBlocks = 0;
+	samplesLeft = 0;
+	intervalMs = 0;
+	windowStartMs = 0;
+	openAtMs = 0;
+	rearmRequested = FALSE;
+	windows = 0;
+	skippedScans = 0;
+	rearmMs = 0;
+	InitializeCriticalSection(&lock);
+}
+
+/**
+ * Name: ~CaptureWindow()
+ * Desc: Frees the lock
+**/
+CaptureWindow::~CaptureWindow()
+{
+	DeleteCriticalSection(&lock);
+}
+
+/**
+ * Name: Configure(long newBlockSamples, long blocks, double newIntervalMs)
+ * Desc: Opens the first window of at least blocks blocks of newBlockSamples
+ *		 each. Later windows open when Rearm was called, no sooner than
+ *		 newIntervalMs after the previous one opened.
+**/
+void CaptureWindow::Configure(long newBlockSamples, long blocks, double newIntervalMs)
+{
+	blockSamples = newBlockSamples;
+	minBlocks = blocks;
+	windowSamples = 0;
+	InterlockedExchange(&windowBlocks, blocks);
+	samplesLeft = 0;
+	intervalMs = newIntervalMs;
+	EnterCriticalSection(&lock);
+	windowStartMs = Stopwatch::GetTimeMs();
+	openAtMs = windowStartMs;
+	LeaveCriticalSection(&lock);
+	InterlockedExchange(&rearmRequested, FALSE);
+	windows = 1;
+	skippedScans = 0;
+	rearmMs = 0;
+	active = TRUE;
+}
+
+/**
+ * Name: Disable()
+ * Desc: Stops gating; every scan is accepted
+**/
+void CaptureWindow::Disable()
+{
+	active = FALSE;
+}
+
+/**
+ * Name: IsActive()
+ * Desc: Returns true between Configure and Disable
+**/
+bool CaptureWindow::IsActive()
+{
+	return active;
+}
+
+/**
+ * Name: Accept(int scanSamples)
+ * Desc: Decides whether the next scan of scanSamples values goes into the
+ *		 FIFO. A closed gate only reads the clock once a rearm is pending.
+ * Retn: TRUE if the scan is part of a window
+**/
+bool CaptureWindow::Accept(int scanSamples)
+{
+	double now;
+	long unit, a, b, r;
+
+	if (!active)
+		return TRUE;
+
+	// First scan: round the window to whole blocks and whole scans
+	if (windowSamples == 0)
+	{
+		for (a = blockSamples, b = scanSamples; b != 0; a = b, b = r)
+			r = a % b;
+		unit = blockSamples / a * scanSamples;
+		windowSamples = (minBlocks * blockSamples + unit - 1) / unit * unit;
+		samplesLeft = windowSamples;
+		InterlockedExchange(&windowBlocks, windowSamples / blockSamples);
+	}
+
+	if (samplesLeft <= 0)
+	{
+		if (!rearmRequested)
+		{
+			skippedScans++;
+			return FALSE;
+		}
+
+		now = Stopwatch::GetTimeMs();
+		EnterCriticalSection(&lock);
+		if (now < openAtMs)
+		{
+			LeaveCriticalSection(&lock);
+			skippedScans++;
+			return FALSE;
+		}
+
+		rearmMs += now - openAtMs;
+		windowStartMs = now;
+		LeaveCriticalSection(&lock);
+		windows++;
+		samplesLeft = windowSamples;
+		InterlockedExchange(&rearmRequested, FALSE);
+	}
+
+	samplesLeft -= scanSamples;
+	return TRUE;
+}
+
+/**
+ * Name: Rearm()
+ * Desc: Lets the next window open, called once DASYLab has read the last
+ *		 block of the current one
+**/
+void CaptureWindow::Rearm()
+{
+	double now = Stopwatch::GetTimeMs();
+
+	EnterCriticalSection(&lock);
+	openAtMs = windowStartMs + intervalMs;
+	if (openAtMs < now)
+		openAtMs = now;
+	LeaveCriticalSection(&lock);
+	InterlockedExchange(&rearmRequested, TRUE);
+}
+
+/**
+ * Name: GetWindowBlocks()
+ * Desc: Returns the blocks DASYLab reads per window. Until the first scan
+ *		 rounds the window this is the requested count.
+**/
+long CaptureWindow::GetWindowBlocks()
+{
+	return windowBlocks;
+}
+
+/**
+ * Name: GetWindows()
+ * Desc: Returns the windows opened since Configure
+**/
+DWORD CaptureWindow::GetWindows()
+{
+	return windows;
+}
+
+/**
+ * Name: GetSkippedScans()
+ * Desc: Returns the scans dropped between windows
+**/
+DWORD CaptureWindow::GetSkippedScans()
+{
+	return skippedScans;
+}
+
+/**
+ * Name: GetMeanRearmMs()
+ * Desc: Returns how long a window took on average to receive its first
+ *		 scan once it was allowed to open (ms)
+**/
+double CaptureWindow::GetMeanRearmMs()
+{
+	return windows > 1 ? rearmMs / (windows - 1) : 0;
+}
@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: CaptureWindow.h
+ * Desc: Header file for CaptureWindow object class
+**/
+
+#ifndef CAPTUREWINDOW_H
+#define CAPTUREWINDOW_H
+
+//	Windows
+#include "stdafx.h"
+#include <windows.h>
+
+/**
+ * Name: CaptureWindow
+ * Desc: Gate in front of DASYLab's FIFO for DRV_AQM_BLOCK. A window lets
+ *		 a fixed number of samples through, then the gate closes and scans
+ *		 are dropped while the stream keeps running. Once DASYLab has read
+ *		 the whole window, Rearm opens the gate again at the next scan, so
+ *		 a new window costs a flag instead of a stream restart.
+ *
+ *		 A window is a whole number of DASYLab blocks and a whole number of
+ *		 scans, so every window starts on both a block and a channel
+ *		 boundary. The scan width is only known once scans arrive, so the
+ *		 first Accept rounds the window up to the least such size.
+ *
+ *		 Accept is called by the acquiring thread and Rearm and
+ *		 GetWindowBlocks by DASYLab's. They share the rearm flag and the
+ *		 rounded block count, exchanged with interlocked calls, and the
+ *		 window times, which lock guards.
+ *
+ *		 Configured in the driver INI file:
+ *
+ *		 [BlockMode]
+ *		 IntervalMs=0			; least time from one window's start to the next
+**/
+class CaptureWindow {
+
+		// Instance variables
+		bool active;
+		long blockSamples;								// Samples in one DASYLab block
+		long minBlocks;									// Blocks requested per window
+		long windowSamples;								// Samples let through per window, 0 until rounded
+		volatile LONG windowBlocks;						// Blocks per window after rounding
+		long samplesLeft;								// Samples still to come in this window, 0 while closed
+		double intervalMs;								// Least time between the starts of two windows
+		CRITICAL_SECTION lock;							// Guards windowStartMs and openAtMs
+		double windowStartMs;							// When the current window opened
+		double openAtMs;								// Earliest time the next window may open
+		volatile LONG rearmRequested;					// Set by Rearm, cleared when the window opens
+		DWORD windows;									// Windows opened in this experiment
+		DWORD skippedScans;								// Scans dropped while closed
+		double rearmMs;									// Time from openAtMs to the first scan, summed over windows
+
+	public:
+		CaptureWindow();
+		~CaptureWindow();
+		void Configure(long newBlockSamples, long blocks, double newIntervalMs);
+		void Disable();
+		bool IsActive();
+		bool Accept(int scanSamples);
+		void Rearm();
+		long GetWindowBlocks();
+		DWORD GetWindows();
+		DWORD GetSkippedScans();
+		double GetMeanRearmMs();
+};
+#endif
@@ -0,0 +1,169 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: ChannelTable.cpp
+ * Desc: Per-scan conversion descriptors built from the experiment plan
+**/
+
+// Windows
+#include "stdafx.h"
+#include <windows.h>
+
+// Compiler
+#include <limits.h>
+
+// Class header file
+#include "ChannelTable.h"
+
+/** Cold junction temperature assumed until one is measured (C) **/
+static const double DEFAULT_COLD_JUNCTION = 25;
+
+/**
+ * Name: ChannelTable()
+ * Desc: Creates an empty table
+**/
+ChannelTable::ChannelTable()
+{
+	numEntries = 0;
+}
+
+/**
+ * Name: Build(ExperimentPlan * plan)
+ * Desc: Lays out the entries of the plan's scan. The device scan holds
+ *		 the streamed analog inputs, one word with the state of all
+ *		 digital lines (stream channel 193 or the polled bits) and the
+ *		 latest value of each slow input; the plan gives each value's
+ *		 position. Thermocouples start with the cold junction at 25 C until
+ *		 SetColdJunction is called.
+**/
+void ChannelTable::Build(ExperimentPlan * plan)
+{
+	const AnalogInputPlan * analogInputs = plan->GetAnalogInputs();
+	const int * digitalInputs = plan->GetDigitalInputs();
+	int numAIN = plan->GetNumAnalogInputs();
+	int numDI = plan->GetNumDigitalInputs();
+	int i, n, tc;
+
+	// Sized once per experiment, nothing is allocated while converting
+	numEntries = numAIN + numDI;
+	scale.resize(numEntries);
+	offset.resize(numEntries);
+	clampLow.resize(numEntries);
+	clampHigh.resize(numEntries);
+	bitMask.resize(numEntries);
+	source.resize(numEntries);
+	type.resize(numEntries);
+	thermocouple.resize(numEntries);
+	coldJunction.resize(numEntries);
+	converted.resize(numEntries);
+	linearizers.resize(Thermocouples::GetNumTypes());
+
+	n = 0;
+	for (i = 0; i < numAIN; i++, n++)
+	{
+		type[n] = ENTRY_ANALOG;
+		source[n] = (WORD)analogInputs[i].source;
+		scale[n] = analogInputs[i].scale;
+		offset[n] = 0;							// The UD driver returns calibrated volts
+		clampLow[n] = SHRT_MIN;
+		clampHigh[n] = SHRT_MAX;
+		bitMask[n] = 0;
+		thermocouple[n] = 0;
+		coldJunction[n] = 0;
+
+		tc = analogInputs[i].thermocouple;
+		if (tc >= 0)
+		{
+			type[n] = ENTRY_THERMOCOUPLE;
+			thermocouple[n] = (BYTE)tc;
+			coldJunction[n] = Thermocouples::GetMillivolts(tc, DEFAULT_COLD_JUNCTION);
+			if (!linearizers[tc].IsBuilt())
+				linearizers[tc].Build(tc, LINEARIZER_POINTS);
+		}
+	}
+
+	for (i = 0; i < numDI; i++, n++)
+	{
+		type[n] = ENTRY_DIGITAL;
+		source[n] = (WORD)plan->GetDigitalSource();
+		scale[n] = 1;
+		offset[n] = 0;
+		clampLow[n] = 0;
+		clampHigh[n] = 1;
+		bitMask[n] = 1UL << digitalInputs[i];
+		thermocouple[n] = 0;
+		coldJunction[n] = 0;
+	}
+}
+
+/**
+ * Name: GetNumEntries()
+ * Desc: Returns the number of values in one scan
+**/
+int ChannelTable::GetNumEntries()
+{
+	return numEntries;
+}
+
+/**
+ * Name: SetScale(int entry, double newScale)
+ * Desc: Changes the volts to SAMPLE factor of an analog entry, for an
+ *		 input whose range changed while running
+**/
+void ChannelTable::SetScale(int entry, double newScale)
+{
+	scale[entry] = newScale;
+}
+
+/**
+ * Name: SetColdJunction(double celsius)
+ * Desc: Sets the temperature of the thermocouples' cold junction. Each
+ *		 thermocouple keeps the reference function voltage of its type
+ *		 there, so compensating a reading is one addition.
+**/
+void ChannelTable::SetColdJunction(double celsius)
+{
+	int n;
+
+	for (n = 0; n < numEntries; n++)
+	{
+		if (type[n] == ENTRY_THERMOCOUPLE)
+			coldJunction[n] = Thermocouples::GetMillivolts(thermocouple[n], celsius);
+	}
+}
+
+/**
+ * Name: ConvertScan(const double * scan)
+ * Desc: Converts one device scan into DASYLab samples, clipping rather
+ *		 than wrapping readings beyond full scale. A thermocouple's volts
+ *		 plus its cold junction voltage are looked up in the table of its
+ *		 type, which gives the temperature that is scaled.
+ * Retn: The GetNumEntries() samples of the scan, valid until the next call
+**/
+const SAMPLE * ChannelTable::ConvertScan(const double * scan)
+{
+	double value;
+	int n;
+
+	for (n = 0; n < numEntries; n++)
+	{
+		if (type[n] == ENTRY_DIGITAL)
+		{
+			converted[n] = ((DWORD)scan[source[n]] & bitMask[n]) != 0;
+			continue;
+		}
+
+		if (type[n] == ENTRY_THERMOCOUPLE)
+			value = linearizers[thermocouple[n]].GetCelsius(scan[source[n]] * 1000 + coldJunction[n]) * scale[n] + offset[n];
+		else
+			value = scan[source[n]] * scale[n] + offset[n];
+		if (value > clampHigh[n])
+			value = clampHigh[n];
+		else if (value < clampLow[n])
+			value = clampLow[n];
+		converted[n] = (SAMPLE)value;
+	}
+
+	return numEntries > 0 ? &converted[0] : NULL;
+}
@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: ChannelTable.h
+ * Desc: Header file for ChannelTable object class
+**/
+
+#ifndef CHANNELTABLE_H
+#define CHANNELTABLE_H
+
+//	Windows
+#include "stdafx.h"
+#include <windows.h>
+
+//	Compiler
+#include <vector>
+
+//	DASYLab driver interface
+#include "treiber.h"
+
+// Application
+#include "ExperimentPlan.h"
+#include "Thermocouple.h"
+
+/**
+ * Name: ChannelTable
+ * Desc: Compact descriptors of the values in one scan, kept apart from
+ *		 DRV_INFOSTRUCT so that converting a scan touches a few small
+ *		 contiguous arrays instead of the channel arrays of the structure.
+ *		 Each field is its own array (structure of arrays) indexed by entry;
+ *		 entries are in FIFO order, every analog input of the plan followed
+ *		 by every digital input, so entry n is written to slot n of the
+ *		 scan. Built when the experiment starts and only read while it runs,
+ *		 apart from the cold junction voltage of the thermocouples.
+**/
+class ChannelTable {
+
+		// Constants
+		const static BYTE ENTRY_ANALOG = 0;
+		const static BYTE ENTRY_DIGITAL = 1;
+		const static BYTE ENTRY_THERMOCOUPLE = 2;
+		const static int LINEARIZER_POINTS = 4096;		// Table size of each thermocouple type
+
+		// Instance variables
+		int numEntries;
+		std::vector<double> scale;						// Volts to SAMPLE factor
+		std::vector<double> offset;						// Added after scaling (SAMPLE)
+		std::vector<double> clampLow;					// Lowest SAMPLE written
+		std::vector<double> clampHigh;					// Highest SAMPLE written
+		std::vector<DWORD> bitMask;						// Line of a digital input in the state word
+		std::vector<WORD> source;						// Index of the reading in the device scan
+		std::vector<BYTE> type;							// ENTRY_ANALOG, ENTRY_DIGITAL or ENTRY_THERMOCOUPLE
+		std::vector<BYTE> thermocouple;					// Type of a thermocouple, index into linearizers
+		std::vector<double> coldJunction;				// Reference function at the cold junction (mV)
+		std::vector<ThermocoupleLinearizer> linearizers;	// One per type, built when first used
+		std::vector<SAMPLE> converted;					// The last scan converted
+
+	public:
+		ChannelTable();
+		void Build(ExperimentPlan * plan);
+		int GetNumEntries();
+		void SetScale(int entry, double newScale);
+		void SetColdJunction(double celsius);
+		const SAMPLE * ConvertScan(const double * scan);
+};
+#endif
@@ -0,0 +1,211 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: ControlLoop.cpp
+ * Desc: PID control and loop timing for the command-response tick
+ * Note: Built without the precompiled header so that it stays portable
+**/
+
+// Class header file
+#include "ControlLoop.h"
+
+/**
+ * Name: ControlLoop()
+ * Desc: Creates a loop with zero gains
+**/
+ControlLoop::ControlLoop()
+{
+	settings.input = 0;
+	settings.output = 0;
+	settings.setpoint = 0;
+	settings.kp = 0;
+	settings.ki = 0;
+	settings.kd = 0;
+	settings.outMin = 0;
+	settings.outMax = 0;
+	dt = 1;
+	integral = 0;
+	lastInput = 0;
+	primed = false;
+	output = 0;
+}
+
+/**
+ * Name: Configure(const ControlSettings * newSettings, double newDt)
+ * Desc: Sets up the loop to be updated every newDt seconds, starting from
+ *		 an output of 0 V limited to the output range
+**/
+void ControlLoop::Configure(const ControlSettings * newSettings, double newDt)
+{
+	settings = *newSettings;
+	dt = newDt > 0 ? newDt : 1;
+	integral = 0;
+	lastInput = 0;
+	primed = false;
+
+	output = 0;
+	if (output < settings.outMin)
+		output = settings.outMin;
+	if (output > settings.outMax)
+		output = settings.outMax;
+}
+
+/**
+ * Name: Update(double measurement)
+ * Desc: Computes the output for a new measurement of the input
+ * Retn: The output (V), also returned by GetOutput until the next update
+**/
+double ControlLoop::Update(double measurement)
+{
+	double error, derivative;
+
+	error = settings.setpoint - measurement;
+
+	integral += settings.ki * error * dt;
+	if (integral > settings.outMax)
+		integral = settings.outMax;
+	else if (integral < settings.outMin)
+		integral = settings.outMin;
+
+	derivative = primed ? -settings.kd * (measurement - lastInput) / dt : 0;
+	lastInput = measurement;
+	primed = true;
+
+	output = settings.kp * error + integral + derivative;
+	if (output > settings.outMax)
+		output = settings.outMax;
+	else if (output < settings.outMin)
+		output = settings.outMin;
+
+	return output;
+}
+
+/**
+ * Name: SetSetpoint(double volts)
+ * Desc: Changes the wanted value of the input
+**/
+void ControlLoop::SetSetpoint(double volts)
+{
+	settings.setpoint = volts;
+}
+
+/**
+ * Name: GetInput()
+ * Desc: Returns the position of the measured value in the polled scan
+**/
+int ControlLoop::GetInput()
+{
+	return settings.input;
+}
+
+/**
+ * Name: GetOutputChannel()
+ * Desc: Returns the DAC the loop drives
+**/
+long ControlLoop::GetOutputChannel()
+{
+	return settings.output;
+}
+
+/**
+ * Name: GetOutput()
+ * Desc: Returns the last output (V)
+**/
+double ControlLoop::GetOutput()
+{
+	return output;
+}
+
+/**
+ * Name: LoopTiming()
+ * Desc: Creates empty statistics
+**/
+LoopTiming::LoopTiming()
+{
+	Reset(0);
+}
+
+/**
+ * Name: Reset(double newPeriodMs)
+ * Desc: Clears the statistics for a loop running every newPeriodMs
+**/
+void LoopTiming::Reset(double newPeriodMs)
+{
+	periodMs = newPeriodMs;
+	lastStartMs = -1;
+	iterations = 0;
+	latencySum = 0;
+	maxLatency = 0;
+	maxJitter = 0;
+}
+
+/**
+ * Name: Start(double nowMs)
+ * Desc: Marks the start of an iteration
+**/
+void LoopTiming::Start(double nowMs)
+{
+	double jitter;
+
+	if (lastStartMs >= 0)
+	{
+		jitter = nowMs - lastStartMs - periodMs;
+		if (jitter < 0)
+			jitter = -jitter;
+		if (jitter > maxJitter)
+			maxJitter = jitter;
+	}
+	lastStartMs = nowMs;
+}
+
+/**
+ * Name: Finish(double nowMs)
+ * Desc: Marks the new output of the iteration started last
+**/
+void LoopTiming::Finish(double nowMs)
+{
+	double latency = nowMs - lastStartMs;
+
+	iterations++;
+	latencySum += latency;
+	if (latency > maxLatency)
+		maxLatency = latency;
+}
+
+/**
+ * Name: GetIterations()
+ * Desc: Returns the iterations finished since Reset
+**/
+unsigned long LoopTiming::GetIterations()
+{
+	return iterations;
+}
+
+/**
+ * Name: GetMeanLatencyMs()
+ * Desc: Returns the mean latency of an iteration (ms)
+**/
+double LoopTiming::GetMeanLatencyMs()
+{
+	return iterations > 0 ? latencySum / iterations : 0;
+}
+
+/**
+ * Name: GetMaxLatencyMs()
+ * Desc: Returns the largest latency of an iteration (ms)
+**/
+double LoopTiming::GetMaxLatencyMs()
+{
+	return maxLatency;
+}
+
+/**
+ * Name: GetMaxJitterMs()
+ * Desc: Returns the largest deviation of an iteration's start from the
+ *		 period (ms)
+**/
+double LoopTiming::GetMaxJitterMs()
+{
+	return maxJitter;
+}
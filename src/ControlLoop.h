@@ -0,0 +1,83 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: ControlLoop.h
+ * Desc: Header file for the ControlLoop and LoopTiming object classes
+**/
+
+#ifndef CONTROLLOOP_H
+#define CONTROLLOOP_H
+
+/**
+ * Name: ControlSettings
+ * Desc: Wiring and tuning of one loop
+**/
+struct ControlSettings {
+	int input;										// Position of the measured value in the polled scan
+	long output;									// DAC written with the controller output
+	double setpoint;								// Wanted value of the input (V)
+	double kp;										// Proportional gain (V/V)
+	double ki;										// Integral gain (1/s)
+	double kd;										// Derivative gain (s)
+	double outMin;									// Output limits (V)
+	double outMax;
+};
+
+/**
+ * Name: ControlLoop
+ * Desc: Discrete PID controller run once per command-response tick. The
+ *		 integral is limited to the output range so it cannot wind up while
+ *		 the output saturates, and the derivative acts on the measurement
+ *		 so a setpoint step does not kick the output.
+ *
+ *		 The classes have no Windows or DASYLab dependencies, so they can
+ *		 be exercised off target.
+**/
+class ControlLoop {
+
+		// Instance variables
+		ControlSettings settings;
+		double dt;										// Seconds between updates
+		double integral;								// Integral term (V)
+		double lastInput;
+		bool primed;									// lastInput holds a measurement
+		double output;									// Last output (V)
+
+	public:
+		ControlLoop();
+		void Configure(const ControlSettings * newSettings, double newDt);
+		double Update(double measurement);
+		void SetSetpoint(double volts);
+		int GetInput();
+		long GetOutputChannel();
+		double GetOutput();
+};
+
+/**
+ * Name: LoopTiming
+ * Desc: Latency and jitter of a periodic loop. Latency runs from the
+ *		 start of an iteration to its new output; jitter is how far the
+ *		 time between two iteration starts is from the period.
+**/
+class LoopTiming {
+
+		// Instance variables
+		double periodMs;
+		double lastStartMs;								// Start of the previous iteration or -1
+		unsigned long iterations;
+		double latencySum;
+		double maxLatency;
+		double maxJitter;
+
+	public:
+		LoopTiming();
+		void Reset(double newPeriodMs);
+		void Start(double nowMs);
+		void Finish(double nowMs);
+		unsigned long GetIterations();
+		double GetMeanLatencyMs();
+		double GetMaxLatencyMs();
+		double GetMaxJitterMs();
+};
+#endif
@@ -0,0 +1,160 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: Decimator.cpp
+ * Desc: Anti-alias filtering and decimation of oversampled stream scans
+ * Note: Built without the precompiled header so that it stays portable
+**/
+
+// Compiler
+#include <stdlib.h>
+
+// Class header file
+#include "Decimator.h"
+
+// Application
+#include "FirMath.h"
+
+/** Fraction of the output Nyquist rate at the filter's -6 dB point **/
+static const double CUTOFF = 0.9;
+
+/**
+ * Name: Decimator()
+ * Desc: Creates an inactive decimator
+**/
+Decimator::Decimator()
+{
+	active = false;
+	numFiltered = 0;
+	numHeld = 0;
+	factor = 1;
+	taps = 4;
+	writeIndex = 0;
+	countdown = 0;
+	primed = false;
+}
+
+/**
+ * Name: Configure(int filtered, int held, int newFactor, int tapsPerFactor)
+ * Desc: Starts decimating scans of filtered channels followed by held
+ *		 channels by newFactor, with a filter tapsPerFactor times the
+ *		 factor long. Everything is allocated here, nothing while scans
+ *		 are processed.
+**/
+void Decimator::Configure(int filtered, int held, int newFactor, int tapsPerFactor)
+{
+	double cutoff, sum;
+	int j;
+
+	numFiltered = filtered;
+	numHeld = held;
+	factor = newFactor > 1 ? newFactor : 1;
+	if (tapsPerFactor < 1)
+		tapsPerFactor = 1;
+	taps = (tapsPerFactor * factor + 3) / 4 * 4;
+
+	// Symmetric low pass below the output Nyquist rate, unity gain at DC
+	cutoff = 0.5 * CUTOFF / factor;
+	filter.resize(taps);
+	sum = 0;
+	for (j = 0; j < taps; j++)
+	{
+		filter[j] = (float)FirMath::WindowedSinc(cutoff, j - (taps - 1) / 2.0, taps);
+		sum += filter[j];
+	}
+	for (j = 0; j < taps; j++)
+		filter[j] = (float)(filter[j] / sum);
+
+	history.assign(numFiltered * 2 * taps, 0.0f);
+	output.assign(numFiltered + numHeld > 0 ? numFiltered + numHeld : 1, 0.0);
+	writeIndex = 0;
+	countdown = 0;
+	primed = false;
+	active = true;
+}
+
+/**
+ * Name: Disable()
+ * Desc: Stops decimating; scans then go on unchanged
+**/
+void Decimator::Disable()
+{
+	active = false;
+}
+
+/**
+ * Name: IsActive()
+ * Desc: Returns true between Configure and Disable
+**/
+bool Decimator::IsActive()
+{
+	return active;
+}
+
+/**
+ * Name: Process(const double * scan)
+ * Desc: Adds the next input scan. The first scan fills the whole window so
+ *		 the output starts without a transient.
+ * Retn: The numFiltered + numHeld values of an output scan, valid until
+ *		 the next call, on every factor-th input starting with the first;
+ *		 otherwise NULL
+**/
+const double * Decimator::Process(const double * scan)
+{
+	int c, n, fill;
+	float * filtered;
+
+	fill = primed ? 1 : taps;
+	for (n = 0; n < fill; n++)
+	{
+		for (c = 0; c < numFiltered; c++)
+		{
+			filtered = &history[c * 2 * taps];
+			filtered[writeIndex] = filtered[writeIndex + taps] = (float)scan[c];
+		}
+		writeIndex = (writeIndex + 1) % taps;
+	}
+	primed = true;
+
+	if (countdown > 0)
+	{
+		countdown--;
+		return NULL;
+	}
+	countdown = factor - 1;
+
+	for (c = 0; c < numFiltered; c++)
+		output[c] = FirMath::DotProduct(&history[c * 2 * taps + writeIndex], &filter[0], taps);
+	for (c = 0; c < numHeld; c++)
+		output[numFiltered + c] = scan[numFiltered + c];
+
+	return &output[0];
+}
+
+/**
+ * Name: GetFactor()
+ * Desc: Returns the input scans per output scan
+**/
+int Decimator::GetFactor()
+{
+	return factor;
+}
+
+/**
+ * Name: GetTaps()
+ * Desc: Returns the filter length
+**/
+int Decimator::GetTaps()
+{
+	return taps;
+}
+
+/**
+ * Name: GetDelay()
+ * Desc: Returns the delay of the filtered channels (input scans)
+**/
+double Decimator::GetDelay()
+{
+	return (taps - 1) / 2.0;
+}
@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: Decimator.h
+ * Desc: Header file for Decimator object class
+**/
+
+#ifndef DECIMATOR_H
+#define DECIMATOR_H
+
+//	Compiler
+#include <vector>
+
+/**
+ * Name: Decimator
+ * Desc: Turns scans streamed factor times faster than requested into
+ *		 scans at the requested rate. Every analog channel goes through a
+ *		 windowed sinc low pass that removes what would alias before only
+ *		 every factor-th output is computed, so averaging the extra scans
+ *		 also lowers the noise (about half a bit per doubling). Channels
+ *		 that must not be filtered, like the state word of the digital
+ *		 lines, keep their newest value.
+ *
+ *		 The class has no Windows or DASYLab dependencies and is not thread
+ *		 safe, so it can be exercised off target.
+**/
+class Decimator {
+
+		// Instance variables
+		bool active;
+		int numFiltered;								// Leading channels of a scan that are filtered
+		int numHeld;									// Trailing channels that keep their newest value
+		int factor;										// Input scans per output scan
+		int taps;										// Filter length, multiple of 4
+		std::vector<float> filter;						// Low pass coefficients, oldest input first
+		std::vector<float> history;						// Last taps inputs of each filtered channel, stored twice
+		int writeIndex;									// Next slot of the history; the window starts here
+		int countdown;									// Inputs until the next output
+		bool primed;									// An input was processed since Configure
+		std::vector<double> output;						// The last scan returned by Process
+
+	public:
+		Decimator();
+		void Configure(int filtered, int held, int newFactor, int tapsPerFactor);
+		void Disable();
+		bool IsActive();
+		const double * Process(const double * scan);
+		int GetFactor();
+		int GetTaps();
+		double GetDelay();
+};
+#endif
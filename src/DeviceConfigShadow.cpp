@@ -0,0 +1,336 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: DeviceConfigShadow.cpp
+ * Desc: Shadow copy of the device configuration that turns an experiment's
+ *		 needs into the smallest set of requests
+**/
+
+/** Includes **/
+
+// Windows
+#include "stdafx.h"
+#include <windows.h>
+
+//	LabJack
+#include "c:\program files\labjack\drivers\LabJackUD.h" // TODO: needs to be flexible
+
+// Class header file
+#include "DeviceConfigShadow.h"
+
+/**
+ * Name: DeviceConfigShadow()
+ * Desc: Creates a shadow that knows nothing about the device
+**/
+DeviceConfigShadow::DeviceConfigShadow()
+{
+	Invalidate();
+}
+
+/**
+ * Name: Invalidate()
+ * Desc: Forgets every setting and output state, for when a device was
+ *		 opened. Pending changes are dropped too.
+**/
+void DeviceConfigShadow::Invalidate()
+{
+	int n;
+
+	Reopened();
+
+	for (n = 0; n < MAX_DACS; n++)
+	{
+		dacWritten[n] = FALSE;
+		dacValues[n] = 0;
+	}
+	linesWritten = 0;
+	lineStates = 0;
+}
+
+/**
+ * Name: Reopened()
+ * Desc: Forgets what the device holds, for when the same device was
+ *		 reopened and may have been reset, but keeps the output states
+ *		 written so that RequireOutputs can restore them. Pending changes
+ *		 are dropped.
+**/
+void DeviceConfigShadow::Reopened()
+{
+	int n;
+
+	for (n = 0; n < MAX_CHANNELS; n++)
+	{
+		rangeKnown[n] = FALSE;
+		ranges[n] = 0;
+	}
+	resolutionKnown = FALSE;
+	resolution = 0;
+	for (n = 0; n < MAX_DACS; n++)
+		dacKnown[n] = FALSE;
+	linesKnown = 0;
+
+	numChanges = 0;
+	numFailed = 0;
+	applied = FALSE;
+
+	ForgetStream();
+}
+
+/**
+ * Name: RequireRange(int channel, long udRange)
+ * Desc: States that the experiment needs the physical channel on the
+ *		 given LJ_rg. Nothing is queued if the device already uses it.
+**/
+void DeviceConfigShadow::RequireRange(int channel, long udRange)
+{
+	if (channel < 0 || channel >= MAX_CHANNELS)
+		return;
+
+	if (rangeKnown[channel] && ranges[channel] == udRange)
+		return;
+
+	AddChange(LJ_ioPUT_AIN_RANGE, channel, udRange);
+}
+
+/**
+ * Name: RequireResolution(long resolutionIndex)
+ * Desc: States that the experiment needs the given LJ_chAIN_RESOLUTION.
+ *		 Nothing is queued if the device already uses it.
+**/
+void DeviceConfigShadow::RequireResolution(long resolutionIndex)
+{
+	if (resolutionKnown && resolution == resolutionIndex)
+		return;
+
+	AddChange(LJ_ioPUT_CONFIG, LJ_chAIN_RESOLUTION, resolutionIndex);
+}
+
+/**
+ * Name: NoteOutput(long ioType, long channel, double value)
+ * Desc: Records a LJ_ioPUT_DAC or LJ_ioPUT_DIGITAL_BIT the experiment
+ *		 wrote to the device itself
+**/
+void DeviceConfigShadow::NoteOutput(long ioType, long channel, double value)
+{
+	if (ioType == LJ_ioPUT_DAC && channel >= 0 && channel < MAX_DACS)
+	{
+		dacWritten[channel] = TRUE;
+		dacKnown[channel] = TRUE;
+		dacValues[channel] = value;
+	}
+	else if (ioType == LJ_ioPUT_DIGITAL_BIT && channel >= 0 && channel < MAX_LINES)
+	{
+		linesWritten |= 1UL << channel;
+		linesKnown |= 1UL << channel;
+		if (value != 0)
+			lineStates |= 1UL << channel;
+		else
+			lineStates &= ~(1UL << channel);
+	}
+}
+
+/**
+ * Name: RequireOutputs()
+ * Desc: States that every output written since the device was opened
+ *		 must hold its last state. Nothing is queued for outputs the
+ *		 device is known to hold.
+**/
+void DeviceConfigShadow::RequireOutputs()
+{
+	int n;
+
+	for (n = 0; n < MAX_DACS; n++)
+	{
+		if (dacWritten[n] && !dacKnown[n])
+			AddChange(LJ_ioPUT_DAC, n, dacValues[n]);
+	}
+
+	for (n = 0; n < MAX_LINES; n++)
+	{
+		if (linesWritten & ~linesKnown & (1UL << n))
+			AddChange(LJ_ioPUT_DIGITAL_BIT, n, (lineStates >> n) & 1);
+	}
+}
+
+/**
+ * Name: AddChange(long ioType, long channel, double value)
+ * Desc: (private) Queues a setting, replacing an earlier one for the same
+ *		 item. Starts a new transaction if the last one was applied.
+**/
+void DeviceConfigShadow::AddChange(long ioType, long channel, double value)
+{
+	int n;
+
+	if (applied)
+	{
+		numChanges = 0;
+		applied = FALSE;
+	}
+
+	for (n = 0; n < numChanges; n++)
+	{
+		if (changes[n].ioType == ioType && changes[n].channel == channel)
+		{
+			changes[n].value = value;
+			return;
+		}
+	}
+
+	if (numChanges == MAX_CHANGES)
+		return;
+
+	changes[numChanges].ioType = ioType;
+	changes[numChanges].channel = channel;
+	changes[numChanges].value = value;
+	changes[numChanges].error = LJE_NOERROR;
+	numChanges++;
+}
+
+/**
+ * Name: GetNumPending()
+ * Desc: Returns the number of settings Apply will send
+**/
+int DeviceConfigShadow::GetNumPending()
+{
+	return applied ? 0 : numChanges;
+}
+
+/**
+ * Name: Apply(long handle)
+ * Desc: Sends the queued settings in a single GoOne and reads back the
+ *		 result of each one. Settings that worked are remembered. The
+ *		 changes stay available through GetChange until the next Require.
+ * Retn: TRUE if every setting was applied and FALSE otherwise
+**/
+bool DeviceConfigShadow::Apply(long handle)
+{
+	long lngErrorcode;
+	double dblValue;
+	int n;
+
+	if (applied)
+		return numFailed == 0;
+
+	numFailed = 0;
+	applied = TRUE;
+	if (numChanges == 0)
+		return TRUE;
+
+	for (n = 0; n < numChanges; n++)
+		changes[n].error = AddRequest(handle, changes[n].ioType, changes[n].channel, changes[n].value, 0, 0);
+
+	lngErrorcode = GoOne(handle);
+
+	for (n = 0; n < numChanges; n++)
+	{
+		if (changes[n].error == LJE_NOERROR)
+		{
+			if (lngErrorcode != LJE_NOERROR)
+				changes[n].error = lngErrorcode;
+			else
+				changes[n].error = GetResult(handle, changes[n].ioType, changes[n].channel, &dblValue);
+		}
+
+		if (changes[n].error == LJE_NOERROR)
+			Remember(&changes[n]);
+		else
+			numFailed++;
+	}
+
+	return numFailed == 0;
+}
+
+/**
+ * Name: Remember(ConfigChange * change)
+ * Desc: (private) Records a setting the device accepted
+**/
+void DeviceConfigShadow::Remember(ConfigChange * change)
+{
+	if (change->ioType == LJ_ioPUT_AIN_RANGE)
+	{
+		rangeKnown[change->channel] = TRUE;
+		ranges[change->channel] = (long)change->value;
+	}
+	else if (change->ioType == LJ_ioPUT_CONFIG && change->channel == LJ_chAIN_RESOLUTION)
+	{
+		resolutionKnown = TRUE;
+		resolution = (long)change->value;
+	}
+	else if (change->ioType == LJ_ioPUT_DAC || change->ioType == LJ_ioPUT_DIGITAL_BIT)
+		NoteOutput(change->ioType, change->channel, change->value);
+}
+
+/**
+ * Name: GetNumChanges()
+ * Desc: Returns the number of settings sent by the last Apply
+**/
+int DeviceConfigShadow::GetNumChanges()
+{
+	return applied ? numChanges : 0;
+}
+
+/**
+ * Name: GetChange(int index)
+ * Desc: Returns a setting sent by the last Apply with its result
+**/
+ConfigChange * DeviceConfigShadow::GetChange(int index)
+{
+	return &changes[index];
+}
+
+/**
+ * Name: GetNumFailed()
+ * Desc: Returns the number of settings the last Apply could not make
+**/
+int DeviceConfigShadow::GetNumFailed()
+{
+	return numFailed;
+}
+
+/**
+ * Name: HasStream(const StreamSetup * setup)
+ * Desc: Returns true if the device is known to be set up for exactly
+ *		 this stream
+**/
+bool DeviceConfigShadow::HasStream(const StreamSetup * setup)
+{
+	int n;
+
+	if (!streamKnown ||
+		stream.scanFrequency != setup->scanFrequency ||
+		stream.bufferSize != setup->bufferSize ||
+		stream.callbackScans != setup->callbackScans ||
+		stream.userValue != setup->userValue ||
+		stream.numChannels != setup->numChannels)
+		return FALSE;
+
+	for (n = 0; n < setup->numChannels; n++)
+	{
+		if (stream.channels[n] != setup->channels[n])
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Name: RememberStream(const StreamSetup * setup)
+ * Desc: Records a stream setup the device accepted
+**/
+void DeviceConfigShadow::RememberStream(const StreamSetup * setup)
+{
+	stream = *setup;
+	streamKnown = TRUE;
+}
+
+/**
+ * Name: ForgetStream()
+ * Desc: Forgets the stream setup, for when it is being changed
+**/
+void DeviceConfigShadow::ForgetStream()
+{
+	streamKnown = FALSE;
+	stream.numChannels = 0;
+	stream.channels.clear();
+}
@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: DeviceConfigShadow.h
+ * Desc: Header file for DeviceConfigShadow object class
+**/
+
+#ifndef DEVICECONFIGSHADOW_H
+#define DEVICECONFIGSHADOW_H
+
+//	Windows
+#include "stdafx.h"
+#include <windows.h>
+
+//	Compiler
+#include <vector>
+
+/**
+ * Name: ConfigChange
+ * Desc: One setting to send to the device and, after Apply, how it went
+**/
+struct ConfigChange {
+	long ioType;									// LJ_ioPUT_AIN_RANGE, LJ_ioPUT_CONFIG, LJ_ioPUT_DAC or LJ_ioPUT_DIGITAL_BIT
+	long channel;									// Physical channel or LJ_ch special channel
+	double value;
+	long error;										// LJE_ result of the request
+};
+
+/**
+ * Name: StreamSetup
+ * Desc: Everything StartStreaming configures besides ranges and resolution
+**/
+struct StreamSetup {
+	double scanFrequency;							// LJ_chSTREAM_SCAN_FREQUENCY
+	double bufferSize;								// LJ_chSTREAM_BUFFER_SIZE
+	long callbackScans;								// Scans per LJ_ioSET_STREAM_CALLBACK call
+	long userValue;									// Value passed to the callback
+	int numChannels;
+	std::vector<long> channels;						// LJ_ioADD_STREAM_CHANNEL in order
+};
+
+/**
+ * Name: DeviceConfigShadow
+ * Desc: Remembers what has been configured on the device so that an
+ *		 experiment only sends the settings that differ. The experiment
+ *		 states what it needs with the Require functions, then Apply sends
+ *		 the difference as one AddRequest/GoOne transaction and checks the
+ *		 result of every request. Settings that fail are not remembered so
+ *		 they are tried again next time. The stream setup is remembered as
+ *		 a whole so an unchanged stream can simply be started again.
+ *
+ *		 The DAC and digital output states an experiment wrote are kept
+ *		 too. When the same device is reopened, and may have been reset,
+ *		 Reopened forgets what the device holds but not those states, and
+ *		 RequireOutputs queues them to be written again.
+**/
+class DeviceConfigShadow {
+
+		// Constants
+		const static int MAX_CHANNELS = 256;			// Highest physical channel number + 1
+		const static int MAX_CHANGES = 64;
+		const static int MAX_DACS = 4;
+		const static int MAX_LINES = 32;				// Digital lines in a DWORD of states
+
+		// Instance variables
+		bool rangeKnown[MAX_CHANNELS];					// The device is known to use ranges[n]
+		long ranges[MAX_CHANNELS];						// LJ_rg of each physical channel
+		bool resolutionKnown;
+		long resolution;								// LJ_chAIN_RESOLUTION index
+		ConfigChange changes[MAX_CHANGES];				// Pending, then applied, settings
+		int numChanges;
+		int numFailed;
+		bool applied;									// changes holds the last transaction
+		bool streamKnown;								// The device is known to be set up as stream
+		StreamSetup stream;
+		bool dacWritten[MAX_DACS];						// The experiment set dacValues[n]
+		bool dacKnown[MAX_DACS];						// The device is known to output dacValues[n]
+		double dacValues[MAX_DACS];						// Volts
+		DWORD linesWritten;								// Digital outputs the experiment set
+		DWORD linesKnown;								// Digital outputs the device is known to hold
+		DWORD lineStates;
+
+	public:
+		DeviceConfigShadow();
+		void Invalidate();
+		void Reopened();
+		void RequireRange(int channel, long udRange);
+		void RequireResolution(long resolutionIndex);
+		void NoteOutput(long ioType, long channel, double value);
+		void RequireOutputs();
+		int GetNumPending();
+		bool Apply(long handle);
+		int GetNumChanges();
+		ConfigChange * GetChange(int index);
+		int GetNumFailed();
+		bool HasStream(const StreamSetup * setup);
+		void RememberStream(const StreamSetup * setup);
+		void ForgetStream();
+
+	private:
+		void AddChange(long ioType, long channel, double value);
+		void Remember(ConfigChange * change);
+};
+#endif
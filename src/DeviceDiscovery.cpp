@@ -0,0 +1,334 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: DeviceDiscovery.cpp
+ * Desc: Concurrent device enumeration with a persistent cache of the
+ *		 devices found
+**/
+
+/** Includes **/
+
+// Windows
+#include "stdafx.h"
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+//	LabJack
+#include "c:\program files\labjack\drivers\LabJackUD.h" // TODO: needs to be flexible
+
+// Class header file
+#include "DeviceDiscovery.h"
+
+// Application
+#include "DriverSettings.h"
+
+/**
+ * Name: DeviceDiscovery()
+ * Desc: Creates an idle discovery object with an empty cache
+**/
+DeviceDiscovery::DeviceDiscovery()
+{
+	int n;
+
+	types[0] = LJ_dtU3;
+	types[1] = LJ_dtU6;
+	types[2] = LJ_dtUE9;
+
+	for (n = 0; n < NUM_TYPES; n++)
+	{
+		numFound[n] = 0;
+		threads[n] = NULL;
+		jobs[n].owner = this;
+		jobs[n].typeIndex = n;
+	}
+
+	pendingJobs = 0;
+	numCached = 0;
+	InitializeCriticalSection(&cacheLock);
+}
+
+/**
+ * Name: ~DeviceDiscovery()
+ * Desc: Waits for any enumeration still running before going away
+**/
+DeviceDiscovery::~DeviceDiscovery()
+{
+	int n;
+
+	WaitForEnumeration(INFINITE);
+
+	for (n = 0; n < NUM_TYPES; n++)
+		if (threads[n] != NULL)
+			CloseHandle(threads[n]);
+
+	DeleteCriticalSection(&cacheLock);
+}
+
+/**
+ * Name: BeginEnumeration()
+ * Desc: Starts one ListAll per device model, each on its own thread.
+ *		 If a thread cannot be created that model is listed synchronously.
+**/
+void DeviceDiscovery::BeginEnumeration()
+{
+	int n;
+	DWORD threadID;
+
+	if (pendingJobs > 0)
+		return;
+
+	pendingJobs = NUM_TYPES;
+	for (n = 0; n < NUM_TYPES; n++)
+	{
+		if (threads[n] != NULL)
+			CloseHandle(threads[n]);
+
+		threads[n] = CreateThread(NULL, 0, EnumerateThread, &jobs[n], 0, &threadID);
+		if (threads[n] == NULL)
+			Enumerate(n);
+	}
+}
+
+/**
+ * Name: EnumerateThread(LPVOID param)
+ * Desc: (private) Thread entry point that lists one device model
+**/
+DWORD WINAPI DeviceDiscovery::EnumerateThread(LPVOID param)
+{
+	EnumerationJob * job = (EnumerationJob *)param;
+
+	job->owner->Enumerate(job->typeIndex);
+
+	return 0;
+}
+
+/**
+ * Name: Enumerate(int typeIndex)
+ * Desc: (private) Lists the devices of one model. The last job to finish
+ *		 folds the results into the cache and saves it.
+**/
+void DeviceDiscovery::Enumerate(int typeIndex)
+{
+	long found = 0;
+
+	if (ListAll(types[typeIndex], LJ_ctUSB, &found, serialNumbers[typeIndex], ids[typeIndex], addresses[typeIndex]) != LJE_NOERROR)
+		found = 0;
+	numFound[typeIndex] = found;
+
+	if (InterlockedDecrement(&pendingJobs) == 0)
+	{
+		UpdateCache();
+		SaveCache();
+	}
+}
+
+/**
+ * Name: WaitForEnumeration(DWORD timeout)
+ * Desc: Waits up to timeout milliseconds for every model to be listed
+ * Retn: TRUE if enumeration is complete and FALSE on timeout
+**/
+bool DeviceDiscovery::WaitForEnumeration(DWORD timeout)
+{
+	HANDLE running[NUM_TYPES];
+	DWORD numRunning = 0;
+	int n;
+
+	for (n = 0; n < NUM_TYPES; n++)
+		if (threads[n] != NULL)
+			running[numRunning++] = threads[n];
+
+	if (numRunning > 0)
+		WaitForMultipleObjects(numRunning, running, TRUE, timeout);
+
+	return IsEnumerationComplete();
+}
+
+/**
+ * Name: IsEnumerationComplete()
+ * Desc: Returns true once every model has been listed
+**/
+bool DeviceDiscovery::IsEnumerationComplete()
+{
+	return pendingJobs == 0;
+}
+
+/**
+ * Name: GetBestDevice(long * deviceType)
+ * Desc: Picks the model to open after enumeration, preferring the UE9
+ *		 over the U6 over the U3 as DRV_InitDevice always has
+ * Retn: TRUE if any device was found and FALSE otherwise
+**/
+bool DeviceDiscovery::GetBestDevice(long * deviceType)
+{
+	int n;
+
+	for (n = NUM_TYPES - 1; n >= 0; n--)
+	{
+		if (numFound[n] > 0)
+		{
+			*deviceType = types[n];
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/**
+ * Name: UpdateCache()
+ * Desc: (private) Replaces the cache with the devices just enumerated
+**/
+void DeviceDiscovery::UpdateCache()
+{
+	int n, i;
+
+	EnterCriticalSection(&cacheLock);
+
+	numCached = 0;
+	for (n = 0; n < NUM_TYPES; n++)
+	{
+		for (i = 0; i < numFound[n] && numCached < MAX_CACHED; i++)
+		{
+			cachedTypes[numCached] = types[n];
+			cachedSerials[numCached] = serialNumbers[n][i];
+			cachedIDs[numCached] = ids[n][i];
+			numCached++;
+		}
+	}
+
+	LeaveCriticalSection(&cacheLock);
+}
+
+/**
+ * Name: LoadCache()
+ * Desc: Reads the devices found by a previous run from the INI file:
+ *
+ *		 [Discovery]
+ *		 Count=1
+ *		 Device0=6,360012345,1		; LJ_dt, serial number, local ID
+ *		 PreferredType=6
+ *		 PreferredSerial=360012345
+ *
+ * Retn: TRUE if the cache held any devices and FALSE otherwise
+**/
+bool DeviceDiscovery::LoadCache()
+{
+	int n, count;
+	char key[16];
+	CString entry;
+	long type, serial, id;
+
+	EnterCriticalSection(&cacheLock);
+
+	numCached = 0;
+	count = DriverSettings::GetInt("Discovery", "Count", 0);
+	for (n = 0; n < count && numCached < MAX_CACHED; n++)
+	{
+		sprintf(key, "Device%d", n);
+		entry = DriverSettings::GetString("Discovery", key, "");
+		if (sscanf(entry, "%ld,%ld,%ld", &type, &serial, &id) == 3)
+		{
+			cachedTypes[numCached] = type;
+			cachedSerials[numCached] = serial;
+			cachedIDs[numCached] = id;
+			numCached++;
+		}
+	}
+
+	LeaveCriticalSection(&cacheLock);
+
+	return numCached > 0;
+}
+
+/**
+ * Name: SaveCache()
+ * Desc: Writes the cached devices to the INI file
+**/
+void DeviceDiscovery::SaveCache()
+{
+	int n;
+	char key[16];
+	char entry[64];
+
+	EnterCriticalSection(&cacheLock);
+
+	DriverSettings::PutInt("Discovery", "Count", numCached);
+	for (n = 0; n < numCached; n++)
+	{
+		sprintf(key, "Device%d", n);
+		sprintf(entry, "%ld,%ld,%ld", cachedTypes[n], cachedSerials[n], cachedIDs[n]);
+		DriverSettings::PutString("Discovery", key, entry);
+	}
+
+	LeaveCriticalSection(&cacheLock);
+}
+
+/**
+ * Name: GetPreferred(long * deviceType, long * serialNumber)
+ * Desc: Gets the device opened last time if it is still in the cache
+ * Retn: TRUE if there is a preferred device and FALSE otherwise
+**/
+bool DeviceDiscovery::GetPreferred(long * deviceType, long * serialNumber)
+{
+	int n;
+	long type, serial;
+	bool found = FALSE;
+
+	type = DriverSettings::GetInt("Discovery", "PreferredType", 0);
+	serial = DriverSettings::GetInt("Discovery", "PreferredSerial", 0);
+	if (serial == 0)
+		return FALSE;
+
+	EnterCriticalSection(&cacheLock);
+	for (n = 0; n < numCached && !found; n++)
+		found = cachedTypes[n] == type && cachedSerials[n] == serial;
+	LeaveCriticalSection(&cacheLock);
+
+	if (found)
+	{
+		*deviceType = type;
+		*serialNumber = serial;
+	}
+
+	return found;
+}
+
+/**
+ * Name: SetPreferred(long deviceType, long serialNumber)
+ * Desc: Remembers the device that was opened so the next start can open
+ *		 it directly
+**/
+void DeviceDiscovery::SetPreferred(long deviceType, long serialNumber)
+{
+	DriverSettings::PutInt("Discovery", "PreferredType", deviceType);
+	DriverSettings::PutInt("Discovery", "PreferredSerial", serialNumber);
+}
+
+/**
+ * Name: GetNumCached()
+ * Desc: Returns the number of devices in the cache
+**/
+int DeviceDiscovery::GetNumCached()
+{
+	return numCached;
+}
+
+/**
+ * Name: GetCachedType(int index)
+ * Desc: Returns the LJ_dt of a cached device
+**/
+long DeviceDiscovery::GetCachedType(int index)
+{
+	return cachedTypes[index];
+}
+
+/**
+ * Name: GetCachedSerial(int index)
+ * Desc: Returns the serial number of a cached device
+**/
+long DeviceDiscovery::GetCachedSerial(int index)
+{
+	return cachedSerials[index];
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: DeviceDiscovery.h
+ * Desc: Header file for DeviceDiscovery object class
+**/
+
+#ifndef DEVICEDISCOVERY_H
+#define DEVICEDISCOVERY_H
+
+//	Windows
+#include "stdafx.h"
+#include <windows.h>
+
+class DeviceDiscovery;
+
+/**
+ * Name: EnumerationJob
+ * Desc: Parameter handed to each enumeration thread
+**/
+struct EnumerationJob {
+	DeviceDiscovery * owner;
+	int typeIndex;
+};
+
+/**
+ * Name: DeviceDiscovery
+ * Desc: Looks for U3, U6 and UE9 devices on USB with one ListAll per model
+ *		 running concurrently on its own thread. The serial numbers found are
+ *		 cached in the driver INI file so that the next DASYLab start can open
+ *		 the device used last time without waiting for a full bus scan.
+**/
+class DeviceDiscovery {
+
+		// Constants
+		const static int NUM_TYPES = 3;
+		const static int MAX_LISTED = 128;				// ListAll always fills 128 entries
+		const static int MAX_CACHED = 16;
+
+		// Instance variables
+		long types[NUM_TYPES];							// LJ_dt of each model, in ascending order of preference
+		long numFound[NUM_TYPES];						// Devices found of each model
+		long serialNumbers[NUM_TYPES][MAX_LISTED];		// ListAll results
+		long ids[NUM_TYPES][MAX_LISTED];
+		double addresses[NUM_TYPES][MAX_LISTED];
+		HANDLE threads[NUM_TYPES];						// Enumeration threads, NULL when not started
+		EnumerationJob jobs[NUM_TYPES];
+		volatile LONG pendingJobs;						// Enumeration threads still running
+		long cachedTypes[MAX_CACHED];					// Devices remembered from earlier runs
+		long cachedSerials[MAX_CACHED];
+		long cachedIDs[MAX_CACHED];
+		int numCached;
+		CRITICAL_SECTION cacheLock;
+
+	public:
+		DeviceDiscovery();
+		~DeviceDiscovery();
+		void BeginEnumeration();
+		bool WaitForEnumeration(DWORD timeout);
+		bool IsEnumerationComplete();
+		bool LoadCache();
+		void SaveCache();
+		bool GetPreferred(long * deviceType, long * serialNumber);
+		bool GetBestDevice(long * deviceType);
+		int GetNumCached();
+		long GetCachedType(int index);
+		long GetCachedSerial(int index);
+		static void SetPreferred(long deviceType, long serialNumber);
+
+	private:
+		static DWORD WINAPI EnumerateThread(LPVOID param);
+		void Enumerate(int typeIndex);
+		void UpdateCache();
+};
+#endif
@@ -0,0 +1,303 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: DeviceModel.cpp
+ * Desc: Constant descriptor tables of the supported LabJack models
+**/
+
+// Windows
+#include "stdafx.h"
+#include <windows.h>
+
+// Compiler
+#include <math.h>
+
+//	LabJack
+#include "c:\program files\labjack\drivers\LabJackUD.h" // TODO: needs to be flexible
+
+// Header file
+#include "DeviceModel.h"
+
+/** Headroom left when choosing a resolution, see PlanStream **/
+const double DeviceModels::STREAM_RATE_MARGIN = 0.8;
+const double DeviceModels::MAX_SCAN_INTERVAL = 65535;
+const double DeviceModels::RATE_TOLERANCE = 1e-9;
+
+/** 4 MHz stream clock, divided by 256 for slow scans **/
+static const double STREAM_CLOCKS[] = {
+	4000000, 4000000 / 256.0
+};
+
+/** Every UD input range, indexed by LJ_rg value from the first of its kind **/
+static const InputRange AUTO_RANGE = { LJ_rgAUTO, 0, 0, "auto" };
+static const InputRange BIPOLAR_RANGES[] = {
+	{ LJ_rgBIP20V, -20, 20, "+/- 20V" },
+	{ LJ_rgBIP10V, -10, 10, "+/- 10V" },
+	{ LJ_rgBIP5V, -5, 5, "+/- 5V" },
+	{ LJ_rgBIP4V, -4, 4, "+/- 4V" },
+	{ LJ_rgBIP2P5V, -2.5, 2.5, "+/- 2.5V" },
+	{ LJ_rgBIP2V, -2, 2, "+/- 2V" },
+	{ LJ_rgBIP1P25V, -1.25, 1.25, "+/- 1.25V" },
+	{ LJ_rgBIP1V, -1, 1, "+/- 1V" },
+	{ LJ_rgBIPP625V, -0.625, 0.625, "+/- 0.625V" },
+	{ LJ_rgBIPP1V, -0.1, 0.1, "+/- 0.1V" },
+	{ LJ_rgBIPP01V, -0.01, 0.01, "+/- 0.01V" }
+};
+static const InputRange UNIPOLAR_RANGES[] = {
+	{ LJ_rgUNI20V, 0, 20, "0-20V" },
+	{ LJ_rgUNI10V, 0, 10, "0-10V" },
+	{ LJ_rgUNI5V, 0, 5, "0-5V" },
+	{ LJ_rgUNI4V, 0, 4, "0-4V" },
+	{ LJ_rgUNI2P5V, 0, 2.5, "0-2.5V" },
+	{ LJ_rgUNI2V, 0, 2, "0-2V" },
+	{ LJ_rgUNI1P25V, 0, 1.25, "0-1.25V" },
+	{ LJ_rgUNI1V, 0, 1, "0-1V" },
+	{ LJ_rgUNIP625V, 0, 0.625, "0-0.625V" },
+	{ LJ_rgUNIP5V, 0, 0.5, "0-0.5V" },
+	{ LJ_rgUNIP3125V, 0, 0.3125, "0-0.3125V" },
+	{ LJ_rgUNIP25V, 0, 0.25, "0-0.25V" },
+	{ LJ_rgUNIP025V, 0, 0.025, "0-0.025V" },
+	{ LJ_rgUNIP0025V, 0, 0.0025, "0-0.0025V" }
+};
+static const int NUM_BIPOLAR_RANGES = sizeof(BIPOLAR_RANGES) / sizeof(BIPOLAR_RANGES[0]);
+static const int NUM_UNIPOLAR_RANGES = sizeof(UNIPOLAR_RANGES) / sizeof(UNIPOLAR_RANGES[0]);
+
+/** U3: 30 temperature, 31 Vreg, 32 special range **/
+static const long U3_CHANNELS[] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 30, 31, 32
+};
+static const StreamRate U3_STREAM_RATES[] = {
+	{ 12, 50000, 12.0 }
+};
+
+/** U6: 14 temperature, 15 GND **/
+static const long U6_CHANNELS[] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+};
+static const ModelGain U6_GAINS[] = {
+	{ 1, LJ_rgBIP10V },
+	{ 10, LJ_rgBIP1V },
+	{ 100, LJ_rgBIPP1V },
+	{ 1000, LJ_rgBIPP01V }
+};
+static const StreamRate U6_STREAM_RATES[] = {
+	{ 1, 50000, 16.0 },
+	{ 2, 25000, 16.5 },
+	{ 3, 10000, 17.0 },
+	{ 4, 5000, 17.5 },
+	{ 5, 2500, 17.9 },
+	{ 6, 1000, 18.3 },
+	{ 7, 500, 18.8 },
+	{ 8, 250, 19.1 }
+};
+
+/** UE9: 128 Vref, 132 Vs, 133 temperature, 136 GND, 140-141 extended **/
+static const long UE9_CHANNELS[] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 128, 132, 133, 136, 140, 141
+};
+// TODO: 0-5V range
+static const ModelGain UE9_GAINS[] = {
+	{ 1, LJ_rgBIP5V },
+	{ 2, LJ_rgUNI2P5V },
+	{ 4, LJ_rgUNI1P25V },
+	{ 8, LJ_rgUNIP625V }
+};
+static const StreamRate UE9_STREAM_RATES[] = {
+	{ 12, 50000, 12.0 }
+};
+
+#define TABLE(t) sizeof(t) / sizeof(t[0]), t
+
+/** The models **/
+static const DeviceModel U3_LV = {
+	LJ_dtU3, FALSE, "U3-LV",
+	TABLE(U3_CHANNELS), 0, 0, 0, -2.5, 2.5,
+	20, 2, 0, 5,
+	0, NULL,
+	TABLE(U3_STREAM_RATES),
+	TABLE(STREAM_CLOCKS), 193,
+	16, FALSE
+};
+static const DeviceModel U3_HV = {
+	LJ_dtU3, TRUE, "U3-HV",
+	TABLE(U3_CHANNELS), 4, -10, 10, -2.5, 2.5,
+	20, 2, 0, 5,
+	0, NULL,
+	TABLE(U3_STREAM_RATES),
+	TABLE(STREAM_CLOCKS), 193,
+	16, FALSE
+};
+static const DeviceModel U6 = {
+	LJ_dtU6, FALSE, "U6",
+	TABLE(U6_CHANNELS), 0, 0, 0, -10, 10,
+	23, 2, 0, 5,
+	TABLE(U6_GAINS),
+	TABLE(U6_STREAM_RATES),
+	TABLE(STREAM_CLOCKS), 193,
+	14, FALSE
+};
+static const DeviceModel UE9 = {
+	LJ_dtUE9, FALSE, "UE9",
+	TABLE(UE9_CHANNELS), 0, 0, 0, -5, 5,
+	23, 2, 0, 5,
+	TABLE(UE9_GAINS),
+	TABLE(UE9_STREAM_RATES),
+	TABLE(STREAM_CLOCKS), 193,
+	18, TRUE
+};
+
+#undef TABLE
+
+/** Models by LJ_dt, then by high voltage variant **/
+static const int NUM_DEVICE_TYPES = 10;
+static const DeviceModel * const MODELS[NUM_DEVICE_TYPES][2] = {
+	{ NULL, NULL },
+	{ NULL, NULL },
+	{ NULL, NULL },
+	{ &U3_LV, &U3_HV },								// LJ_dtU3
+	{ NULL, NULL },
+	{ NULL, NULL },
+	{ &U6, &U6 },									// LJ_dtU6
+	{ NULL, NULL },
+	{ NULL, NULL },
+	{ &UE9, &UE9 }									// LJ_dtUE9
+};
+
+/**
+ * Name: Find(long deviceType, bool highVoltage)
+ * Desc: Returns the table of the given model and variant or NULL if the
+ *		 model is not supported
+**/
+const DeviceModel * DeviceModels::Find(long deviceType, bool highVoltage)
+{
+	if (deviceType < 0 || deviceType >= NUM_DEVICE_TYPES)
+		return NULL;
+
+	return MODELS[deviceType][highVoltage ? 1 : 0];
+}
+
+/**
+ * Name: FindRange(long udRange)
+ * Desc: Returns the limits and description of the given LJ_rg or NULL
+ *		 if it is unknown
+**/
+const InputRange * DeviceModels::FindRange(long udRange)
+{
+	int n;
+
+	if (udRange == LJ_rgAUTO)
+		return &AUTO_RANGE;
+
+	// The tables follow the LJ_rg numbering so the value is the index
+	n = udRange - LJ_rgBIP20V;
+	if (n >= 0 && n < NUM_BIPOLAR_RANGES && BIPOLAR_RANGES[n].udRange == udRange)
+		return &BIPOLAR_RANGES[n];
+
+	n = udRange - LJ_rgUNI20V;
+	if (n >= 0 && n < NUM_UNIPOLAR_RANGES && UNIPOLAR_RANGES[n].udRange == udRange)
+		return &UNIPOLAR_RANGES[n];
+
+	return NULL;
+}
+
+/**
+ * Name: GetMaxSampleRate(const DeviceModel * model)
+ * Desc: Returns the fastest total stream rate of the model (samples/s)
+**/
+double DeviceModels::GetMaxSampleRate(const DeviceModel * model)
+{
+	return model->streamRates[0].maxSampleRate;
+}
+
+/**
+ * Name: PlanStream(const DeviceModel * model, double sampleRate)
+ * Desc: Chooses the stream setting for the given total rate (samples/s,
+ *		 summed over all stream channels): the finest resolution that still
+ *		 runs at the rate with STREAM_RATE_MARGIN to spare, or the fastest
+ *		 setting when the rate is within the model's limit but none has
+ *		 that much headroom
+ * Retn: The setting or NULL if the model cannot stream that fast
+**/
+const StreamRate * DeviceModels::PlanStream(const DeviceModel * model, double sampleRate)
+{
+	int n;
+
+	// The table is ordered fastest (coarsest) first
+	for (n = model->numStreamRates - 1; n >= 0; n--)
+	{
+		if (model->streamRates[n].maxSampleRate * STREAM_RATE_MARGIN >= sampleRate)
+			return &model->streamRates[n];
+	}
+
+	if (sampleRate <= model->streamRates[0].maxSampleRate)
+		return &model->streamRates[0];
+
+	return NULL;
+}
+
+/**
+ * Name: GetNoiseVolts(const DeviceModel * model, const StreamRate * rate)
+ * Desc: Returns the typical noise (one count of the effective resolution)
+ *		 of an input with the model's unity gain range at the given setting
+**/
+double DeviceModels::GetNoiseVolts(const DeviceModel * model, const StreamRate * rate)
+{
+	return (model->aiMaxVolts - model->aiMinVolts) / pow(2.0, rate->effectiveBits);
+}
+
+/**
+ * Name: QuantizeScanRate(const DeviceModel * model, double scanRate)
+ * Desc: Returns the scan rate the device actually produces when asked for
+ *		 the given one: a stream clock divided by a whole scan interval.
+ *		 Like the UD driver it uses the fastest clock whose interval still
+ *		 fits in 16 bits and rounds to the nearest interval.
+**/
+double DeviceModels::QuantizeScanRate(const DeviceModel * model, double scanRate)
+{
+	double clock, interval;
+	int n;
+
+	if (scanRate <= 0)
+		return scanRate;
+
+	for (n = 0; n < model->numStreamClocks; n++)
+	{
+		clock = model->streamClocks[n];
+		interval = floor(clock / scanRate + 0.5);
+		if (interval <= MAX_SCAN_INTERVAL || n == model->numStreamClocks - 1)
+		{
+			if (interval < 1)
+				interval = 1;
+			else if (interval > MAX_SCAN_INTERVAL)
+				interval = MAX_SCAN_INTERVAL;
+			return clock / interval;
+		}
+	}
+
+	return scanRate;
+}
+
+/**
+ * Name: FindOversampling(const DeviceModel * model, double scanRate,
+ *						  int numStreamChannels, int maxFactor)
+ * Desc: Returns the largest factor up to maxFactor that the scan rate can
+ *		 be multiplied by while the model still streams every channel and
+ *		 produces the faster rate exactly, or 1 if there is none
+**/
+int DeviceModels::FindOversampling(const DeviceModel * model, double scanRate, int numStreamChannels, int maxFactor)
+{
+	double rate;
+	int factor;
+
+	for (factor = maxFactor; factor > 1; factor--)
+	{
+		rate = scanRate * factor;
+		if (rate * numStreamChannels > GetMaxSampleRate(model))
+			continue;
+		if (fabs(QuantizeScanRate(model, rate) - rate) <= rate * RATE_TOLERANCE)
+			return factor;
+	}
+
+	return 1;
+}
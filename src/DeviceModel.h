@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: DeviceModel.h
+ * Desc: Header file for the DeviceModel descriptor tables
+**/
+
+#ifndef DEVICEMODEL_H
+#define DEVICEMODEL_H
+
+//	Windows
+#include "stdafx.h"
+#include <windows.h>
+
+//	DASYLab driver interface
+#include "treiber.h"
+
+/**
+ * Name: InputRange
+ * Desc: Nominal limits and description of one UD input range
+**/
+struct InputRange {
+	long udRange;									// LJ_rg
+	double minVolts;
+	double maxVolts;
+	const char * text;								// Shown by DRV_ExplainGainCode
+};
+
+/**
+ * Name: ModelGain
+ * Desc: One entry of GainInfo and the range it selects
+**/
+struct ModelGain {
+	INT16 dasyGain;									// "Real gain" DASYLab shows
+	long udRange;									// LJ_rg used by the UD driver
+};
+
+/**
+ * Name: StreamRate
+ * Desc: Fastest stream at one resolution setting
+**/
+struct StreamRate {
+	long resolution;								// LJ_chAIN_RESOLUTION value
+	double maxSampleRate;							// Samples per second summed over all channels
+	double effectiveBits;							// Typical effective resolution at unity gain
+};
+
+/**
+ * Name: DeviceModel
+ * Desc: Everything the driver needs to know about one LabJack model, as
+ *		 a constant table. FillInfoStructure copies it into DASYLab's
+ *		 structure and the experiment plan indexes it directly, so a new
+ *		 model or variant is supported by adding its table to
+ *		 DeviceModel.cpp.
+**/
+struct DeviceModel {
+	long deviceType;								// LJ_dt
+	bool highVoltage;								// U3-HV variant
+	const char * name;
+	int numAIChannels;								// Max_AI_Channel
+	const long * aiChannels;						// Physical channel of each DASYLab AI channel
+	int numWideInputs;								// Leading inputs with the wide nominal range
+	double wideMinVolts;
+	double wideMaxVolts;
+	double aiMinVolts;								// Nominal unity gain range of the other inputs
+	double aiMaxVolts;
+	int numDIOLines;								// Max_DI_Channel and Max_DO_Channel
+	int numAOChannels;
+	double aoMinVolts;
+	double aoMaxVolts;
+	int numGains;
+	const ModelGain * gains;						// In GainInfo order, widest range first
+	int numStreamRates;
+	const StreamRate * streamRates;					// Fastest first
+	int numStreamClocks;
+	const double * streamClocks;					// Clocks the scan interval counts (Hz), fastest first
+	long digitalStreamChannel;						// Stream channel carrying the FIO/EIO states
+	int temperatureChannel;							// DASYLab AI channel of the internal temperature sensor
+	bool pollsWhileStreaming;						// Analog inputs can be read command-response during a stream
+};
+
+/**
+ * Name: DeviceModels
+ * Desc: Lookups into the model and range tables, all by array index
+**/
+class DeviceModels {
+
+	public:
+		static const DeviceModel * Find(long deviceType, bool highVoltage);
+		static const InputRange * FindRange(long udRange);
+		static double GetMaxSampleRate(const DeviceModel * model);
+		static const StreamRate * PlanStream(const DeviceModel * model, double sampleRate);
+		static double GetNoiseVolts(const DeviceModel * model, const StreamRate * rate);
+		static double QuantizeScanRate(const DeviceModel * model, double scanRate);
+		static int FindOversampling(const DeviceModel * model, double scanRate, int numStreamChannels, int maxFactor);
+
+	private:
+		static const double STREAM_RATE_MARGIN;		// Fraction of a setting's maximum rate to plan for
+		static const double MAX_SCAN_INTERVAL;		// Largest count of the scan interval (16 bits)
+		static const double RATE_TOLERANCE;			// Relative difference below which two rates are equal
+};
+#endif
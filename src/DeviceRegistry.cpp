@@ -0,0 +1,1011 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: DeviceRegistry.cpp
+ * Desc: Keeps track of every LabJack in use by DASYLab and merges their
+ *		 scans into DASYLab's single input buffer
+**/
+
+/** Includes **/
+
+// Windows
+#include "stdafx.h"
+#include <windows.h>
+#include <stdio.h>
+#include <stddef.h>
+
+//	LabJack
+#include "c:\program files\labjack\drivers\LabJackUD.h" // TODO: needs to be flexible
+
+// Class header file
+#include "DeviceRegistry.h"
+
+// Application
+#include "LabJackDasy.h"
+#include "DriverSettings.h"
+#include "Stopwatch.h"
+
+/**
+ * Name: DeviceRegistry(DRV_INFOSTRUCT * structAddress)
+ * Desc: Creates the registry with an unopened primary device that uses
+ *		 DASYLab's information structure
+**/
+DeviceRegistry::DeviceRegistry(DRV_INFOSTRUCT * structAddress)
+{
+	int n;
+
+	infoStruct = structAddress;
+	dasyStruct = structAddress;
+	openUnpublished = FALSE;
+
+	for (n = 0; n < MAX_DEVICES; n++)
+	{
+		devices[n] = NULL;
+		deviceStructs[n] = NULL;
+		mergeScans[n] = NULL;
+		firstChannel[n] = 0;
+		numChannels[n] = 0;
+		requestedChannels[n] = 0;
+		active[n] = FALSE;
+	}
+
+	devices[0] = new LabJackLayer(infoStruct);
+	devices[0]->SetRegistryIndex(0);
+	numDevices = 1;
+	merging = FALSE;
+	referenceDevice = 0;
+
+	openState = OPEN_IDLE;
+	openThread = NULL;
+	openDone = CreateEvent(NULL, TRUE, TRUE, NULL);
+	openType = NONE_TYPE;
+	openID = 0;
+	openSerial = 0;
+	openEthernet = FALSE;
+	openFallback = NULL;
+	openTime = 0;
+
+	InitializeCriticalSection(&mergeLock);
+}
+
+/**
+ * Name: ~DeviceRegistry()
+ * Desc: Deletes every device layer and private information structure
+**/
+DeviceRegistry::~DeviceRegistry()
+{
+	int n;
+
+	for (n = 0; n < MAX_DEVICES; n++)
+	{
+		delete devices[n];
+		delete deviceStructs[n];
+		delete [] mergeScans[n];
+	}
+
+	if (openThread != NULL)
+		CloseHandle(openThread);
+	if (openDone != NULL)
+		CloseHandle(openDone);
+
+	DeleteCriticalSection(&mergeLock);
+}
+
+/**
+ * Name: GetPrimary()
+ * Desc: Returns the device that owns DASYLab's information structure and FIFO
+**/
+LabJackLayer * DeviceRegistry::GetPrimary()
+{
+	return devices[0];
+}
+
+/**
+ * Name: GetDevice(int index)
+ * Desc: Returns the device at the given index or NULL if there is none
+**/
+LabJackLayer * DeviceRegistry::GetDevice(int index)
+{
+	if (index < 0 || index >= numDevices)
+		return NULL;
+	return devices[index];
+}
+
+/**
+ * Name: GetNumDevices()
+ * Desc: Returns the number of devices including the primary device
+**/
+int DeviceRegistry::GetNumDevices()
+{
+	return numDevices;
+}
+
+/**
+ * Name: OpenPrimary(long deviceType, int id)
+ * Desc: (Re)opens the primary device over USB followed by the secondary
+ *		 devices. The UD driver's Close() closes every device at once so
+ *		 the secondary devices are always reopened with the primary.
+**/
+void DeviceRegistry::OpenPrimary(long deviceType, int id)
+{
+	RemoveSecondaryDevices();
+	devices[0]->OpenDevice(deviceType, id);
+	LoadSecondaryDevices();
+}
+
+/**
+ * Name: OpenPrimaryEthernet(long deviceType, CString address)
+ * Desc: (Re)opens the primary device over ethernet followed by the
+ *		 secondary devices
+**/
+void DeviceRegistry::OpenPrimaryEthernet(long deviceType, CString address)
+{
+	RemoveSecondaryDevices();
+	devices[0]->OpenEthernetDevice(deviceType, address);
+	LoadSecondaryDevices();
+}
+
+/**
+ * Name: OpenPrimaryBySerial(long deviceType, long serial)
+ * Desc: (Re)opens the primary device over USB by its serial number
+ *		 followed by the secondary devices
+**/
+void DeviceRegistry::OpenPrimaryBySerial(long deviceType, long serial)
+{
+	RemoveSecondaryDevices();
+	devices[0]->OpenDeviceBySerial(deviceType, serial);
+	LoadSecondaryDevices();
+}
+
+/**
+ * Name: BeginOpenPrimary(long deviceType, int id, DeviceDiscovery * fallback)
+ * Desc: Starts opening the primary device on a background thread so that
+ *		 DASYLab's UI thread is not held up by OpenLabJack and the U3 HV
+ *		 detection. A deviceType of NONE_TYPE skips the direct open. If the
+ *		 device does not open and fallback is not NULL, the best device
+ *		 found by its enumeration is opened instead.
+ * Retn: TRUE if the open was started and FALSE if one is already pending
+**/
+bool DeviceRegistry::BeginOpenPrimary(long deviceType, int id, DeviceDiscovery * fallback)
+{
+	if (openState == OPEN_PENDING)
+		return FALSE;
+
+	openType = deviceType;
+	openID = id;
+	openSerial = 0;
+	openEthernet = FALSE;
+	openFallback = fallback;
+
+	return StartOpenThread();
+}
+
+/**
+ * Name: BeginOpenPrimaryBySerial(long deviceType, long serial, int id,
+ *								  DeviceDiscovery * fallback)
+ * Desc: Starts opening the primary device with the given serial number
+ *		 on a background thread. If it is not there the device with the
+ *		 given local ID is tried, unless id is -1, and then the fallback
+ *		 enumeration as for BeginOpenPrimary.
+ * Retn: TRUE if the open was started and FALSE if one is already pending
+**/
+bool DeviceRegistry::BeginOpenPrimaryBySerial(long deviceType, long serial, int id, DeviceDiscovery * fallback)
+{
+	if (openState == OPEN_PENDING)
+		return FALSE;
+
+	openType = deviceType;
+	openID = id;
+	openSerial = serial;
+	openEthernet = FALSE;
+	openFallback = fallback;
+
+	return StartOpenThread();
+}
+
+/**
+ * Name: BeginOpenPrimaryEthernet(long deviceType, CString address)
+ * Desc: Starts opening the primary device over ethernet on a background
+ *		 thread. An unresponsive UE9 then only delays the experiment
+ *		 instead of hanging DASYLab.
+ * Retn: TRUE if the open was started and FALSE if one is already pending
+**/
+bool DeviceRegistry::BeginOpenPrimaryEthernet(long deviceType, CString address)
+{
+	if (openState == OPEN_PENDING)
+		return FALSE;
+
+	openType = deviceType;
+	openAddress = address;
+	openSerial = 0;
+	openEthernet = TRUE;
+	openFallback = NULL;
+
+	return StartOpenThread();
+}
+
+/**
+ * Name: StartOpenThread()
+ * Desc: (private) Marks the open as pending and runs it on a new thread,
+ *		 or synchronously if the thread cannot be created
+ * Retn: TRUE
+**/
+bool DeviceRegistry::StartOpenThread()
+{
+	DWORD threadID;
+
+	if (openThread != NULL)
+	{
+		CloseHandle(openThread);
+		openThread = NULL;
+	}
+
+	// DASYLab may read its structure at any time, so the open fills a
+	// private copy that WaitUntilReady publishes on DASYLab's thread
+	if (openUnpublished)
+		PublishOpen();
+	memcpy(&openStruct, dasyStruct, sizeof(DRV_INFOSTRUCT));
+	infoStruct = &openStruct;
+	devices[0]->SetInfoStruct(&openStruct);
+	openUnpublished = TRUE;
+
+	ResetEvent(openDone);
+	InterlockedExchange(&openState, OPEN_PENDING);
+
+	openThread = CreateThread(NULL, 0, OpenThread, this, 0, &threadID);
+	if (openThread == NULL)
+		RunOpen();
+
+	return TRUE;
+}
+
+/**
+ * Name: OpenThread(LPVOID param)
+ * Desc: (private) Thread entry point for the background open
+**/
+DWORD WINAPI DeviceRegistry::OpenThread(LPVOID param)
+{
+	((DeviceRegistry *)param)->RunOpen();
+
+	return 0;
+}
+
+/**
+ * Name: RunOpen()
+ * Desc: (private) Opens the primary and secondary devices with the pending
+ *		 parameters, remembers the device for the next warm start and
+ *		 publishes the new state
+**/
+void DeviceRegistry::RunOpen()
+{
+	Stopwatch openTimer;
+	long targetDeviceType = openType;
+
+	if (openEthernet)
+		OpenPrimaryEthernet(openType, openAddress);
+	else if (openType != NONE_TYPE && openSerial != 0)
+	{
+		OpenPrimaryBySerial(openType, openSerial);
+		if (!devices[0]->IsOpen() && openID >= 0)
+		{
+			devices[0]->SetError(0);
+			OpenPrimary(openType, openID);
+		}
+	}
+	else if (openType != NONE_TYPE && openID >= 0)
+		OpenPrimary(openType, openID);
+
+	// Fall back on whatever the enumeration found
+	if (!devices[0]->IsOpen() && openFallback != NULL)
+	{
+		devices[0]->SetError(0);
+		openFallback->WaitForEnumeration(DISCOVERY_TIMEOUT);
+		if (openFallback->GetBestDevice(&targetDeviceType))
+			OpenPrimary(targetDeviceType, 0); // Pass zero for first found
+		else
+			devices[0]->SetError(LJE_LABJACK_NOT_FOUND);
+	}
+
+	openTime = openTimer.GetElapsedMs();
+
+	if (devices[0]->IsOpen())
+	{
+		if (!openEthernet)
+			DeviceDiscovery::SetPreferred(targetDeviceType, devices[0]->GetSerialNumber());
+		SaveOpenTimes();
+		InterlockedExchange(&openState, OPEN_READY);
+	}
+	else
+		InterlockedExchange(&openState, OPEN_FAILED);
+
+	SetEvent(openDone);
+}
+
+/**
+ * Name: SaveOpenTimes()
+ * Desc: (private) Writes how long each phase of the last successful open
+ *		 took to the INI file:
+ *
+ *		 [Diagnostics]
+ *		 OpenConnectMs=412.7	; OpenLabJack
+ *		 OpenBufferMs=0.1		; AllocateInputBuffer
+ *		 OpenSerialMs=1.9		; serial number read
+ *		 OpenCalibrationMs=0.4	; constants read, or taken from the INI file
+ *		 OpenInfoMs=3.2			; FillInfoStructure
+ *		 OpenTotalMs=421.0		; including secondary devices and fallback
+**/
+void DeviceRegistry::SaveOpenTimes()
+{
+	const char * keys[LabJackLayer::NUM_OPEN_PHASES] = {
+		"OpenConnectMs", "OpenBufferMs", "OpenSerialMs", "OpenCalibrationMs", "OpenInfoMs" };
+	char value[32];
+	int n;
+
+	for (n = 0; n < LabJackLayer::NUM_OPEN_PHASES; n++)
+	{
+		sprintf(value, "%.1f", devices[0]->GetOpenPhaseTime(n));
+		DriverSettings::PutString("Diagnostics", keys[n], value);
+	}
+
+	sprintf(value, "%.1f", openTime);
+	DriverSettings::PutString("Diagnostics", "OpenTotalMs", value);
+}
+
+/**
+ * Name: WaitUntilReady(DWORD timeout)
+ * Desc: Waits up to timeout milliseconds for a pending open to finish,
+ *		 then copies what it found into DASYLab's structure. Called on
+ *		 DASYLab's thread. On failure the Error of DASYLab's structure is
+ *		 set to DRV_ERR_DEVICENOTINIT if the open is still running and is
+ *		 left as the open set it otherwise.
+ * Retn: TRUE if the primary device is open and FALSE otherwise
+**/
+bool DeviceRegistry::WaitUntilReady(DWORD timeout)
+{
+	WaitForSingleObject(openDone, timeout);
+
+	if (openState == OPEN_PENDING)
+	{
+		dasyStruct->Error = DRV_ERR_DEVICENOTINIT;
+		return FALSE;
+	}
+
+	if (openUnpublished)
+		PublishOpen();
+
+	return devices[0]->IsOpen();
+}
+
+/**
+ * Name: PublishOpen()
+ * Desc: (private) Copies the hardware description a finished open wrote
+ *		 into openStruct to DASYLab's structure and moves the registry and
+ *		 primary device back onto it. Only the fields the open fills are
+ *		 copied, so experiment settings DASYLab changed meanwhile stay.
+**/
+void DeviceRegistry::PublishOpen()
+{
+	dasyStruct->Error = openStruct.Error;
+	dasyStruct->Features = openStruct.Features;
+	dasyStruct->HelpIndex = openStruct.HelpIndex;
+
+	// Part 2 of the structure, from MinFreq up to the experiment setup
+	memcpy(&dasyStruct->MinFreq, &openStruct.MinFreq,
+		offsetof(DRV_INFOSTRUCT, AI_Frequency) - offsetof(DRV_INFOSTRUCT, MinFreq));
+
+	// Set by FillInfoStructure and AllocateInputBuffer
+	dasyStruct->ADI_BlockSize = openStruct.ADI_BlockSize;
+	if (openStruct.Error == DRV_ERR_NOTENOUGHMEM)
+		dasyStruct->DriverBufferSize = openStruct.DriverBufferSize;
+
+	infoStruct = dasyStruct;
+	devices[0]->SetInfoStruct(dasyStruct);
+	openUnpublished = FALSE;
+}
+
+/**
+ * Name: GetOpenState()
+ * Desc: Returns one of the OPEN_ constants
+**/
+LONG DeviceRegistry::GetOpenState()
+{
+	return openState;
+}
+
+/**
+ * Name: GetOpenTime()
+ * Desc: Returns the total milliseconds taken by the last open
+**/
+double DeviceRegistry::GetOpenTime()
+{
+	return openTime;
+}
+
+/**
+ * Name: LoadSecondaryDevices()
+ * Desc: Opens the secondary devices listed in the driver INI file:
+ *
+ *		 [Devices]
+ *		 Secondary=2
+ *		 [Device1]
+ *		 Type=6			; LJ_dt value, must match the primary device
+ *		 ID=1			; local ID for USB devices
+ *		 Address=		; IP address for ethernet devices
+ *		 Channels=16	; DASYLab AI channels to map onto it (0 for all)
+ *
+ * Note: Expects no secondary devices to be open, see OpenPrimary
+**/
+void DeviceRegistry::LoadSecondaryDevices()
+{
+	int n, count, id, channels;
+	long type;
+	char section[16];
+	CString address;
+
+	if (!devices[0]->IsOpen())
+		return;
+
+	count = DriverSettings::GetInt("Devices", "Secondary", 0);
+	for (n = 1; n <= count && numDevices < MAX_DEVICES; n++)
+	{
+		sprintf(section, "Device%d", n);
+		type = DriverSettings::GetInt(section, "Type", devices[0]->GetDeviceType());
+		id = DriverSettings::GetInt(section, "ID", n);
+		channels = DriverSettings::GetInt(section, "Channels", 0);
+		address = DriverSettings::GetString(section, "Address", "");
+
+		if (address.IsEmpty())
+			AddDevice(type, id, channels);
+		else
+			AddEthernetDevice(type, address, channels);
+	}
+
+	UpdateChannelMap();
+}
+
+/**
+ * Name: AddDevice(long deviceType, int id, int channels)
+ * Desc: Opens a secondary device over USB and appends it to the registry
+ * Retn: TRUE if successful and FALSE otherwise (infoStruct->Error is set)
+**/
+bool DeviceRegistry::AddDevice(long deviceType, int id, int channels)
+{
+	DRV_INFOSTRUCT * deviceStruct;
+	LabJackLayer * device;
+
+	if (numDevices == MAX_DEVICES)
+		return FALSE;
+
+	// Start from a copy of DASYLab's structure so the experiment defaults are sane
+	deviceStruct = new DRV_INFOSTRUCT;
+	memcpy(deviceStruct, infoStruct, sizeof(DRV_INFOSTRUCT));
+
+	device = new LabJackLayer(deviceStruct);
+	device->OpenDevice(deviceType, id);
+
+	return FinishAdd(device, deviceStruct, channels);
+}
+
+/**
+ * Name: AddEthernetDevice(long deviceType, CString address, int channels)
+ * Desc: Opens a secondary device over ethernet and appends it to the registry
+ * Retn: TRUE if successful and FALSE otherwise (infoStruct->Error is set)
+**/
+bool DeviceRegistry::AddEthernetDevice(long deviceType, CString address, int channels)
+{
+	DRV_INFOSTRUCT * deviceStruct;
+	LabJackLayer * device;
+
+	if (numDevices == MAX_DEVICES)
+		return FALSE;
+
+	deviceStruct = new DRV_INFOSTRUCT;
+	memcpy(deviceStruct, infoStruct, sizeof(DRV_INFOSTRUCT));
+
+	device = new LabJackLayer(deviceStruct);
+	device->OpenEthernetDevice(deviceType, address);
+
+	return FinishAdd(device, deviceStruct, channels);
+}
+
+/**
+ * Name: FinishAdd(LabJackLayer * device, DRV_INFOSTRUCT * deviceStruct, int channels)
+ * Desc: (private) Keeps a newly opened secondary device or throws it away
+ *		 if it failed to open or is not the same model as the primary device.
+ *		 Gain codes are shared through DASYLab's GainInfo so all devices
+ *		 must be the same model. A rejected device is only released: the
+ *		 UD driver's Close() would close the devices already in use.
+**/
+bool DeviceRegistry::FinishAdd(LabJackLayer * device, DRV_INFOSTRUCT * deviceStruct, int channels)
+{
+	if (device->IsOpen() && device->GetDeviceType() != devices[0]->GetDeviceType())
+		deviceStruct->Error = DRV_ERR_CHECKHARDWARE;
+
+	if (!device->IsOpen() || deviceStruct->Error)
+	{
+		infoStruct->Error = deviceStruct->Error;
+		if (device->IsOpen())
+			device->Release();
+		delete device;
+		delete deviceStruct;
+		return FALSE;
+	}
+
+	device->SetRegistryIndex(numDevices);
+	devices[numDevices] = device;
+	deviceStructs[numDevices] = deviceStruct;
+	requestedChannels[numDevices] = channels;
+	numDevices++;
+
+	return TRUE;
+}
+
+/**
+ * Name: RemoveSecondaryDevices()
+ * Desc: Releases every device except the primary one, which keeps its
+ *		 handle
+**/
+void DeviceRegistry::RemoveSecondaryDevices()
+{
+	int n;
+
+	for (n = 1; n < numDevices; n++)
+	{
+		if (devices[n]->IsOpen())
+			devices[n]->Release();
+		delete devices[n];
+		delete deviceStructs[n];
+		devices[n] = NULL;
+		deviceStructs[n] = NULL;
+	}
+	numDevices = 1;
+
+	UpdateChannelMap();
+}
+
+/**
+ * Name: UpdateChannelMap()
+ * Desc: Lays the devices' analog inputs end to end in DASYLab's channel
+ *		 numbering and publishes the combined channel information. Must be
+ *		 called again whenever the primary device is (re)opened since that
+ *		 refills DASYLab's information structure.
+**/
+void DeviceRegistry::UpdateChannelMap()
+{
+	int n, i, available, total;
+
+	total = 0;
+	for (n = 0; n < numDevices; n++)
+	{
+		if (n == 0)
+			available = devices[0]->GetOwnedChannels();
+		else
+			available = deviceStructs[n]->Max_AI_Channel;
+
+		numChannels[n] = available;
+		if (requestedChannels[n] > 0 && requestedChannels[n] < available)
+			numChannels[n] = requestedChannels[n];
+		if (total + numChannels[n] > 512)
+			numChannels[n] = 512 - total;
+
+		firstChannel[n] = total;
+		devices[n]->SetOwnedChannels(numChannels[n]);
+
+		// Show the secondary channels to DASYLab after those before them
+		if (n > 0)
+			for (i = 0; i < numChannels[n]; i++)
+				infoStruct->AI_ChInfo[total + i] = deviceStructs[n]->AI_ChInfo[i];
+
+		total += numChannels[n];
+	}
+
+	if (numDevices > 1)
+		infoStruct->Max_AI_Channel = total;
+}
+
+/**
+ * Name: BuildDeviceStruct(int index)
+ * Desc: (private) Copies the part of DASYLab's experiment setup that
+ *		 concerns the given secondary device into its private structure,
+ *		 renumbering its channels from 0. Digital inputs and stop-after-N
+ *		 handling stay with the primary device.
+**/
+void DeviceRegistry::BuildDeviceStruct(int index)
+{
+	DRV_INFOSTRUCT * deviceStruct = deviceStructs[index];
+	int i, source;
+
+	deviceStruct->Error = 0;
+	deviceStruct->AI_Frequency = infoStruct->AI_Frequency;
+	deviceStruct->AcquisitionMode = DRV_AQM_CONTINUOUS;
+	deviceStruct->MaxBlocks = 0;
+	deviceStruct->ADI_BlockSize = infoStruct->ADI_BlockSize;
+	deviceStruct->DI_Channel = 0;
+	deviceStruct->DI_FreqRate = infoStruct->DI_FreqRate;
+	deviceStruct->AO_FreqRate = infoStruct->AO_FreqRate;
+	deviceStruct->DO_FreqRate = infoStruct->DO_FreqRate;
+
+	memset(deviceStruct->AI_Channel, 0, sizeof(deviceStruct->AI_Channel));
+	for (i = 0; i < numChannels[index]; i++)
+	{
+		source = firstChannel[index] + i;
+		if (infoStruct->AI_Channel[source / 16] & (1 << (source % 16)))
+			deviceStruct->AI_Channel[i / 16] |= (WORD)(1 << (i % 16));
+		deviceStruct->AI_ChSetup[i] = infoStruct->AI_ChSetup[source];
+	}
+}
+
+/**
+ * Name: ConfirmDataStructure()
+ * Desc: Verifies DASYLab's information structure for the primary device
+ *		 and the derived structures of every secondary device
+**/
+bool DeviceRegistry::ConfirmDataStructure()
+{
+	int n, totalStreamChannels;
+
+	// With several devices the rate depends on all their channels
+	for (n = 0; n < numDevices; n++)
+		devices[n]->SetFrequencyNegotiation(numDevices == 1);
+
+	if (!devices[0]->ConfirmDataStructure())
+		return FALSE;
+
+	for (n = 1; n < numDevices; n++)
+	{
+		BuildDeviceStruct(n);
+		if (!devices[n]->ConfirmDataStructure())
+		{
+			CopyError(n);
+			return FALSE;
+		}
+	}
+
+	if (numDevices == 1)
+		return TRUE;
+
+	// Round AI_Frequency so the common scan rate is exact
+	totalStreamChannels = 0;
+	for (n = 0; n < numDevices; n++)
+	{
+		totalStreamChannels += devices[n]->GetNumAINRequested();
+		if (devices[n]->GetNumDIRequested() > 0)
+			totalStreamChannels++;
+	}
+
+	devices[0]->FillFrequencyList(totalStreamChannels);
+	return devices[0]->NegotiateFrequency(totalStreamChannels);
+}
+
+/**
+ * Name: BeginExperiment()
+ * Desc: Starts every device with channels in the experiment. With several
+ *		 devices each one gets a queue and the same scan rate, which is
+ *		 AI_Frequency spread over the stream channels of all devices.
+**/
+void DeviceRegistry::BeginExperiment()
+{
+	int n, width, totalStreamChannels;
+	double scanRate;
+	bool useStreaming;
+
+	if (numDevices == 1)
+	{
+		merging = FALSE;
+		devices[0]->SetScanSink(NULL);
+		devices[0]->SetScanFrequency(0);
+		devices[0]->BeginExperiment();
+		return;
+	}
+
+	// Size the queues and work out the common scan rate
+	totalStreamChannels = 0;
+	for (n = 0; n < numDevices; n++)
+	{
+		width = devices[n]->GetNumAINRequested() + devices[n]->GetNumDIRequested();
+		active[n] = width > 0;
+
+		scanQueues[n].Allocate(QUEUE_SCANS, width);
+		delete [] mergeScans[n];
+		mergeScans[n] = new SAMPLE[width > 0 ? width : 1];
+		memset(mergeScans[n], 0, sizeof(SAMPLE) * (width > 0 ? width : 1));
+
+		totalStreamChannels += devices[n]->GetNumAINRequested();
+		if (devices[n]->GetNumDIRequested() > 0)
+			totalStreamChannels++;
+	}
+
+	if (totalStreamChannels == 0)
+		totalStreamChannels = 1;
+	scanRate = infoStruct->AI_Frequency / totalStreamChannels;
+	useStreaming = devices[0]->RequiresStreaming();
+
+	// The merged timeline follows the first device taking part
+	referenceDevice = 0;
+	while (referenceDevice < numDevices - 1 && !active[referenceDevice])
+		referenceDevice++;
+	aligner.Reset(numDevices, scanRate);
+
+	merging = TRUE;
+	for (n = 0; n < numDevices; n++)
+	{
+		devices[n]->SetScanSink(&scanQueues[n]);
+		devices[n]->SetScanFrequency(scanRate);
+	}
+
+	// Start the secondary devices first so the primary never waits on them
+	for (n = numDevices - 1; n > 0; n--)
+	{
+		if (!active[n])
+			continue;
+
+		devices[n]->BeginExperiment(useStreaming);
+		if (!devices[n]->IsMeasuring())
+		{
+			CopyError(n);
+			StopExperiment();
+			return;
+		}
+	}
+
+	devices[0]->BeginExperiment(useStreaming);
+}
+
+/**
+ * Name: StopExperiment()
+ * Desc: Stops every device
+**/
+void DeviceRegistry::StopExperiment()
+{
+	int n;
+
+	for (n = 0; n < numDevices; n++)
+		devices[n]->StopExperiment();
+
+	if (merging)
+		SaveAlignment();
+	merging = FALSE;
+}
+
+/**
+ * Name: AdvanceInputBuf()
+ * Desc: Frees a processed block in the primary device's FIFO and stops the
+ *		 secondary devices once a stop-after-N experiment is complete
+**/
+void DeviceRegistry::AdvanceInputBuf()
+{
+	int n;
+
+	devices[0]->AdvanceInputBuf();
+
+	if (merging && devices[0]->HasReachedMaxBlocks())
+		for (n = 1; n < numDevices; n++)
+			devices[n]->StopExperiment();
+}
+
+/**
+ * Name: IsMeasuring()
+ * Desc: Returns true if any device is taking part in an experiment
+**/
+bool DeviceRegistry::IsMeasuring()
+{
+	int n;
+
+	for (n = 0; n < numDevices; n++)
+		if (devices[n]->IsMeasuring())
+			return TRUE;
+
+	return FALSE;
+}
+
+/**
+ * Name: StreamCallback(int index, long scansAvailable, double userValue)
+ * Desc: Routes a UD stream callback to the device it came from and merges
+ *		 any scans that are now complete on every device
+**/
+void DeviceRegistry::StreamCallback(int index, long scansAvailable, double userValue)
+{
+	DWORD scansBefore;
+
+	if (index < 0 || index >= numDevices)
+		return;
+
+	scansBefore = scanQueues[index].GetTotalScans();
+	devices[index]->StreamCallback(scansAvailable, userValue);
+
+	if (merging)
+	{
+		StampBatch(index, scansBefore);
+		MergeScans();
+	}
+}
+
+/**
+ * Name: CommandResponseCallback(LabJackLayer * device)
+ * Desc: Routes a timer tick to the device it was installed for and merges
+ *		 any scans that are now complete on every device
+**/
+void DeviceRegistry::CommandResponseCallback(LabJackLayer * device)
+{
+	DWORD scansBefore;
+	int index;
+
+	for (index = 0; index < numDevices && devices[index] != device; index++);
+
+	// A tick from a timer that outlived its device is ignored
+	if (index == numDevices)
+		return;
+
+	scansBefore = scanQueues[index].GetTotalScans();
+	device->CommandResponseCallback();
+
+	if (merging)
+	{
+		StampBatch(index, scansBefore);
+		MergeScans();
+	}
+}
+
+/**
+ * Name: StampBatch(int index, DWORD scansBefore)
+ * Desc: (private) Stamps the scans a device just queued with the host time
+ *		 so the aligner can follow its clock
+**/
+void DeviceRegistry::StampBatch(int index, DWORD scansBefore)
+{
+	long numScans = scanQueues[index].GetTotalScans() - scansBefore;
+
+	if (numScans <= 0)
+		return;
+
+	EnterCriticalSection(&mergeLock);
+	aligner.AddBatch(index, numScans, Stopwatch::GetTimeMs());
+	LeaveCriticalSection(&mergeLock);
+}
+
+/**
+ * Name: MergeScans()
+ * Desc: (private) For each scan of the reference device, asks the aligner
+ *		 what every other active device contributes: its scan nearest in
+ *		 time, after dropping any earlier ones, or a repeat of its last scan
+ *		 if its next one is later. Stops when a device has to be waited for.
+ *		 Each combined scan is written into DASYLab's FIFO as the primary
+ *		 device's analog inputs, then each secondary device's analog inputs
+ *		 in channel order, then the primary device's digital inputs. Between
+ *		 block mode capture windows the scans are merged but not written.
+**/
+void DeviceRegistry::MergeScans()
+{
+	int n, action, primaryAIN, mergedWidth;
+	unsigned long adjustments;
+	bool ready;
+
+	EnterCriticalSection(&mergeLock);
+
+	primaryAIN = devices[0]->GetNumAINRequested();
+	adjustments = aligner.GetTotalAdjustments();
+
+	mergedWidth = 0;
+	for (n = 0; n < numDevices; n++)
+		if (active[n])
+			mergedWidth += n == 0 ? primaryAIN + devices[0]->GetNumDIRequested() : scanQueues[n].GetScanWidth();
+
+	while (active[referenceDevice] && scanQueues[referenceDevice].GetScansAvailable() > 0)
+	{
+		// Decide for every device before taking anything so a device that
+		// must be waited for leaves the others untouched
+		ready = TRUE;
+		for (n = 0; n < numDevices && ready; n++)
+		{
+			if (!active[n] || n == referenceDevice)
+				continue;
+
+			do
+			{
+				action = aligner.Align(n, referenceDevice, scanQueues[n].GetScansAvailable(),
+									   scanQueues[referenceDevice].GetScansAvailable());
+				if (action == ScanAligner::ALIGN_DROP)
+				{
+					scanQueues[n].PopScan(mergeScans[n]);
+					aligner.Commit(n, action);
+				}
+			} while (action == ScanAligner::ALIGN_DROP);
+
+			alignActions[n] = action;
+			ready = action != ScanAligner::ALIGN_WAIT;
+		}
+		if (!ready)
+			break;
+
+		scanQueues[referenceDevice].PopScan(mergeScans[referenceDevice]);
+		aligner.Commit(referenceDevice, ScanAligner::ALIGN_USE);
+		for (n = 0; n < numDevices; n++)
+		{
+			if (!active[n] || n == referenceDevice)
+				continue;
+			if (alignActions[n] == ScanAligner::ALIGN_USE)
+				scanQueues[n].PopScan(mergeScans[n]);
+			aligner.Commit(n, alignActions[n]);
+		}
+
+		if (!devices[0]->AcceptCaptureScan(mergedWidth))
+			continue;
+
+		if (active[0])
+			devices[0]->WriteInputScan(mergeScans[0], primaryAIN);
+		for (n = 1; n < numDevices; n++)
+			if (active[n])
+				devices[0]->WriteInputScan(mergeScans[n], scanQueues[n].GetScanWidth());
+		if (active[0])
+			devices[0]->WriteInputScan(mergeScans[0] + primaryAIN, devices[0]->GetNumDIRequested());
+	}
+
+	if (aligner.GetTotalAdjustments() != adjustments)
+		devices[0]->ReportDataLost();
+
+	LeaveCriticalSection(&mergeLock);
+}
+
+/**
+ * Name: SaveAlignment()
+ * Desc: (private) Writes what the aligner did during the experiment to the
+ *		 INI file, one line per device:
+ *
+ *		 [Diagnostics]
+ *		 Align1=12,3,-37.5,205.0,0,0	; inserted, dropped, offset (ms),
+ *										; drift (ppm), relocks, queue overruns
+**/
+void DeviceRegistry::SaveAlignment()
+{
+	char key[16];
+	char value[96];
+	int n;
+
+	for (n = 0; n < numDevices; n++)
+	{
+		sprintf(key, "Align%d", n);
+		sprintf(value, "%lu,%lu,%.1f,%.1f,%lu,%lu", aligner.GetInsertedScans(n), aligner.GetDroppedScans(n),
+				aligner.GetOffset(n, referenceDevice), aligner.GetDrift(n, referenceDevice),
+				aligner.GetRelocks(n), (unsigned long)scanQueues[n].GetDroppedScans());
+		DriverSettings::PutString("Diagnostics", key, value);
+	}
+}
+
+/**
+ * Name: CopyError(int index)
+ * Desc: (private) Reports an error from a secondary device's private
+ *		 structure through DASYLab's structure
+**/
+void DeviceRegistry::CopyError(int index)
+{
+	if (deviceStructs[index] != NULL && deviceStructs[index]->Error)
+		infoStruct->Error = deviceStructs[index]->Error;
+}
+
+/**
+ * Name: CleanUp()
+ * Desc: Frees the buffers and closes every open device, stopping an
+ *		 experiment DASYLab abandoned first
+**/
+void DeviceRegistry::CleanUp()
+{
+	int n;
+	bool anyOpen = devices[0]->IsOpen();
+
+	if (IsMeasuring())
+		StopExperiment();
+
+	for (n = numDevices - 1; n >= 1; n--)
+	{
+		if (devices[n]->IsOpen())
+		{
+			devices[n]->Release();
+			anyOpen = TRUE;
+		}
+	}
+
+	// The UD driver's Close() closes them all at once
+	if (anyOpen)
+		devices[0]->CleanUp();
+}
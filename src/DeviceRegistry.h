@@ -0,0 +1,120 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: DeviceRegistry.h
+ * Desc: Header file for DeviceRegistry object class
+**/
+
+#ifndef DEVICEREGISTRY_H
+#define DEVICEREGISTRY_H
+
+//	Windows
+#include "stdafx.h"
+#include <windows.h>
+
+//	DASYLab driver interface
+#include "treiber.h"
+
+// Application
+#include "LabJackLayer.h"
+#include "ScanQueue.h"
+#include "ScanAligner.h"
+#include "DeviceDiscovery.h"
+
+/**
+ * Name: DeviceRegistry
+ * Desc: Owns every LabJackLayer in use by DASYLab. The primary device (index 0)
+ *		 uses DASYLab's information structure and owns the FIFO. Secondary
+ *		 devices are listed in the driver INI file, get private information
+ *		 structures and are mapped onto the DASYLab AI channels following
+ *		 those of the device before them. Every device streams on its own;
+ *		 their scans are queued, lined up in time by a ScanAligner and
+ *		 merged scan by scan into the FIFO.
+**/
+class DeviceRegistry {
+
+		// Constants
+		const static int MAX_DEVICES = 4;
+		const static DWORD QUEUE_SCANS = 16384;			// Scans each device may run ahead of the slowest one
+		const static DWORD DISCOVERY_TIMEOUT = 10000;	// Longest wait for enumeration when falling back (ms)
+
+		// Instance variables
+		DRV_INFOSTRUCT * infoStruct;					// Structure the registry and primary device use: DASYLab's, or openStruct during an open
+		DRV_INFOSTRUCT * dasyStruct;					// DASYLab's information structure
+		DRV_INFOSTRUCT openStruct;						// Private copy a background open fills
+		bool openUnpublished;							// openStruct holds an open not yet copied to dasyStruct
+		LabJackLayer * devices[MAX_DEVICES];			// Device layers, index 0 is the primary device
+		DRV_INFOSTRUCT * deviceStructs[MAX_DEVICES];	// Private information structures of secondary devices
+		ScanQueue scanQueues[MAX_DEVICES];				// Scans waiting to be merged, one queue per device
+		int firstChannel[MAX_DEVICES];					// First DASYLab AI channel mapped onto each device
+		int numChannels[MAX_DEVICES];					// Number of DASYLab AI channels mapped onto each device
+		int requestedChannels[MAX_DEVICES];				// Channel count asked for in the INI file (0 for all)
+		int numDevices;									// Number of devices in the registry (at least the primary)
+		bool merging;									// TRUE while several devices feed the FIFO
+		bool active[MAX_DEVICES];						// Devices with at least one channel in the experiment
+		SAMPLE * mergeScans[MAX_DEVICES];				// Last scan taken from each device, repeated on insertion
+		ScanAligner aligner;							// Host time base clock model of every device
+		int referenceDevice;							// Active device whose scans set the merged timeline
+		int alignActions[MAX_DEVICES];					// ALIGN_ decision for each device in the scan being merged
+		CRITICAL_SECTION mergeLock;						// Serializes merging between device callback threads
+		volatile LONG openState;						// One of the OPEN_ states below
+		HANDLE openThread;								// Background open, NULL when none was started
+		HANDLE openDone;								// Manual reset event, signaled when no open is pending
+		long openType;									// Parameters of the pending open
+		int openID;										// Local ID, or -1 for none
+		long openSerial;								// Serial number, or 0 to open by local ID
+		CString openAddress;
+		bool openEthernet;
+		DeviceDiscovery * openFallback;					// Enumeration to fall back on or NULL
+		double openTime;								// Total milliseconds of the last open
+
+	public:
+		// Public constants
+		const static LONG OPEN_IDLE = 0;				// No open has been requested
+		const static LONG OPEN_PENDING = 1;				// An open is running in the background
+		const static LONG OPEN_READY = 2;				// The primary device is open
+		const static LONG OPEN_FAILED = 3;				// The last open did not find a device
+
+		DeviceRegistry(DRV_INFOSTRUCT * structAddress);
+		~DeviceRegistry();
+		LabJackLayer * GetPrimary();
+		LabJackLayer * GetDevice(int index);
+		int GetNumDevices();
+		void OpenPrimary(long deviceType, int id);
+		void OpenPrimaryEthernet(long deviceType, CString address);
+		void OpenPrimaryBySerial(long deviceType, long serial);
+		bool BeginOpenPrimary(long deviceType, int id, DeviceDiscovery * fallback);
+		bool BeginOpenPrimaryEthernet(long deviceType, CString address);
+		bool BeginOpenPrimaryBySerial(long deviceType, long serial, int id, DeviceDiscovery * fallback);
+		bool WaitUntilReady(DWORD timeout);
+		LONG GetOpenState();
+		double GetOpenTime();
+		void LoadSecondaryDevices();
+		bool AddDevice(long deviceType, int id, int channels);
+		bool AddEthernetDevice(long deviceType, CString address, int channels);
+		void RemoveSecondaryDevices();
+		void UpdateChannelMap();
+		bool ConfirmDataStructure();
+		void BeginExperiment();
+		void StopExperiment();
+		void AdvanceInputBuf();
+		bool IsMeasuring();
+		void StreamCallback(int index, long scansAvailable, double userValue);
+		void CommandResponseCallback(LabJackLayer * device);
+		void CleanUp();
+
+	private:
+		bool StartOpenThread();
+		static DWORD WINAPI OpenThread(LPVOID param);
+		void RunOpen();
+		void PublishOpen();
+		void SaveOpenTimes();
+		bool FinishAdd(LabJackLayer * device, DRV_INFOSTRUCT * deviceStruct, int channels);
+		void BuildDeviceStruct(int index);
+		void StampBatch(int index, DWORD scansBefore);
+		void MergeScans();
+		void SaveAlignment();
+		void CopyError(int index);
+};
+#endif
@@ -60,6 +60,7 @@ void DeviceSetupDialog::OnBnClickedCancel()
 void DeviceSetupDialog::OnBnClickedOk()
 {
 	int id;
+	bool started = TRUE;
 
 	// Get the id number as string
 	CString * idAddress = new CString("");
@@ -72,10 +73,10 @@ void DeviceSetupDialog::OnBnClickedOk()
 	switch(DeviceCombo.GetCurSel())
 	{
 	case U3_COMBOBOX_INDEX:
-		OpenNewDevice(LJ_dtU3, id);
+		started = OpenNewDevice(LJ_dtU3, id);
 		break;
 	case U6_COMBOBOX_INDEX:
-		OpenNewDevice(LJ_dtU6, id);
+		started = OpenNewDevice(LJ_dtU6, id);
 		break;
 	case UE9_COMBOBOX_INDEX:
 		
@@ -84,16 +85,23 @@ void DeviceSetupDialog::OnBnClickedOk()
 		{
 			CString * ipAddress = new CString("");
 			ipEntry.GetWindowText(*ipAddress);
-			OpenNewEthernetDevice(LJ_dtUE9, *ipAddress);
+			started = OpenNewEthernetDevice(LJ_dtUE9, *ipAddress);
 			delete ipAddress;
 		}
 		else
-			OpenNewDevice(LJ_dtUE9, id);
+			started = OpenNewDevice(LJ_dtUE9, id);
 		break;
 	}
 
 	delete idAddress;
 
+	// Keep the dialog up until the device being opened is done
+	if (!started)
+	{
+		MessageBox("The previous device is still being opened. Please try again shortly.", "LabJack", MB_OK | MB_ICONINFORMATION);
+		return;
+	}
+
 	CDialog::OnOK();
 }
 
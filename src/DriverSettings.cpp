@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: DriverSettings.cpp
+ * Desc: A thin wrapper around the driver's INI file
+**/
+
+// Windows
+#include "stdafx.h"
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Class header file
+#include "DriverSettings.h"
+
+const char DriverSettings::INI_FILE_NAME[] = "LabJackDASY.ini";
+
+/**
+ * Name: GetInt(const char * section, const char * key, int defaultValue)
+ * Desc: Returns the integer stored under section/key or defaultValue
+ *		 if it is not present
+**/
+int DriverSettings::GetInt(const char * section, const char * key, int defaultValue)
+{
+	return (int)GetPrivateProfileInt(section, key, defaultValue, INI_FILE_NAME);
+}
+
+/**
+ * Name: GetDouble(const char * section, const char * key, double defaultValue)
+ * Desc: Returns the floating point value stored under section/key or
+ *		 defaultValue if it is not present
+**/
+double DriverSettings::GetDouble(const char * section, const char * key, double defaultValue)
+{
+	char buffer[64];
+
+	GetPrivateProfileString(section, key, "", buffer, sizeof(buffer), INI_FILE_NAME);
+	if (buffer[0] == '\0')
+		return defaultValue;
+
+	return atof(buffer);
+}
+
+/**
+ * Name: GetString(const char * section, const char * key, const char * defaultValue)
+ * Desc: Returns the string stored under section/key or defaultValue
+ *		 if it is not present
+**/
+CString DriverSettings::GetString(const char * section, const char * key, const char * defaultValue)
+{
+	char buffer[256];
+
+	GetPrivateProfileString(section, key, defaultValue, buffer, sizeof(buffer), INI_FILE_NAME);
+	return CString(buffer);
+}
+
+/**
+ * Name: PutInt(const char * section, const char * key, int value)
+ * Desc: Stores an integer under section/key
+**/
+void DriverSettings::PutInt(const char * section, const char * key, int value)
+{
+	char buffer[30];
+
+	sprintf(buffer, "%d", value);
+	WritePrivateProfileString(section, key, buffer, INI_FILE_NAME);
+}
+
+/**
+ * Name: PutString(const char * section, const char * key, const char * value)
+ * Desc: Stores a string under section/key
+**/
+void DriverSettings::PutString(const char * section, const char * key, const char * value)
+{
+	WritePrivateProfileString(section, key, value, INI_FILE_NAME);
+}
@@ -0,0 +1,36 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: DriverSettings.h
+ * Desc: Header file for DriverSettings, a thin wrapper around the
+ *		 driver's INI file
+**/
+
+#ifndef DRIVERSETTINGS_H
+#define DRIVERSETTINGS_H
+
+//	Windows
+#include "stdafx.h"
+#include <windows.h>
+
+/**
+ * Name: DriverSettings
+ * Desc: Reads and writes the advanced settings that DASYLab has no dialog
+ *		 for. The file name is reported to DASYLab in INIFileName and the
+ *		 file itself lives in the Windows directory like other DASYLab
+ *		 driver INI files.
+**/
+class DriverSettings {
+
+	public:
+		static int GetInt(const char * section, const char * key, int defaultValue);
+		static double GetDouble(const char * section, const char * key, double defaultValue);
+		static CString GetString(const char * section, const char * key, const char * defaultValue);
+		static void PutInt(const char * section, const char * key, int value);
+		static void PutString(const char * section, const char * key, const char * value);
+
+		// Public constants
+		static const char INI_FILE_NAME[];				// Name of the INI file (fits in DRV_INFOSTRUCT::INIFileName)
+};
+#endif
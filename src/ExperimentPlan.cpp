@@ -0,0 +1,517 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: ExperimentPlan.cpp
+ * Desc: Experiment setup compiled from DASYLab's information structure
+**/
+
+/** Includes **/
+
+// Windows
+#include "stdafx.h"
+#include <windows.h>
+
+// Compiler
+#include <math.h>
+
+// Class header file
+#include "ExperimentPlan.h"
+
+// Application
+#include "Thermocouple.h"
+
+/** Bit positions by de Bruijn product, see LowestBit **/
+static const int DE_BRUIJN_POSITION[32] = {
+	0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+	31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+};
+
+/**
+ * Name: ExperimentPlan()
+ * Desc: Creates an empty plan, not yet compiled
+**/
+ExperimentPlan::ExperimentPlan()
+{
+	compiled = FALSE;
+	numAnalogInputs = 0;
+	numDigitalInputs = 0;
+	numStreamChannels = 0;
+	numStreamAnalogInputs = 0;
+	numSlowInputs = 0;
+	coldJunction = -1;
+	pollSlowInputs = FALSE;
+	slowDownCount = DEFAULT_SLOW_DOWN;
+	aiFrequency = 0;
+	overallFrequency = 0;
+	scanFrequency = 0;
+	callbackScans = 0;
+	bufferSize = 0;
+	blockSize = 0;
+	maxBlocks = 0;
+	windowBlocks = 0;
+}
+
+/**
+ * Name: Compile(DRV_INFOSTRUCT * info, const DeviceModel * model,
+ *				 int ownedChannels, const InputOptions * options)
+ * Desc: Works out the plan from DASYLab's structure for the given model.
+ *		 Only the first ownedChannels analog inputs belong to the device.
+ *		 options selects slow inputs, thermocouples and the cold junction,
+ *		 or is NULL to read every input as volts at the scan rate.
+**/
+void ExperimentPlan::Compile(DRV_INFOSTRUCT * info, const DeviceModel * model, int ownedChannels, const InputOptions * options)
+{
+	CompileScanOrder(info, model, ownedChannels, options);
+	CompileConversion(info, model);
+	CompileTiming(info);
+	compiled = TRUE;
+}
+
+/**
+ * Name: CompileScanOrder(DRV_INFOSTRUCT * info, const DeviceModel * model,
+ *						  int ownedChannels, const InputOptions * options)
+ * Desc: (private) Lists the requested analog and digital inputs in channel
+ *		 order and the stream channels that read them. Only the set bits
+ *		 of the bitmaps are visited, so a sparse selection out of 512
+ *		 channels costs no more than its own size.
+ *
+ *		 The device scan that is converted holds the stream channels, the
+ *		 analog inputs first and then the word of the digital lines,
+ *		 followed by the latest value of every slow input. Slow inputs are
+ *		 polled while the stream runs if the model allows it; otherwise
+ *		 they stay in the stream and their readings are averaged. The cold
+ *		 junction sensor is read like a slow input that is not delivered.
+**/
+void ExperimentPlan::CompileScanOrder(DRV_INFOSTRUCT * info, const DeviceModel * model, int ownedChannels, const InputOptions * options)
+{
+	AnalogInputPlan input;
+	SlowInputPlan slowInput;
+	DWORD bits;
+	int i, word, channel;
+
+	if (ownedChannels > model->numAIChannels)
+		ownedChannels = model->numAIChannels;
+
+	// AI_Channel is a bitmap of 16 channels per WORD
+	analogInputs.clear();
+	for (word = 0; word < NUM_AI_WORDS && word * 16 < ownedChannels; word++)
+	{
+		for (bits = info->AI_Channel[word]; bits != 0; bits &= bits - 1)
+		{
+			channel = word * 16 + LowestBit(bits);
+			if (channel >= ownedChannels)
+				break;
+
+			input.channel = channel;
+			input.udChannel = model->aiChannels[channel];
+			input.gainCode = 0;
+			input.udRange = 0;
+			input.scale = 1;
+			input.slow = options != NULL && (options->slowChannels[word] & (1 << (channel % 16))) != 0;
+			input.streamIndex = -1;
+			input.source = -1;
+			input.thermocouple = options != NULL ? Thermocouples::Find(options->thermocouples[channel]) : -1;
+			analogInputs.push_back(input);
+		}
+	}
+	numAnalogInputs = (int)analogInputs.size();
+
+	digitalInputs.clear();
+	for (bits = info->DI_Channel; bits != 0; bits &= bits - 1)
+		digitalInputs.push_back(LowestBit(bits));
+	numDigitalInputs = (int)digitalInputs.size();
+
+	// Every streamed analog input then one channel carrying all digital
+	// inputs
+	pollSlowInputs = model->pollsWhileStreaming;
+	streamChannels.clear();
+	slowInputs.clear();
+	for (i = 0; i < numAnalogInputs; i++)
+	{
+		if (!analogInputs[i].slow || !pollSlowInputs)
+		{
+			analogInputs[i].streamIndex = (int)streamChannels.size();
+			if (!analogInputs[i].slow)
+				analogInputs[i].source = analogInputs[i].streamIndex;
+			streamChannels.push_back(analogInputs[i].udChannel);
+		}
+
+		if (analogInputs[i].slow)
+		{
+			slowInput.analogInput = i;
+			slowInput.udChannel = analogInputs[i].udChannel;
+			slowInput.streamIndex = analogInputs[i].streamIndex;
+			slowInputs.push_back(slowInput);
+		}
+	}
+
+	coldJunction = -1;
+	if (options != NULL && options->coldJunction && model->temperatureChannel >= 0)
+	{
+		slowInput.analogInput = -1;
+		slowInput.udChannel = model->aiChannels[model->temperatureChannel];
+		slowInput.streamIndex = -1;
+		if (!pollSlowInputs)
+		{
+			slowInput.streamIndex = (int)streamChannels.size();
+			streamChannels.push_back(slowInput.udChannel);
+		}
+		coldJunction = (int)slowInputs.size();
+		slowInputs.push_back(slowInput);
+	}
+	numStreamAnalogInputs = (int)streamChannels.size();
+	numSlowInputs = (int)slowInputs.size();
+
+	if (numDigitalInputs > 0)
+		streamChannels.push_back(model->digitalStreamChannel);
+	numStreamChannels = (int)streamChannels.size();
+
+	for (i = 0; i < numSlowInputs; i++)
+	{
+		if (slowInputs[i].analogInput >= 0)
+			analogInputs[slowInputs[i].analogInput].source = numStreamChannels + i;
+	}
+}
+
+/**
+ * Name: LowestBit(DWORD bits)
+ * Desc: (private) Returns the position of the lowest set bit (count of
+ *		 trailing zeros). Isolating the bit and multiplying by a de Bruijn
+ *		 sequence puts a unique pattern in the top five bits, which the
+ *		 table turns back into the position; the compiler has no
+ *		 _BitScanForward intrinsic.
+ * Note: bits must not be 0
+**/
+int ExperimentPlan::LowestBit(DWORD bits)
+{
+	return DE_BRUIJN_POSITION[(((bits & (0 - bits)) * 0x077CB531UL) & 0xFFFFFFFFUL) >> 27];
+}
+
+/**
+ * Name: CompileConversion(DRV_INFOSTRUCT * info, const DeviceModel * model)
+ * Desc: (private) Works out the range and the volts to SAMPLE factor of
+ *		 every analog input from its gain and its (calibrated) input limits,
+ *		 so conversion is a single multiply. A thermocouple's factor is
+ *		 degrees Celsius to SAMPLE over the range of its type, which the
+ *		 driver reports as the channel's input limits whatever the gain.
+**/
+void ExperimentPlan::CompileConversion(DRV_INFOSTRUCT * info, const DeviceModel * model)
+{
+	AnalogInputPlan * input;
+	const ThermocoupleType * tc;
+	double maxValue, inputRange, bitsAvailable;
+	int i;
+
+	bitsAvailable = sizeof(SAMPLE) * 8;
+
+	for (i = 0; i < numAnalogInputs; i++)
+	{
+		input = &analogInputs[i];
+		input->gainCode = info->AI_ChSetup[input->channel].GainCode;
+		input->udRange = input->gainCode < model->numGains ? model->gains[input->gainCode].udRange : 0;
+
+		if (input->thermocouple >= 0)
+		{
+			tc = Thermocouples::Get(input->thermocouple);
+			input->scale = pow(2.0, bitsAvailable-1) / (tc->maxCelsius - tc->minCelsius);
+			continue;
+		}
+
+		// Calculate range
+		inputRange = info->AI_ChInfo[input->channel].InputRange_Max - info->AI_ChInfo[input->channel].InputRange_Min;
+
+		// Find the maximum value
+		if (info->AI_ChInfo[input->channel].InputRange_Min < 0)
+			maxValue = pow(2.0, bitsAvailable-1);
+		else
+			maxValue = pow(2.0, bitsAvailable);
+
+		input->scale = maxValue / inputRange;
+
+		// Apply range
+		if (input->gainCode != 0 && input->gainCode < model->numGains)
+			input->scale *= info->GainInfo[input->gainCode];
+	}
+}
+
+/**
+ * Name: CompileTiming(DRV_INFOSTRUCT * info)
+ * Desc: (private) Works out the rates and the buffer geometry
+**/
+void ExperimentPlan::CompileTiming(DRV_INFOSTRUCT * info)
+{
+	aiFrequency = info->AI_Frequency;
+
+	// Each digital input counts as a reading of its own in command-response
+	overallFrequency = aiFrequency;
+	if (numDigitalInputs > 0)
+	{
+		if (numAnalogInputs > 0)
+			overallFrequency += aiFrequency / numAnalogInputs * (numDigitalInputs - 1);
+		else
+			overallFrequency += aiFrequency * (numDigitalInputs - 1);
+	}
+
+	if (GetNumScanChannels() > 0)
+	{
+		scanFrequency = aiFrequency / GetNumScanChannels();
+		callbackScans = info->ADI_BlockSize / GetNumScanChannels();
+	}
+	else
+	{
+		scanFrequency = aiFrequency;
+		callbackScans = info->ADI_BlockSize;
+	}
+
+	slowDownCount = info->SlowDownCount > 0 ? info->SlowDownCount : DEFAULT_SLOW_DOWN;
+
+	bufferSize = info->DriverBufferSize;
+	blockSize = info->ADI_BlockSize;
+
+	if (info->AcquisitionMode == DRV_AQM_STOP)
+		maxBlocks = info->MaxBlocks;
+	else
+		maxBlocks = 0;
+
+	if (info->AcquisitionMode == DRV_AQM_BLOCK)
+		windowBlocks = info->MaxBlocks;
+	else
+		windowBlocks = 0;
+}
+
+/**
+ * Name: Invalidate()
+ * Desc: Marks the plan out of date, for example after the input buffer
+ *		 was reallocated, so it is compiled again before the next run
+**/
+void ExperimentPlan::Invalidate()
+{
+	compiled = FALSE;
+}
+
+/**
+ * Name: IsCompiled()
+ * Desc: Returns true once Compile has been called
+**/
+bool ExperimentPlan::IsCompiled()
+{
+	return compiled;
+}
+
+/**
+ * Name: GetNumAnalogInputs()
+ * Desc: Returns the number of analog inputs in the scan list
+**/
+int ExperimentPlan::GetNumAnalogInputs()
+{
+	return numAnalogInputs;
+}
+
+/**
+ * Name: GetAnalogInputs()
+ * Desc: Returns the analog inputs in scan order
+**/
+const AnalogInputPlan * ExperimentPlan::GetAnalogInputs()
+{
+	return numAnalogInputs > 0 ? &analogInputs[0] : NULL;
+}
+
+/**
+ * Name: GetNumDigitalInputs()
+ * Desc: Returns the number of digital inputs in the scan list
+**/
+int ExperimentPlan::GetNumDigitalInputs()
+{
+	return numDigitalInputs;
+}
+
+/**
+ * Name: GetDigitalInputs()
+ * Desc: Returns the digital input lines in scan order
+**/
+const int * ExperimentPlan::GetDigitalInputs()
+{
+	return numDigitalInputs > 0 ? &digitalInputs[0] : NULL;
+}
+
+/**
+ * Name: GetNumStreamChannels()
+ * Desc: Returns the number of stream channels: one per streamed analog
+ *		 input plus one (193) carrying all digital inputs
+**/
+int ExperimentPlan::GetNumStreamChannels()
+{
+	return numStreamChannels;
+}
+
+/**
+ * Name: GetStreamChannels()
+ * Desc: Returns the stream channels in scan order
+**/
+const long * ExperimentPlan::GetStreamChannels()
+{
+	return numStreamChannels > 0 ? &streamChannels[0] : NULL;
+}
+
+/**
+ * Name: GetNumStreamAnalogInputs()
+ * Desc: Returns the number of analog inputs at the start of a stream scan
+**/
+int ExperimentPlan::GetNumStreamAnalogInputs()
+{
+	return numStreamAnalogInputs;
+}
+
+/**
+ * Name: GetNumScanChannels()
+ * Desc: Returns the channels AI_Frequency is spread over: every analog
+ *		 input, slow or not, plus one for all digital inputs
+**/
+int ExperimentPlan::GetNumScanChannels()
+{
+	return numAnalogInputs + (numDigitalInputs > 0 ? 1 : 0);
+}
+
+/**
+ * Name: GetDigitalSource()
+ * Desc: Returns the position of the digital line word in the device scan
+**/
+int ExperimentPlan::GetDigitalSource()
+{
+	return numStreamAnalogInputs;
+}
+
+/**
+ * Name: GetScanWidth()
+ * Desc: Returns the values in a device scan: the stream channels then one
+ *		 per slow input
+**/
+int ExperimentPlan::GetScanWidth()
+{
+	return numStreamChannels + numSlowInputs;
+}
+
+/**
+ * Name: GetNumSlowInputs()
+ * Desc: Returns the number of inputs read at the slowdown rate, counting
+ *		 the cold junction sensor
+**/
+int ExperimentPlan::GetNumSlowInputs()
+{
+	return numSlowInputs;
+}
+
+/**
+ * Name: GetSlowInputs()
+ * Desc: Returns the slow inputs in the order of their device scan values
+**/
+const SlowInputPlan * ExperimentPlan::GetSlowInputs()
+{
+	return numSlowInputs > 0 ? &slowInputs[0] : NULL;
+}
+
+/**
+ * Name: GetColdJunction()
+ * Desc: Returns the index into GetSlowInputs() of the cold junction sensor
+ *		 or -1 if it is not read
+**/
+int ExperimentPlan::GetColdJunction()
+{
+	return coldJunction;
+}
+
+/**
+ * Name: IsPollingSlowInputs()
+ * Desc: Returns true if slow inputs are read on their own while streaming
+ *		 and false if they are streamed and averaged
+**/
+bool ExperimentPlan::IsPollingSlowInputs()
+{
+	return pollSlowInputs;
+}
+
+/**
+ * Name: GetSlowDownCount()
+ * Desc: Returns the scans per reading of a slow input (SlowDownCount)
+**/
+DWORD ExperimentPlan::GetSlowDownCount()
+{
+	return slowDownCount;
+}
+
+/**
+ * Name: GetAIFrequency()
+ * Desc: Returns AI_Frequency, the rate summed over the scan list (Hz)
+**/
+double ExperimentPlan::GetAIFrequency()
+{
+	return aiFrequency;
+}
+
+/**
+ * Name: GetOverallFrequency()
+ * Desc: Returns the readings per second when every digital input is read
+ *		 on its own, as command-response does
+**/
+double ExperimentPlan::GetOverallFrequency()
+{
+	return overallFrequency;
+}
+
+/**
+ * Name: GetScanFrequency()
+ * Desc: Returns the scan rate of a device streaming on its own (Hz)
+**/
+double ExperimentPlan::GetScanFrequency()
+{
+	return scanFrequency;
+}
+
+/**
+ * Name: GetCallbackScans()
+ * Desc: Returns the scans in one block of ADI_BlockSize samples
+**/
+long ExperimentPlan::GetCallbackScans()
+{
+	return callbackScans;
+}
+
+/**
+ * Name: GetBufferSize()
+ * Desc: Returns the size of DASYLab's input buffer (samples)
+**/
+DWORD ExperimentPlan::GetBufferSize()
+{
+	return bufferSize;
+}
+
+/**
+ * Name: GetBlockSize()
+ * Desc: Returns the size of a DRV_GetInputBuf block (samples)
+**/
+DWORD ExperimentPlan::GetBlockSize()
+{
+	return blockSize;
+}
+
+/**
+ * Name: GetMaxBlocks()
+ * Desc: Returns the blocks to acquire before stopping, 0 for continuous
+**/
+DWORD ExperimentPlan::GetMaxBlocks()
+{
+	return maxBlocks;
+}
+
+/**
+ * Name: GetWindowBlocks()
+ * Desc: Returns the blocks requested per window in block mode, after
+ *		 which acquisition pauses until DASYLab has read them, or 0 to
+ *		 acquire without gaps. CaptureWindow may round this up so a window
+ *		 also holds whole scans.
+**/
+DWORD ExperimentPlan::GetWindowBlocks()
+{
+	return windowBlocks;
+}
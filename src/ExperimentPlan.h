@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: ExperimentPlan.h
+ * Desc: Header file for ExperimentPlan object class
+**/
+
+#ifndef EXPERIMENTPLAN_H
+#define EXPERIMENTPLAN_H
+
+//	Windows
+#include "stdafx.h"
+#include <windows.h>
+
+//	Compiler
+#include <vector>
+
+//	DASYLab driver interface
+#include "treiber.h"
+
+// Application
+#include "DeviceModel.h"
+
+/**
+ * Name: AnalogInputPlan
+ * Desc: How one analog input of the scan list is set up and converted
+**/
+struct AnalogInputPlan {
+	int channel;									// DASYLab channel number (index into AI_ChSetup)
+	long udChannel;									// Physical channel read through the UD driver
+	UINT16 gainCode;								// Index into GainInfo chosen in DASYLab
+	long udRange;									// LJ_rg for the gain code
+	double scale;									// Volts to SAMPLE factor
+	bool slow;										// Delivered at the slowdown rate
+	int streamIndex;								// Position in a stream scan or -1 if polled
+	int source;										// Position of the value converted in the device scan
+	int thermocouple;								// Index into Thermocouples or -1 for volts
+};
+
+/**
+ * Name: SlowInputPlan
+ * Desc: One input read at the slowdown rate: a slow analog input of the
+ *		 scan list, or the cold junction sensor that no channel delivers
+**/
+struct SlowInputPlan {
+	int analogInput;								// Index into the analog inputs or -1 for the cold junction
+	long udChannel;									// Physical channel read through the UD driver
+	int streamIndex;								// Position in a stream scan or -1 if polled
+};
+
+struct InputOptions;
+
+/**
+ * Name: ExperimentPlan
+ * Desc: Everything an experiment needs from DRV_INFOSTRUCT, worked out
+ *		 once when DASYLab calls DRV_TestStruct: the scan order, the
+ *		 conversion of every analog input, the stream parameters and the
+ *		 buffer geometry. DRV_StartMeas only activates the plan and the
+ *		 device layer reads nothing else while acquiring. DRV_TestStruct
+ *		 is refused during a run, so DASYLab editing its structure then has
+ *		 no effect until the next experiment.
+**/
+class ExperimentPlan {
+
+		// Constants
+		const static int NUM_DI_LINES = 32;				// Bits in DI_Channel
+		const static DWORD DEFAULT_SLOW_DOWN = 100;		// Slowdown when DASYLab sets none
+
+		// Instance variables
+		bool compiled;
+		std::vector<AnalogInputPlan> analogInputs;		// In scan order
+		int numAnalogInputs;
+		std::vector<int> digitalInputs;					// DI line numbers in scan order
+		int numDigitalInputs;
+		std::vector<long> streamChannels;				// LJ_ioADD_STREAM_CHANNEL order
+		int numStreamChannels;
+		int numStreamAnalogInputs;						// Leading stream channels that are analog inputs
+		std::vector<SlowInputPlan> slowInputs;			// Slow analog inputs then the cold junction
+		int numSlowInputs;
+		int coldJunction;								// Index into slowInputs of the cold junction or -1
+		bool pollSlowInputs;							// Slow inputs are read on their own, not streamed
+		DWORD slowDownCount;							// Scans per reading of a slow input
+		double aiFrequency;								// AI_Frequency, summed over the scan list
+		double overallFrequency;						// Readings per second counting every digital input
+		double scanFrequency;							// AI_Frequency spread over the scan channels
+		long callbackScans;								// Scans per stream callback (one block)
+		DWORD bufferSize;								// DriverBufferSize (samples)
+		DWORD blockSize;								// ADI_BlockSize (samples)
+		DWORD maxBlocks;								// Blocks to acquire, 0 for continuous
+		DWORD windowBlocks;								// Blocks per capture window in block mode, 0 otherwise
+
+	public:
+		const static int NUM_AI_WORDS = 32;				// WORDs in the AI_Channel bitmap (512 channels)
+
+		ExperimentPlan();
+		void Compile(DRV_INFOSTRUCT * info, const DeviceModel * model, int ownedChannels, const InputOptions * options);
+		void Invalidate();
+		bool IsCompiled();
+		int GetNumAnalogInputs();
+		const AnalogInputPlan * GetAnalogInputs();
+		int GetNumDigitalInputs();
+		const int * GetDigitalInputs();
+		int GetNumStreamChannels();
+		const long * GetStreamChannels();
+		int GetNumStreamAnalogInputs();
+		int GetNumScanChannels();
+		int GetDigitalSource();
+		int GetScanWidth();
+		int GetNumSlowInputs();
+		const SlowInputPlan * GetSlowInputs();
+		int GetColdJunction();
+		bool IsPollingSlowInputs();
+		DWORD GetSlowDownCount();
+		double GetAIFrequency();
+		double GetOverallFrequency();
+		double GetScanFrequency();
+		long GetCallbackScans();
+		DWORD GetBufferSize();
+		DWORD GetBlockSize();
+		DWORD GetMaxBlocks();
+		DWORD GetWindowBlocks();
+
+	private:
+		void CompileScanOrder(DRV_INFOSTRUCT * info, const DeviceModel * model, int ownedChannels, const InputOptions * options);
+		static int LowestBit(DWORD bits);
+		void CompileConversion(DRV_INFOSTRUCT * info, const DeviceModel * model);
+		void CompileTiming(DRV_INFOSTRUCT * info);
+};
+
+/**
+ * Name: InputOptions
+ * Desc: Driver settings that change how the analog inputs are read, which
+ *		 DASYLab's structure has no place for
+**/
+struct InputOptions {
+	WORD slowChannels[ExperimentPlan::NUM_AI_WORDS];	// Bitmap like AI_Channel of the inputs delivered slowly
+	char thermocouples[ExperimentPlan::NUM_AI_WORDS * 16];	// Type letter of each DASYLab channel or 0 for volts
+	bool coldJunction;								// Read the internal temperature sensor as the cold junction
+};
+#endif
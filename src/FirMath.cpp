@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: FirMath.cpp
+ * Desc: FIR filter design and dot product
+ * Note: Built without the precompiled header so that it stays portable
+**/
+
+// Compiler
+#include <math.h>
+
+// SSE on x86, plain C elsewhere
+#if defined(_M_IX86) || defined(__SSE__)
+#define FIRMATH_SSE
+#include <xmmintrin.h>
+#endif
+
+// Class header file
+#include "FirMath.h"
+
+static const double PI = 3.14159265358979323846;
+
+/**
+ * Name: WindowedSinc(double cutoff, double distance, double span)
+ * Desc: Returns the low pass coefficient at distance input samples from
+ *		 the filter's centre: a sinc with its -6 dB point at cutoff (cycles
+ *		 per input sample) under a Blackman window span samples wide. The
+ *		 caller scales the filter to unity gain.
+**/
+double FirMath::WindowedSinc(double cutoff, double distance, double span)
+{
+	double value, u;
+
+	value = 2 * cutoff;
+	if (distance != 0)
+		value = sin(2 * PI * cutoff * distance) / (PI * distance);
+
+	u = distance / span + 0.5;
+	return value * (0.42 - 0.5 * cos(2 * PI * u) + 0.08 * cos(4 * PI * u));
+}
+
+/**
+ * Name: DotProduct(const float * a, const float * b, int count)
+ * Desc: Returns the sum of the products of a and b, four at a time.
+ *		 count must be a multiple of 4; the arrays need no alignment.
+**/
+float FirMath::DotProduct(const float * a, const float * b, int count)
+{
+	int n;
+
+#ifdef FIRMATH_SSE
+	__m128 sum = _mm_setzero_ps();
+	float parts[4];
+
+	for (n = 0; n < count; n += 4)
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + n), _mm_loadu_ps(b + n)));
+	_mm_storeu_ps(parts, sum);
+
+	return (parts[0] + parts[1]) + (parts[2] + parts[3]);
+#else
+	float sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+
+	for (n = 0; n < count; n += 4)
+	{
+		sum0 += a[n] * b[n];
+		sum1 += a[n + 1] * b[n + 1];
+		sum2 += a[n + 2] * b[n + 2];
+		sum3 += a[n + 3] * b[n + 3];
+	}
+
+	return (sum0 + sum1) + (sum2 + sum3);
+#endif
+}
@@ -0,0 +1,23 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: FirMath.h
+ * Desc: Header file for FirMath, the shared FIR filter routines
+**/
+
+#ifndef FIRMATH_H
+#define FIRMATH_H
+
+/**
+ * Name: FirMath
+ * Desc: Filter design and the inner loop shared by the Resampler and the
+ *		 Decimator. No Windows or DASYLab dependencies.
+**/
+class FirMath {
+
+	public:
+		static double WindowedSinc(double cutoff, double distance, double span);
+		static float DotProduct(const float * a, const float * b, int count);
+};
+#endif
@@ -49,18 +49,25 @@ EXTERN_C IMAGE_DOS_HEADER __ImageBase;
 //	Application
 #include "LabJackDasy.h"
 #include "LabJackLayer.h"
+#include "DeviceRegistry.h"
+#include "DriverSettings.h"
+#include "DeviceDiscovery.h"
 #include "DeviceSetupDialog.h"
+#include "WorksheetConfig.h"
 
 //	LabJack
 #include "c:\program files\labjack\drivers\LabJackUD.h" // TODO: needs to be flexible
 
 /** Global variables **/
 // TODO: Need to get rid of these distasteful global variables
-LabJackLayer * deviceLayer;
+DeviceRegistry * deviceRegistry;					// Every LabJack in use, the primary one owns the FIFO
+DeviceDiscovery * deviceDiscovery;					// Background enumeration and its persistent cache
 const char DRIVER_NAME [] = "LabJackDASY";
 const char DASY_DRIVER_VERSION [] = "0.1//05.10";	// Version/Date as required by DASYLab
 const double DEFAULT_FREQUENCY = 10;				// The default frequency for input (Hz)
 const DWORD DEFAULT_BLOCK_SIZE = 4;					// The default size allocated for readings (bytes)
+const DWORD OPEN_WAIT_TIMEOUT = 15000;				// Longest wait for a background open before an experiment (ms)
+const DWORD KILL_WAIT_TIMEOUT = 5000;				// Longest wait for a background open on shutdown (ms)
 DWORD StartTime;									// for start time of measure
 HINSTANCE hInst = NULL;								// handle to previous WINDOWS-instance
 DRV_INFOSTRUCT * infoStruct;						// Pointer to DASYLab's information structure
@@ -111,7 +118,7 @@ extern "C"
 **/
 int _stdcall DRV_AdvanceAnalogOutputBuf()
 {
-	deviceLayer->AdvanceAnalogOutputBuf();
+	deviceRegistry->GetPrimary()->AdvanceAnalogOutputBuf();
 	return TRUE;
 }
 
@@ -132,7 +139,7 @@ int _stdcall DRV_AdvanceCounterOutputBuf()
 **/
 int _stdcall DRV_AdvanceDigitalOutputBuf()
 {
-	deviceLayer->AdvanceDigitalOutputBuf();
+	deviceRegistry->GetPrimary()->AdvanceDigitalOutputBuf();
 	return TRUE;
 }
 
@@ -142,7 +149,7 @@ int _stdcall DRV_AdvanceDigitalOutputBuf()
 **/
 int _stdcall DRV_AdvanceInputBuf()
 {
-	deviceLayer->AdvanceInputBuf(); //AnalogInputBuf();
+	deviceRegistry->AdvanceInputBuf(); //AnalogInputBuf();
 	return DRV_FUNCTION_OK;
 }
 
@@ -154,71 +161,14 @@ char* _stdcall DRV_ExplainGainCode(SCAN_ENTRY chan, UINT gainIndex)
 {
 	UNUSED (chan);
 
-	long gainCode, dasyLabGainCode;
+	const InputRange * range;
 
-	dasyLabGainCode = infoStruct->GainInfo[gainIndex];
+	// GainInfo is filled from the model's table, so its index is the table's
+	range = deviceRegistry->GetPrimary()->GetGainRange(gainIndex);
+	if (range == NULL)
+		return NULL; // Error - Invalid gain code
 
-	gainCode = deviceLayer->ConvertToUDRange(dasyLabGainCode);
-
-	// Explain the gain code according to the range constant it represents
-	// TODO: There ought to be a more graceful way to do this?
-	switch(gainCode)
-	{
-		case LJ_rgAUTO:
-			return "auto";
-		case LJ_rgBIP20V:
-			return "+/- 20V";
-		case LJ_rgBIP10V:
-			return "+/- 10V";
-		case LJ_rgBIP5V:
-			return "+/- 5V";
-		case LJ_rgBIP4V:
-			return "+/- 4V";
-		case LJ_rgBIP2P5V:
-			return "+/- 2V";
-		case LJ_rgBIP2V:
-			return "+/- 2V";
-		case LJ_rgBIP1P25V:
-			return "+/- 1.25V";
-		case LJ_rgBIP1V:
-			return "+/- 1V";
-		case LJ_rgBIPP625V:
-			return "+/- 0.625V";
-		case LJ_rgBIPP1V:
-			return "+/- 0.1V";
-		case LJ_rgBIPP01V:
-			return "+/- 0.01V";
-		case LJ_rgUNI20V:
-			return "0-20V";
-		case LJ_rgUNI10V:
-			return "0-10V";
-		case LJ_rgUNI5V:
-			return "0-5V";
-		case LJ_rgUNI4V:
-			return "0-4V";
-		case LJ_rgUNI2P5V:
-			return "0-2.5V";
-		case LJ_rgUNI2V:
-			return "0-2V";
-		case LJ_rgUNI1P25V:
-			return "0-1.25V";
-		case LJ_rgUNI1V:
-			return "0-1V";
-		case LJ_rgUNIP625V:
-			return "0-0.625V";
-		case LJ_rgUNIP5V:
-			return "0-5V";
-		case LJ_rgUNIP25V:
-			return "0-0.25V";
-		case LJ_rgUNIP3125V:
-			return "0-0.3125V";
-		case LJ_rgUNIP025V:
-			return "0-0.025V";
-		case LJ_rgUNIP0025V:
-			return "0-0.0025V";
-		default:
-			return NULL; // Error - Invalid gain code
-	}
+	return (char *)range->text;
 }
 
 /**
@@ -227,7 +177,7 @@ char* _stdcall DRV_ExplainGainCode(SCAN_ENTRY chan, UINT gainIndex)
 **/
 LPSAMPLE _stdcall DRV_GetAnalogOutputBuf()
 {
-	return deviceLayer->GetAnalogOutputBuf();
+	return deviceRegistry->GetPrimary()->GetAnalogOutputBuf();
 }
 
 /**
@@ -236,7 +186,7 @@ LPSAMPLE _stdcall DRV_GetAnalogOutputBuf()
 **/
 int _stdcall DRV_GetAnalogOutputStatus()
 {
-	return (int)deviceLayer->GetAnalogOutputStatus();
+	return (int)deviceRegistry->GetPrimary()->GetAnalogOutputStatus();
 }
 
 /**
@@ -267,7 +217,7 @@ int _stdcall DRV_GetCounterOutputStatus()
 **/
 LPSAMPLE _stdcall DRV_GetDigitalOutputBuf()
 {
-	return deviceLayer->GetDigitalOutputBuf();
+	return deviceRegistry->GetPrimary()->GetDigitalOutputBuf();
 }
 
 /**
@@ -276,7 +226,7 @@ LPSAMPLE _stdcall DRV_GetDigitalOutputBuf()
 **/
 int _stdcall DRV_GetDigitalOutputStatus()
 {
-	return deviceLayer->GetDigitalOutputStatus();
+	return deviceRegistry->GetPrimary()->GetDigitalOutputStatus();
 }
 
 /**
@@ -296,7 +246,7 @@ HW_COMPONENT * _stdcall DRV_GetHardwareDescription()
 **/
 LPSAMPLE _stdcall DRV_GetInputBuf()
 {
-	return deviceLayer->GetInputBuf(); //AnalogInputBuf();
+	return deviceRegistry->GetPrimary()->GetInputBuf(); //AnalogInputBuf();
 }
 
 /**
@@ -307,7 +257,7 @@ LPSAMPLE _stdcall DRV_GetInputBuf()
 **/
 int _stdcall DRV_GetInputBufStatus()
 {
-	return deviceLayer->GetInputStatus(); //AnalogInputStatus();
+	return deviceRegistry->GetPrimary()->GetInputStatus(); //AnalogInputStatus();
 }
 
 /**
@@ -316,7 +266,7 @@ int _stdcall DRV_GetInputBufStatus()
 **/
 DRV_MEASINFO * _stdcall DRV_GetMeasInfoEx()
 {
-	return deviceLayer->GetMeasInfo();
+	return deviceRegistry->GetPrimary()->GetMeasInfo();
 }
 
 /**
@@ -328,83 +278,128 @@ int _stdcall DRV_InitDevice(DRV_INFOSTRUCT *newInfoStruct)
 	
 	infoStruct = newInfoStruct;
 	
-	// Create the layer but do not open the device
-	deviceLayer = new LabJackLayer(newInfoStruct);
+	// Create the registry and its primary layer but do not open the device
+	deviceRegistry = new DeviceRegistry(newInfoStruct);
 
 	// Define the driver identification information not related to the device
 	_fstrcpy(infoStruct->DriverName, DRIVER_NAME);
 	_fstrcpy(infoStruct->DLL_Version, DASY_DRIVER_VERSION);
 	_fstrcpy(infoStruct->VxD_Version, DASY_DRIVER_VERSION);
 	infoStruct->DriverIdCode = DRV_ID_FREEWARE;	// or DRV_ID_OEM
+	_fstrcpy(infoStruct->INIFileName, DriverSettings::INI_FILE_NAME);
 
 	// Set experiment defaults
 	infoStruct->AI_Frequency = DEFAULT_FREQUENCY;
 	infoStruct->ADI_BlockSize = DEFAULT_BLOCK_SIZE;
 
-	// Find first available device
-	long numDevices = 0;
-	long targetDeviceType = 0;
-	long serialNumbers [128];
-	long ids [128];
-	double addresses [128];
-
-	// TODO: Might be a better way to do this?
-	ListAll(LJ_dtU3, LJ_ctUSB, &numDevices, &serialNumbers[0], &ids[0], &addresses[0]);
-	targetDeviceType = NONE_TYPE;
-	if(numDevices > 0)
-		targetDeviceType = LJ_dtU3;
-	ListAll(LJ_dtU6, LJ_ctUSB, &numDevices, &serialNumbers[0], &ids[0], &addresses[0]);
-	if(numDevices > 0)
-		targetDeviceType = LJ_dtU6;
-	ListAll(LJ_dtUE9, LJ_ctUSB, &numDevices, &serialNumbers[0], &ids[0], &addresses[0]);
-	if(numDevices > 0)
-		targetDeviceType = LJ_dtUE9;
-	if(targetDeviceType == NONE_TYPE)
-	{
-		deviceLayer->SetError(LJE_LABJACK_NOT_FOUND);
-		DRV_ShowError();
-		//return DRV_FUNCTION_FALSE;
-	}
+	// Start listing every model on the bus in the background
+	long targetDeviceType = NONE_TYPE;
+	long serialNumber = 0;
+
+	deviceDiscovery = new DeviceDiscovery();
+	deviceDiscovery->BeginEnumeration();
 
-	// Open the device
-	deviceLayer->OpenDevice(targetDeviceType, 0); // Pass zero for first found
+	// Open in the background: the device used last time by its serial number
+	// (warm start) or else the first device the enumeration finds (cold start).
+	// Errors are reported when DRV_TestStruct or DRV_StartMeas wait for it.
+	if (!deviceDiscovery->LoadCache() || !deviceDiscovery->GetPreferred(&targetDeviceType, &serialNumber))
+		targetDeviceType = NONE_TYPE;
+	deviceRegistry->BeginOpenPrimaryBySerial(targetDeviceType, serialNumber, -1, deviceDiscovery);
 
-	// Return value according to errors generated
-	if (deviceLayer->GetError())
-		DRV_ShowError();
-		//return DRV_FUNCTION_FALSE;
-	//else
 	return DRV_FUNCTION_OK;
 	// Force to return OK for ethernet purposes
 }
 
 /**
- * Name: DRV_KillDevice()
- * Desc: Clean up the device layer
+ * Name: WaitForDevice()
+ * Desc: Waits a bounded time for a background open to finish and shows
+ *		 the error if the device did not open
+ * Retn: TRUE if the primary device is open and FALSE otherwise
 **/
-int _stdcall DRV_KillDevice()
+bool WaitForDevice()
 {
-	if (deviceLayer->IsOpen())
+	HCURSOR oldCursor;
+	bool ready;
+
+	if (deviceRegistry->GetOpenState() == DeviceRegistry::OPEN_PENDING)
 	{
-		deviceLayer->CleanUp();
-		//_CrtDumpMemoryLeaks();
-		delete deviceLayer;
-		//_CrtDumpMemoryLeaks();
-		//delete deviceDialog;
-		return DRV_FUNCTION_OK;
+		oldCursor = SetCursor (LoadCursor (NULL, IDC_WAIT));
+		ready = deviceRegistry->WaitUntilReady(OPEN_WAIT_TIMEOUT);
+		SetCursor (oldCursor);
 	}
 	else
+		ready = deviceRegistry->WaitUntilReady(0);
+
+	// Show why the device did not open once, then report it as not initialized
+	if (!ready)
+	{
+		if (deviceRegistry->GetPrimary()->GetError() > LabJackLayer::LABJACK_ERROR_PREFIX)
+			DRV_ShowError();
+		infoStruct->Error = DRV_ERR_DEVICENOTINIT;
+	}
+
+	return ready;
+}
+
+/**
+ * Name: DRV_KillDevice()
+ * Desc: Clean up the device layer
+**/
+int _stdcall DRV_KillDevice()
+{
+	bool primaryOpen;
+
+	// The background open still uses the registry; leave it rather than
+	// delete it from under the thread
+	if (!deviceRegistry->WaitUntilReady(KILL_WAIT_TIMEOUT) &&
+		deviceRegistry->GetOpenState() == DeviceRegistry::OPEN_PENDING)
 		return DRV_FUNCTION_FALSE;
+
+	// Secondary devices may be open when the primary is not, so the
+	// registry is torn down either way
+	primaryOpen = deviceRegistry->GetPrimary()->IsOpen();
+	deviceRegistry->CleanUp();
+	//_CrtDumpMemoryLeaks();
+	delete deviceRegistry;
+	delete deviceDiscovery;
+	deviceRegistry = NULL;
+	deviceDiscovery = NULL;
+	//_CrtDumpMemoryLeaks();
+	//delete deviceDialog;
+
+	return primaryOpen ? DRV_FUNCTION_OK : DRV_FUNCTION_FALSE;
 }
 
 /**
  * Name: DRV_LoadWorksheet(const char *name)
- * Desc: Required DASYLab entry point
- * Note: This is a useless stub and LabJack Corp. has no intention of finishing it :)
+ * Desc: Called once a worksheet has been loaded. If its DriverParam names
+ *		 a device other than the one open, that device is opened directly
+ *		 by serial number or IP address, without enumerating.
 **/
 int _stdcall DRV_LoadWorksheet(const char *name)
 {
+	WorksheetConfig config;
+	HCURSOR oldCursor;
+
 	UNUSED(name);
+
+	// Worksheets saved before or by another driver are left alone
+	if (!config.Read(infoStruct->DriverParam, sizeof(infoStruct->DriverParam)))
+		return DRV_FUNCTION_OK;
+
+	// A warm start may still be opening, and may already be the right device
+	oldCursor = SetCursor (LoadCursor (NULL, IDC_WAIT));
+	deviceRegistry->WaitUntilReady(OPEN_WAIT_TIMEOUT);
+	SetCursor (oldCursor);
+
+	if (config.Matches(deviceRegistry->GetPrimary()))
+		return DRV_FUNCTION_OK;
+
+	if (config.IsEthernet())
+		deviceRegistry->BeginOpenPrimaryEthernet(config.GetDeviceType(), config.GetIPAddress());
+	else
+		deviceRegistry->BeginOpenPrimaryBySerial(config.GetDeviceType(), config.GetSerialNumber(), config.GetLocalID(), NULL);
+
 	return DRV_FUNCTION_OK;
 }
 
@@ -426,7 +421,7 @@ int _stdcall DRV_NewWorksheet()
 DWORD _stdcall DRV_ReadCounterInput(UINT ch)
 {
 	// TODO: Finish this counter stub
-	deviceLayer->SetError(DRV_ERR_NOHWSUPPORT);
+	deviceRegistry->GetPrimary()->SetError(DRV_ERR_NOHWSUPPORT);
 	UNUSED (ch);
 	return DRV_FUNCTION_FALSE;
 }
@@ -447,12 +442,22 @@ DWORD _stdcall DRV_ReadDigitalInput(UINT ch)
 
 /**
  * Name: DRV_SaveWorksheet(const char *name)
- * Desc: Required DASYLab entry point called when worksheets are saved
- * Note: This is a stub but is not currently scheduled for completion
+ * Desc: Called before a worksheet is saved. Stores the identity of the
+ *		 open device in DriverParam, which DASYLab saves with the worksheet.
 **/
 int _stdcall DRV_SaveWorksheet(const char *name)
 {
+	WorksheetConfig config;
+
 	UNUSED(name);
+
+	// Keep what the worksheet had if no device could be opened
+	if (deviceRegistry->GetOpenState() != DeviceRegistry::OPEN_READY)
+		return DRV_FUNCTION_OK;
+
+	config.Capture(deviceRegistry->GetPrimary());
+	config.Write(infoStruct->DriverParam, sizeof(infoStruct->DriverParam));
+
 	return DRV_FUNCTION_OK;
 }
 
@@ -465,7 +470,7 @@ int _stdcall DRV_SetAnalogOutputBufferMode(UINT mode, DWORD numSamples, DWORD st
 	UNUSED(mode); // TODO: Take care of multiple modes (not currently supported by other software)
 	UNUSED(startDelay); // TODO: Add support for a starting delay on measurement
 
-	deviceLayer->AllocateAOBuffer(numSamples);
+	deviceRegistry->GetPrimary()->AllocateAOBuffer(numSamples);
 
 	return DRV_FUNCTION_OK;
 }
@@ -488,7 +493,7 @@ int _stdcall DRV_SetCounterOutputBufferMode(UINT mode, DWORD numSamples, DWORD s
 int _stdcall DRV_SetDigitalOutputBufferMode(UINT mode, DWORD numSamples, DWORD startDelay)
 {
 	UNUSED(mode);
-	deviceLayer->SetDigitalOutputBufferMode(numSamples, startDelay);
+	deviceRegistry->GetPrimary()->SetDigitalOutputBufferMode(numSamples, startDelay);
 	return DRV_FUNCTION_OK;
 }
 
@@ -498,13 +503,13 @@ int _stdcall DRV_SetDigitalOutputBufferMode(UINT mode, DWORD numSamples, DWORD s
 **/
 int _stdcall DRV_SetInputBufferSize(DWORD size)
 {
-	if ( !deviceLayer->IsMeasuring() )
+	if ( !deviceRegistry->IsMeasuring() )
 	{
-		deviceLayer->AllocateInputBuffer(size); //AIBuffer(size);
+		deviceRegistry->GetPrimary()->AllocateInputBuffer(size); //AIBuffer(size);
 		return DRV_FUNCTION_OK;
 	}
 
-	deviceLayer->SetError(DRV_ERR_MEASRUN);
+	deviceRegistry->GetPrimary()->SetError(DRV_ERR_MEASRUN);
 	return DRV_FUNCTION_FALSE;
 }
 
@@ -548,17 +553,17 @@ int _stdcall DRV_ShowError()
 {
 	char err[255];
 
-	if(deviceLayer->GetError() > LabJackLayer::LABJACK_ERROR_PREFIX)
+	if(deviceRegistry->GetPrimary()->GetError() > LabJackLayer::LABJACK_ERROR_PREFIX)
 	{
-		ErrorToString(deviceLayer->GetError()-5000, err);
+		ErrorToString(deviceRegistry->GetPrimary()->GetError()-5000, err);
 		MessageBox (GetActiveWindow (), err, "LabJack Error", MB_OK | MB_ICONSTOP);
 	}
 	else
 	{
-		sprintf(err, "DASYLab error number %i", deviceLayer->GetError());
+		sprintf(err, "DASYLab error number %i", deviceRegistry->GetPrimary()->GetError());
 		MessageBox (GetActiveWindow (), err, "DASYLab Error", MB_OK | MB_ICONSTOP);
 	}
-	deviceLayer->SetError(0);
+	deviceRegistry->GetPrimary()->SetError(0);
 
 	return DRV_FUNCTION_OK;
 }
@@ -571,16 +576,19 @@ int _stdcall DRV_StartMeas()
 {
 	HCURSOR oldCursor;
 
+	if (!WaitForDevice())
+		return DRV_FUNCTION_FALSE;
+
 	// show WAIT-status with cursor
 	oldCursor = SetCursor (LoadCursor (NULL, IDC_WAIT));
 
-	// Tell the LabJackLayer that we are ready
-	deviceLayer->BeginExperiment();
+	// Tell the devices that we are ready
+	deviceRegistry->BeginExperiment();
     
 	// reset cursor
 	SetCursor (oldCursor);
 
-	if(deviceLayer->IsMeasuring())
+	if(deviceRegistry->IsMeasuring())
 		return DRV_FUNCTION_OK;
 	else
 		return DRV_FUNCTION_FALSE;
@@ -592,7 +600,7 @@ int _stdcall DRV_StartMeas()
 **/
 int _stdcall DRV_StopMeas()
 {
-	deviceLayer->StopExperiment();
+	deviceRegistry->StopExperiment();
 	return DRV_FUNCTION_OK;
 }
 
@@ -602,7 +610,7 @@ int _stdcall DRV_StopMeas()
 **/
 int _stdcall DRV_TestStruct()
 {
-	if(deviceLayer->ConfirmDataStructure())
+	if(WaitForDevice() && deviceRegistry->ConfirmDataStructure())
 		return DRV_FUNCTION_OK;
 	else
 		return DRV_FUNCTION_FALSE;
@@ -615,7 +623,7 @@ int _stdcall DRV_TestStruct()
 **/
 int _stdcall DRV_WriteAnalogOutput(UINT chan, DWORD outVal)
 {
-	deviceLayer->WriteDAC(chan, outVal);
+	deviceRegistry->GetPrimary()->WriteDAC(chan, outVal);
 	return DRV_FUNCTION_OK;
 }
 
@@ -636,7 +644,7 @@ int _stdcall DRV_WriteCounterOutput(UINT chan, DWORD outVal)
 **/
 int _stdcall DRV_WriteDigitalOutput(UINT chan, DWORD outVal)
 {
-	deviceLayer->WriteDigitalOutput(chan, outVal);
+	deviceRegistry->GetPrimary()->WriteDigitalOutput(chan, outVal);
 
 	return DRV_FUNCTION_OK;
 }
@@ -650,7 +658,8 @@ int _stdcall DRV_WriteDigitalOutput(UINT chan, DWORD outVal)
 **/
 void StreamCallbackWrapper(long scansAvailable, double userValue)
 {
-	deviceLayer->StreamCallback(scansAvailable, userValue);
+	// The user value is the device's index in the registry
+	deviceRegistry->StreamCallback((int)userValue, scansAvailable, userValue);
 }
 
 /**
@@ -660,7 +669,8 @@ void StreamCallbackWrapper(long scansAvailable, double userValue)
 **/
 void CALLBACK CommandResponseCallbackWrapper(UINT uID, UINT uMsg, DWORD dwUser, DWORD dw1, DWORD dw2)
 {
-	deviceLayer->CommandResponseCallback();
+	// dwUser is the device layer that installed the timer
+	deviceRegistry->CommandResponseCallback((LabJackLayer *)dwUser);
 }
 
 /**
@@ -705,17 +715,18 @@ BOOL CALLBACK DlgCardDef (HWND hWndDlg, UINT message, WPARAM wParam, LPARAM lPar
 
 /**
  * Name: OpenNewDevice(long newDeviceType)
- * Desc: Creates a new device layer for the given device type
- *		 and local id
+ * Desc: Starts opening a new device of the given device type
+ *		 and local id in the background
+ * Retn: TRUE if the open was started and FALSE if another open is pending
 **/
-void OpenNewDevice(long newDeviceType, int id)
+bool OpenNewDevice(long newDeviceType, int id)
 {
 	// TODO: There might be a bug (?) in DASYLab that
 	//		 does not let the following occur
 	//if(deviceLayer != NULL)
-	//	if (deviceLayer->IsOpen())
+	//	if (deviceRegistry->GetPrimary()->IsOpen())
 	//	{
-	//		deviceLayer->CleanUp();
+	//		deviceRegistry->GetPrimary()->CleanUp();
 	//		delete deviceLayer;
 	//	}
 
@@ -724,17 +735,18 @@ void OpenNewDevice(long newDeviceType, int id)
 	//deviceLayer = new LabJackLayer(infoStruct, newDeviceType);
 	
 	// TODO: This is bad bad form
-	deviceLayer->OpenDevice(newDeviceType, id);
+	return deviceRegistry->BeginOpenPrimary(newDeviceType, id, NULL);
 }
 
 /**
  * Name: OpenNewEthernetDevice
  * Desc: Instructs the device layer to open a device of deviceType
- *		 via ethernet at the given address
+ *		 via ethernet at the given address in the background
+ * Retn: TRUE if the open was started and FALSE if another open is pending
 **/
-void OpenNewEthernetDevice(long newDeviceType, CString adr)
+bool OpenNewEthernetDevice(long newDeviceType, CString adr)
 {
-	deviceLayer->OpenEthernetDevice(newDeviceType, adr);
+	return deviceRegistry->BeginOpenPrimaryEthernet(newDeviceType, adr);
 }
 
 /**
@@ -744,7 +756,7 @@ void OpenNewEthernetDevice(long newDeviceType, CString adr)
 **/
 long GetDeviceType()
 {
-	return deviceLayer->GetDeviceType();
+	return deviceRegistry->GetPrimary()->GetDeviceType();
 }
 
 /**
@@ -754,7 +766,7 @@ long GetDeviceType()
 **/
 bool IsUsingEthernet()
 {
-	return deviceLayer->IsUsingEthernet();
+	return deviceRegistry->GetPrimary()->IsUsingEthernet();
 }
 
 /**
@@ -764,7 +776,7 @@ bool IsUsingEthernet()
 **/
 int GetID()
 {
-	return deviceLayer->GetDeviceID();
+	return deviceRegistry->GetPrimary()->GetDeviceID();
 }
 
 /**
@@ -774,16 +786,18 @@ int GetID()
 **/
 char * GetIPAddress()
 {
-	return deviceLayer->GetIPAddress().GetBuffer();
+	return deviceRegistry->GetPrimary()->GetIPAddress().GetBuffer();
 }
 
 /**
- * Name: ToCharArray(int x)
- * Desc: Helper function that converts an integer to a string
+ * Name: ToCharArray(int x, char * buffer)
+ * Desc: Helper function that converts an integer to a string in the
+ *		 caller's buffer, which must hold at least 12 characters. Devices
+ *		 are opened from several threads so nothing is shared.
+ * Retn: buffer
 **/
-char * ToCharArray(int x)
+char * ToCharArray(int x, char * buffer)
 {
-	char buffer[30];
 	sprintf(buffer, "%d", x);
 	return buffer;
 }
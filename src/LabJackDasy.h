@@ -62,13 +62,14 @@ BOOL _stdcall DlgCardDef (HWND hWndDlg, UINT message, WPARAM wParam, LPARAM lPar
 // Helper functions not exported to DASYLab
 void StreamCallbackWrapper(long scansAvailable, double userValue);
 void CALLBACK CommandResponseCallbackWrapper(UINT uID, UINT uMsg, DWORD dwUser, DWORD dw1, DWORD dw2);
-void OpenNewDevice(long newDeviceType, int id);
-void OpenNewEthernetDevice(long newDeviceType, CString value);
+bool OpenNewDevice(long newDeviceType, int id);
+bool OpenNewEthernetDevice(long newDeviceType, CString value);
+bool WaitForDevice();
 long GetDeviceType();
 bool IsUsingEthernet();
 int GetID();
 char * GetIPAddress();
-char * ToCharArray(int x);
+char * ToCharArray(int x, char * buffer);
 CString ToCString(int x); // TODO: this is bad form
 
 #ifdef  __cplusplus
@@ -22,9 +22,6 @@
 #include<mmsystem.h>
 #pragma comment(lib, "winmm.lib")
 
-// Bitset
-#include <bitset>
-
 //	LabJack
 #include "c:\program files\labjack\drivers\LabJackUD.h" // TODO: needs to be flexible
 
@@ -33,9 +30,22 @@
 
 // Application
 #include "LabJackDasy.h"
+#include "Stopwatch.h"
+#include "DriverSettings.h"
 
 using namespace std;
 
+/** AI_Frequency choices offered in DASYLab's frequency list (Hz) **/
+static const double FREQUENCY_CHOICES[8] = {
+	1, 10, 100, 500, 1000, 5000, 10000, 50000
+};
+
+/** Relative difference below which AI_Frequency counts as achieved **/
+static const double FREQUENCY_TOLERANCE = 1e-9;
+
+/** 0 C in kelvin, the unit of the internal temperature sensor **/
+static const double KELVIN_OFFSET = 273.15;
+
 /**
  * Name: LabJackLayer(DRV_infoStruct *StructAddress, long newDeviceType)
  * Desc: Constructor for LabJackLayer that saves the given DASYLab structure to infoStruct
@@ -46,6 +56,8 @@ LabJackLayer::LabJackLayer(DRV_INFOSTRUCT * structAddress)
 	//debugValue = (MAX_BIT_VALUE/2.0);
 
 	// Put in some default values
+	hTimerID = 0;
+	timerResolution = TIMER_RESOLUTION;
 	aiRetrieveIndex = 0;
 	wrapAround = FALSE;
 	aoStoreIndex = 0;
@@ -55,6 +67,35 @@ LabJackLayer::LabJackLayer(DRV_INFOSTRUCT * structAddress)
 	measRun = FALSE;
 	isStreaming = FALSE;
 	open = FALSE;
+	numOwnedChannels = 0;
+	model = NULL;
+	streamRate = NULL;
+	negotiateFrequency = TRUE;
+	filterMs = 0;
+	coldJunctionOffset = 0;
+	windowBlocksRead = 0;
+	burstBufferAdr = NULL;
+	burstBufferSize = 0;
+	alarmScanIndex = 0;
+	alarmScanMs = 0;
+	alarmError = LJE_NOERROR;
+	streamStartMs = 0;
+	streamScansRead = 0;
+	rangesPending = FALSE;
+	streamDataScans = 0;
+	filteredScans = 0;
+	serialNumber = 0;
+	for (int n = 0; n < NUM_OPEN_PHASES; n++)
+		openPhaseTimes[n] = 0;
+	registryIndex = 0;
+	scanSink = NULL;
+	scanFrequency = 0;
+	experimentStreaming = FALSE;
+	startLatency = 0;
+	warmStarts = 0;
+	coldStarts = 0;
+	InitializeCriticalSection(&handleLock);
+	recovery.Attach(this);
 
 	// Save the structure address and device type
 	infoStruct = structAddress;
@@ -62,12 +103,22 @@ LabJackLayer::LabJackLayer(DRV_INFOSTRUCT * structAddress)
 	// Issue 4: Command-response does not work until the experiment is started for a second time.
 	// TODO: This is a somewhat dirty fix that, if possible, should be addressed with timer
 	//		 configuration changes. (0.2)
-    InstallTimerInterruptHandler();
+    InstallTimerInterruptHandler((UINT)(1.0/infoStruct->AI_Frequency*1000));
 	RemoveTimerInterruptHandler();
 
 	SetError(0);
 }
 
+/**
+ * Name: ~LabJackLayer()
+ * Desc: Stops the watchdog before the lock it shares goes away
+**/
+LabJackLayer::~LabJackLayer()
+{
+	recovery.Stop();
+	DeleteCriticalSection(&handleLock);
+}
+
 /**
  * Name: AdvanceAnalogOutputBuf()
  * Desc: Changes aoStoreIndex to the next block for AO output
@@ -100,9 +151,9 @@ void LabJackLayer::AdvanceDigitalOutputBuf()
 void LabJackLayer::AdvanceInputBuf()
 {
 	// mark processed data - one block processed
-	aiRetrieveIndex += infoStruct->ADI_BlockSize;
+	aiRetrieveIndex += plan.GetBlockSize();
 
-	if (aiRetrieveIndex == infoStruct->DriverBufferSize)
+	if (aiRetrieveIndex == plan.GetBufferSize())
 	{
 		aiRetrieveIndex = 0;
 		wrapAround = TRUE;
@@ -113,6 +164,13 @@ void LabJackLayer::AdvanceInputBuf()
 		StopExperiment();
 		maxBlocks = (DWORD) -1L;
 	}
+
+	// The whole capture window was read, let the next one in
+	if (captureWindow.IsActive() && ++windowBlocksRead >= (DWORD)captureWindow.GetWindowBlocks())
+	{
+		windowBlocksRead = 0;
+		captureWindow.Rearm();
+	}
 }
 
 /**
@@ -190,16 +248,23 @@ bool LabJackLayer::GetInputStatus()
 	if (maxBlocks == -1L)
 		return FALSE;
 
+	// An interlock write that failed on the acquiring thread
+	if (alarmError != LJE_NOERROR)
+		ErrorHandler(InterlockedExchange(&alarmError, LJE_NOERROR));
+
+	if (burst.IsActive())
+		DrainBurst();
+
 	delta = inputStoreIndex - aiRetrieveIndex;
 
 	if ( wrapAround )
 	{
-		delta += infoStruct->DriverBufferSize;
+		delta += plan.GetBufferSize();
 	}
 
-	measInfo.ADI_PercentFull = ( 100L * delta ) / infoStruct->DriverBufferSize;
+	measInfo.ADI_PercentFull = ( 100L * delta ) / plan.GetBufferSize();
 
-	analogBufferValid = ( delta >= (long) infoStruct->ADI_BlockSize );
+	analogBufferValid = ( delta >= (long) plan.GetBlockSize() );
 
 	return analogBufferValid;
 }
@@ -213,6 +278,16 @@ DRV_MEASINFO * LabJackLayer::GetMeasInfo()
 	return &measInfo;
 }
 
+/**
+ * Name: ReportDataLost()
+ * Desc: Tells DASYLab that samples of the running experiment were lost
+ *		 or made up
+**/
+void LabJackLayer::ReportDataLost()
+{
+	measInfo.MeasStatus |= DRV_DATA_LOST;
+}
+
 /**
  * Name: IsOpen()
  * Desc: Return TRUE if the device is open and false otherwise
@@ -238,22 +313,31 @@ long LabJackLayer::GetError()
 **/
 void LabJackLayer::FillInfoStructure()
 {
+	double dblValue;
 	int n;
-	calMapType::iterator calIt;
 
-	// Map the calibration constants
-	//MapCalConstants();
+	// Find the model's table, U3s come as LV or HV
+	dblValue = 0;
+	if (deviceType == LJ_dtU3)
+		eGet(lngHandle, LJ_ioGET_CONFIG, LJ_chU3HV, &dblValue, 0);
+	model = DeviceModels::Find(deviceType, dblValue != 0);
+	if (model == NULL)
+		return;
 
 	// Frequency and features
 	infoStruct->Features = SUPPORT_DEFAULT | SUPPORT_OUT_ALL;
-	infoStruct->SupportedAcqModes = DRV_AQM_CONTINUOUS | DRV_AQM_STOP;
-	infoStruct->MaxFreq = 50000.0;
+	if (model->temperatureChannel >= 0)
+		infoStruct->Features |= SUPPORT_THERMOMEAS;
+	infoStruct->SupportedAcqModes = DRV_AQM_CONTINUOUS | DRV_AQM_BLOCK | DRV_AQM_STOP;
+	infoStruct->MaxFreq = DeviceModels::GetMaxSampleRate(model);
 	infoStruct->MinFreq = 0.0001;
-	infoStruct->MaxFreqPerChan = 50000.0;
+	infoStruct->MaxFreqPerChan = DeviceModels::GetMaxSampleRate(model);
 	infoStruct->MinFreqPerChan = 0.00001;
+	infoStruct->MinSlowDownCount = 1;
+	FillFrequencyList(1);
 
 	// Device general channel specific settings
-	infoStruct->Max_AO_Channel = 2; // DAC0 and DAC1
+	infoStruct->Max_AO_Channel = model->numAOChannels; // DAC0 and DAC1
 	infoStruct->Max_CT_Channel = 0; // TODO: Counters have not yet been implemented
 	infoStruct->DIO_Width = 1; // 1 bit per channel
 
@@ -262,8 +346,8 @@ void LabJackLayer::FillInfoStructure()
 
 	for (n = 0; n < infoStruct->Max_AO_Channel; n++)
 	{
-		infoStruct->AO_ChInfo[n].OutputRange_Min = 0;
-		infoStruct->AO_ChInfo[n].OutputRange_Max = 5;
+		infoStruct->AO_ChInfo[n].OutputRange_Min = model->aoMinVolts;
+		infoStruct->AO_ChInfo[n].OutputRange_Max = model->aoMaxVolts;
 		infoStruct->AO_ChInfo[n].Resolution = CHANNEL_RESOLUTION;		/* == 12 Bit */
 	}
 
@@ -277,134 +361,120 @@ void LabJackLayer::FillInfoStructure()
 	//infoStruct->HelpFileName; // I don't think Vista/7 even supports this!
 	//infoStruct->HelpIndex = 0;
 
-	// Fill device model specific information
-	switch(deviceType)
-	{
-		case LJ_dtU3:
-			FillU3Info();
-			break;
-		case LJ_dtUE9:
-			FillUE9Info();
-			break;
-		case LJ_dtU6:
-			FillU6Info();
-			break;
-	}
+	// Channels of the model, users will need to manage which line is out/in
+	infoStruct->Max_AI_Channel = model->numAIChannels;
+	infoStruct->Max_DI_Channel = model->numDIOLines;
+	infoStruct->Max_DO_Channel = model->numDIOLines;
 
-	// Put gains into the information structure
-	// TODO: Might be a nicer way to do this?
-	n = 0;
-	for ( calIt=dasyLJGainCodes.begin() ; calIt != dasyLJGainCodes.end(); calIt++ )
+	for (n = 0; n < infoStruct->Max_AI_Channel; n++)
 	{
-		infoStruct->GainInfo[n] = (INT16)calIt->first;
-		n++;
-	}
-}
-
-/**
- * Name: FillU3Info()
- * Desc: (private) Fills the DASYLab info structure wtih U3 specific information
-**/
-void LabJackLayer::FillU3Info()
-{
-	double dblValue;
-	int n=0;
-
-	// TODO: These ought to be constants
-	infoStruct->Max_AI_Channel = 19; // LabJackLayer will map 16,17,18 to 30,31,32 respectively
-	infoStruct->Max_DI_Channel = 20; // User will need to manage which line is out/in
-	infoStruct->Max_DO_Channel = 20;
-
-	// Determine if a HV or LV is present
-	dblValue = 0;
-	eGet(lngHandle, LJ_ioGET_CONFIG, LJ_chU3HV, &dblValue, 0);
-	if(dblValue) // If HV
-		for (n = 0; n < HV_CHANNELS; n++) 
+		if (n < model->numWideInputs)
 		{
-			infoStruct->AI_ChInfo[n].InputRange_Max = 10;
-			infoStruct->AI_ChInfo[n].InputRange_Min = -10;
-			infoStruct->AI_ChInfo[n].Resolution = CHANNEL_RESOLUTION;	  /* == 16 Bit */
-			infoStruct->AI_ChInfo[n].BaseUnit = DRV_BASE_UNIT_2COMP;
+			infoStruct->AI_ChInfo[n].InputRange_Min = model->wideMinVolts;
+			infoStruct->AI_ChInfo[n].InputRange_Max = model->wideMaxVolts;
+		}
+		else
+		{
+			infoStruct->AI_ChInfo[n].InputRange_Min = model->aiMinVolts;
+			infoStruct->AI_ChInfo[n].InputRange_Max = model->aiMaxVolts;
 		}
-	for (; n < infoStruct->Max_AI_Channel; n++)
-	{
-		infoStruct->AI_ChInfo[n].InputRange_Max = 2.5;
-		infoStruct->AI_ChInfo[n].InputRange_Min = -2.5;
 		infoStruct->AI_ChInfo[n].Resolution = CHANNEL_RESOLUTION;	  /* == 16 Bit */
 		infoStruct->AI_ChInfo[n].BaseUnit = DRV_BASE_UNIT_2COMP;
 	}
 
-	// TODO: Fill gains
+	// Until told otherwise this device owns every channel it reports
+	numOwnedChannels = infoStruct->Max_AI_Channel;
+
+	// Put gains into the information structure
+	for (n = 0; n < model->numGains; n++)
+		infoStruct->GainInfo[n] = model->gains[n].dasyGain;
+
+	ApplyCalibratedLimits();
+	ApplyThermocoupleLimits();
 }
 
 /**
- * Name: FillU6Info()
- * Desc: (private) Fills the DASYLab info structure wtih U6 specific information
+ * Name: ApplyCalibratedLimits()
+ * Desc: (private) Replaces the nominal input limits of the unity gain range
+ *		 with the calibrated ones of this particular device. DASYLab scales
+ *		 the other gains from these limits.
 **/
-void LabJackLayer::FillU6Info()
+void LabJackLayer::ApplyCalibratedLimits()
 {
-	//double dblValue;
+	double minVolts, maxVolts;
 	int n;
 
-	// TODO: These ought to be constants
-	infoStruct->Max_AI_Channel = 16;
-	infoStruct->Max_DI_Channel = 23; // User will need to manage which line is out/in
-	infoStruct->Max_DO_Channel = 23;
+	if (!calibration.IsCalibrated() || model->numGains == 0)
+		return;
+
+	if (!calibration.GetRange(model->gains[0].udRange, &minVolts, &maxVolts))
+		return;
 
-	for (n=0; n < infoStruct->Max_AI_Channel; n++) 
+	for (n = model->numWideInputs; n < infoStruct->Max_AI_Channel; n++)
 	{
-		infoStruct->AI_ChInfo[n].InputRange_Max = 10;//CalMaxAIValue(n);
-		infoStruct->AI_ChInfo[n].InputRange_Min = -10;//CalMinAIValue(n);
-		infoStruct->AI_ChInfo[n].Resolution = CHANNEL_RESOLUTION;	  /* == 16 Bit */
-		infoStruct->AI_ChInfo[n].BaseUnit = DRV_BASE_UNIT_2COMP;
+		infoStruct->AI_ChInfo[n].InputRange_Min = minVolts;
+		infoStruct->AI_ChInfo[n].InputRange_Max = maxVolts;
 	}
-
-	// Insert gains
-	dasyLJGainCodes.clear();
-	dasyLJGainCodes.insert(pair<long, long>(1, LJ_rgBIP10V));
-	dasyLJGainCodes.insert(pair<long, long>(10, LJ_rgBIP1V));
-	dasyLJGainCodes.insert(pair<long, long>(100, LJ_rgBIPP1V));
-	dasyLJGainCodes.insert(pair<long, long>(1000,LJ_rgBIPP01V));
 }
 
 /**
- * Name: FillUE9Info()
- * Desc: (private) Fills the DASYLab info structure wtih U6 specific information
+ * Name: ApplyThermocoupleLimits()
+ * Desc: (private) Reports the range of a thermocouple channel's type in
+ *		 degrees Celsius as its input limits, so DASYLab shows the
+ *		 temperature the driver writes. Types are read when the device is
+ *		 opened; changing them takes effect the next time it is.
 **/
-void LabJackLayer::FillUE9Info()
+void LabJackLayer::ApplyThermocoupleLimits()
 {
-	int n;
+	InputOptions options;
+	const ThermocoupleType * tc;
+	int n, type;
 
-	// TODO: These ought to be constants
-	infoStruct->Max_AI_Channel = 22; // LabJackLayer will map 16, 17, 18, 19, 20, 21 to
-									 // 128, 132, 133, 136, 140, 141 respectively
-	infoStruct->Max_DI_Channel = 23; // User will need to manage which line is out/in
-	infoStruct->Max_DO_Channel = 23;
-
-	// Put in the analog input ranges
-	for (n=0; n < infoStruct->Max_AI_Channel; n++) 
+	ReadThermocouples(options.thermocouples);
+	for (n = 0; n < infoStruct->Max_AI_Channel; n++)
 	{
-		infoStruct->AI_ChInfo[n].InputRange_Max = 5;
-		infoStruct->AI_ChInfo[n].InputRange_Min = -5;
-		infoStruct->AI_ChInfo[n].Resolution = CHANNEL_RESOLUTION;	  /* == 16 Bit */
-		infoStruct->AI_ChInfo[n].BaseUnit = DRV_BASE_UNIT_2COMP;
-	}
+		type = Thermocouples::Find(options.thermocouples[n]);
+		if (type < 0)
+			continue;
 
-	// Fill gain codes
-	// TODO: 0-5V range
-	dasyLJGainCodes.clear();
-	dasyLJGainCodes.insert(pair<long, long>(1, LJ_rgBIP5V));
-	dasyLJGainCodes.insert(pair<long, long>(2, LJ_rgUNI2P5V));
-	dasyLJGainCodes.insert(pair<long, long>(4, LJ_rgUNI1P25V));
-	dasyLJGainCodes.insert(pair<long, long>(8, LJ_rgUNIP625V));
+		tc = Thermocouples::Get(type);
+		infoStruct->AI_ChInfo[n].InputRange_Min = tc->minCelsius;
+		infoStruct->AI_ChInfo[n].InputRange_Max = tc->maxCelsius;
+	}
 }
 
 /**
  * Name: CleanUp()
- * Desc: Frees up the device and buffers used for DASYLab
+ * Desc: Frees up the device and buffers used for DASYLab. The UD driver's
+ *		 Close() closes every open device, not just this one.
 **/
 void LabJackLayer::CleanUp()
 {
+	Release();
+
+	// Close through UD driver
+	EnterCriticalSection(&handleLock);
+	Close();
+	LeaveCriticalSection(&handleLock);
+}
+
+/**
+ * Name: Release()
+ * Desc: Frees the buffers and marks the device closed but leaves the UD
+ *		 driver open, so the other devices keep their handles. Used to
+ *		 drop one of several devices.
+**/
+void LabJackLayer::Release()
+{
+	// An abandoned experiment still streams into the buffers and keeps
+	// them from being freed, so stop it first
+	if (measRun)
+		StopExperiment();
+
+	// No reopen may run while the handle is closed
+	recovery.Stop();
+	EnterCriticalSection(&handleLock);
+
 	// Clean up the buffers
 	//maxRamSize = 0;
 	KillBuffer(inputBufferAdr);
@@ -413,12 +483,13 @@ void LabJackLayer::CleanUp()
 	delete aoBufferAdr;
 	KillBuffer(doBufferAdr);
 	delete doBufferAdr;
+	burst.Disable();
+	KillBuffer(burstBufferAdr);
+	burstBufferSize = 0;
 
 	// Mark the device closed
 	open = FALSE;
-
-	// Close through UD driver
-	Close();
+	LeaveCriticalSection(&handleLock);
 }
 
 /**
@@ -505,6 +576,9 @@ bool LabJackLayer::AllocateInputBuffer(DWORD size)
 	maxRamSize = size * sizeof (SAMPLE);
 
 	infoStruct->DriverBufferSize = size;
+
+	// The plan describes the old buffer
+	plan.Invalidate();
 	
 	return TRUE;
 }
@@ -519,6 +593,16 @@ bool LabJackLayer::IsMeasuring()
 	return measRun;
 }
 
+/**
+ * Name: HasReachedMaxBlocks()
+ * Desc: Returns true once a DRV_AQM_STOP experiment has delivered all
+ *		 of its blocks
+**/
+bool LabJackLayer::HasReachedMaxBlocks()
+{
+	return maxBlocks == -1L;
+}
+
 /**
  * Name: SetDeviceType(int type)
  * Desc: Sets the LabJackLayer to looks for a given device type as
@@ -531,31 +615,49 @@ void LabJackLayer::SetDeviceType(int type)
 
 /**
  * Name: BeginExperiment()
- * Desc: Sets up DASYLab information structure and deteremines scan list
- * Args: callbackFunction: the pointer (cast as a long) of the function to have the UD
- *						   driver call. Should be a wrapper to this object's callback
- *						   function.
- * Retn: True is successful and false otherwise
- **/
+ * Desc: Sets up DASYLab information structure and deteremines scan list,
+ *		 choosing between streaming and command-response by frequency
+**/
 void LabJackLayer::BeginExperiment()
+{
+	BeginExperiment(RequiresStreaming());
+}
+
+/**
+ * Name: BeginExperiment(bool useStreaming)
+ * Desc: Sets up DASYLab information structure and deteremines scan list
+ * Args: useStreaming: TRUE to stream and FALSE to use command-response. The
+ *					   DeviceRegistry passes the same choice to every device
+ *					   so that their scans can be merged.
+**/
+void LabJackLayer::BeginExperiment(bool useStreaming)
 {
 	// Check that the device is capable of the desired frequency
 	if(!IsFrequencyValid())
 	{
-		MessageBox (GetActiveWindow (), "Whoops! Your LabJack is not capable of your desired frequency. Please see section 3.2 of the User's Guide for more information.", "LabJack Error", MB_OK | MB_ICONSTOP);
+		CString message;
+		message.Format("Whoops! The %s can stream at most %.0f samples per second, but %d channels at %.0f Hz need %.0f. Please see section 3.2 of the User's Guide for more information.",
+			model != NULL ? model->name : "LabJack",
+			model != NULL ? DeviceModels::GetMaxSampleRate(model) : (double)MAX_SCANS_PER_SECOND,
+			GetNumStreamChannels(), GetScanFrequency(), GetScanFrequency() * GetNumStreamChannels());
+		MessageBox (GetActiveWindow (), message, "LabJack Error", MB_OK | MB_ICONSTOP);
 		measRun = FALSE;
 		return;
 	}
-	
-	if (infoStruct->AcquisitionMode == DRV_AQM_STOP)
-		maxBlocks = infoStruct->MaxBlocks;
+
+	// Activate the plan; from here on nothing is read from infoStruct
+	maxBlocks = plan.GetMaxBlocks();
+	windowBlocksRead = 0;
+	if (plan.GetWindowBlocks() > 0)
+		captureWindow.Configure((long)plan.GetBlockSize(), (long)plan.GetWindowBlocks(), DriverSettings::GetDouble("BlockMode", "IntervalMs", 0));
 	else
-		maxBlocks = 0;
+		captureWindow.Disable();
 
 	// (re-)set vars for buffer handling
 	wrapAround = FALSE;
 	aiRetrieveIndex = 0;
 	inputStoreIndex = 0;
+	measInfo.MeasStatus &= ~DRV_DATA_LOST;
 
 	aiChannel = 0;
 	aoCount = 0;
@@ -566,30 +668,82 @@ void LabJackLayer::BeginExperiment()
 	startTime = GetCurrentTime();
 
 	// Check to see if any channels are being used
-	if (numAINRequested == 0 && numDIRequested == 0)
+	if (plan.GetNumAnalogInputs() == 0 && plan.GetNumDigitalInputs() == 0)
 		return;
 
 	// Configure the range
+	Stopwatch startTimer;
+	experimentStreaming = useStreaming;
+	SetupAutoRange();
+	slowInputs.Reset(plan.GetNumSlowInputs(), plan.GetSlowDownCount());
+	coldJunctionOffset = DriverSettings::GetDouble("Thermocouple", "ColdJunctionOffset", 0);
+	deviceScan.resize(plan.GetScanWidth());
+	SetupResampler();
+	SetupDecimator();
+
+	// Stream at the finest resolution the rate allows
+	if (useStreaming && model != NULL)
+		streamRate = DeviceModels::PlanStream(model, GetDeviceScanFrequency() * GetNumStreamChannels());
+	else
+		streamRate = NULL;
+
 	ConfigureRange();
+	channels.Build(&plan);
 
-	// Determine overall frequency
-	double overallFrequency;
-	overallFrequency = infoStruct->AI_Frequency;
-	if (numDIRequested > 0)
+	// Stream data is read into the heap, a few callbacks' worth at a time
+	if (useStreaming)
 	{
-		if (numAINRequested > 0)
-			overallFrequency += infoStruct->AI_Frequency / numAINRequested * (numDIRequested - 1);
-		else
-			overallFrequency += infoStruct->AI_Frequency * (numDIRequested - 1);
+		streamDataScans = GetStreamCallbackScans() * STREAM_READ_CALLBACKS;
+		streamData.resize(streamDataScans * GetNumStreamChannels());
 	}
+	SetupTrigger();
+	SetupBurst();
+	SetupControl();
+	SetupAlarms();
 
-	// TODO: A more empirical approach to determining which mode would
-	//       be more efficient
 	// Start streaming / command response loop
-	if (overallFrequency < START_STREAM_FREQUENCY)
+	if (useStreaming)
+		StartStreaming();
+	else
 		StartCommandResponse();
+
+	// Show how long starting took and the stream resolution in DASYLab's
+	// status bar
+	startLatency = startTimer.GetElapsedMs();
+	if (streamRate != NULL)
+		_snprintf(measInfo.Message, sizeof(measInfo.Message) - 1, "%.0fms R%ld", startLatency, streamRate->resolution);
 	else
-		StartStreaming();
+		_snprintf(measInfo.Message, sizeof(measInfo.Message) - 1, "Start %.0fms", startLatency);
+	measInfo.Message[sizeof(measInfo.Message) - 1] = '\0';
+
+	// Watch for a stalled or failed device from now on, expecting data
+	// every stream callback or timer tick
+	if (measRun)
+	{
+		if (useStreaming)
+			recovery.Start((DWORD)(plan.GetBlockSize() / plan.GetNumScanChannels() * 1000.0 / GetScanFrequency()));
+		else
+			recovery.Start(GetTickPeriod());
+	}
+}
+
+/**
+ * Name: RequiresStreaming()
+ * Desc: Returns true if the overall frequency of the experiment is high
+ *		 enough that streaming should be used instead of command-response
+**/
+bool LabJackLayer::RequiresStreaming()
+{
+	CompilePlan();
+
+	// Control loops run in the command-response tick, so a valid loop
+	// keeps the experiment off the stream
+	if (HasControlLoops())
+		return FALSE;
+
+	// TODO: A more empirical approach to determining which mode would
+	//       be more efficient
+	return plan.GetOverallFrequency() >= START_STREAM_FREQUENCY;
 }
 
 /**
@@ -601,6 +755,11 @@ void LabJackLayer::StopExperiment()
 {
 	long lngErrorcode;
 
+	// Stop watching first so errors while stopping are shown as before.
+	// This waits for a reopen in progress, so the watchdog does not touch
+	// the handle again during this experiment.
+	recovery.Stop();
+
 	if(isStreaming)
 	{
 		//Stop the stream
@@ -611,10 +770,166 @@ void LabJackLayer::StopExperiment()
 	else
 		RemoveTimerInterruptHandler();
 
+	// An interlock write that failed since GetInputStatus last looked
+	if (alarmError != LJE_NOERROR)
+		ErrorHandler(InterlockedExchange(&alarmError, LJE_NOERROR));
+
 	if (measRun)
 		measRun = FALSE;
 
+	if (autoRanger.IsActive())
+	{
+		char key[32];
+		sprintf(key, "RangeSwitches%ld", serialNumber);
+		DriverSettings::PutInt("Diagnostics", key, (int)autoRanger.GetSwitches());
+		RestoreAutoRangeLimits();
+	}
+
+	// Start latency of the last experiment and how often the stream setup
+	// could be reused
+	if (startLatency > 0)
+	{
+		char key[32];
+		char value[48];
+		sprintf(key, "StartLatency%ld", serialNumber);
+		sprintf(value, "%.1f,%lu,%lu", startLatency, warmStarts, coldStarts);
+		DriverSettings::PutString("Diagnostics", key, value);
+	}
+
+	// Resolution of the last stream, its effective bits and typical noise
+	// (microvolts at unity gain)
+	if (streamRate != NULL)
+	{
+		char key[32];
+		char value[48];
+		sprintf(key, "StreamResolution%ld", serialNumber);
+		sprintf(value, "%ld,%.1f,%.1f", streamRate->resolution, streamRate->effectiveBits,
+			DeviceModels::GetNoiseVolts(model, streamRate) * 1e6);
+		DriverSettings::PutString("Diagnostics", key, value);
+	}
+
+	// Resampler taps, latency (ms) and passband error (%) of the last
+	// experiment
+	if (resampler.IsActive())
+	{
+		char key[32];
+		char value[64];
+		sprintf(key, "Resampler%ld", serialNumber);
+		sprintf(value, "%d,%.2f,%.3f", resampler.GetTaps(), resampler.GetLatencyMs(),
+			resampler.GetPassbandError() * 100);
+		DriverSettings::PutString("Diagnostics", key, value);
+	}
+
+	// Oversampling factor, filter taps, delay (ms) and the effective bits
+	// it adds
+	if (decimator.IsActive())
+	{
+		char key[32];
+		char value[64];
+		sprintf(key, "Oversampling%ld", serialNumber);
+		sprintf(value, "%d,%d,%.2f,%.1f", decimator.GetFactor(), decimator.GetTaps(),
+			decimator.GetDelay() * 1000 / GetDeviceScanFrequency(), 0.5 * log((double)decimator.GetFactor()) / log(2.0));
+		DriverSettings::PutString("Diagnostics", key, value);
+	}
+
+	// Last cold junction temperature (1/10 C)
+	if (plan.GetColdJunction() >= 0)
+	{
+		char key[32];
+		sprintf(key, "ColdJunction%ld", serialNumber);
+		DriverSettings::PutInt("Diagnostics", key, (int)measInfo.CJValue);
+	}
+
+	// Control iterations, their mean and worst latency and the worst
+	// jitter of the tick (ms)
+	if (!loops.empty())
+	{
+		char key[32];
+		char value[64];
+		sprintf(key, "Control%ld", serialNumber);
+		sprintf(value, "%lu,%.3f,%.3f,%.3f", controlTiming.GetIterations(), controlTiming.GetMeanLatencyMs(),
+			controlTiming.GetMaxLatencyMs(), controlTiming.GetMaxJitterMs());
+		DriverSettings::PutString("Diagnostics", key, value);
+		loops.clear();
+	}
+
+	// Alarms, the worst time from a scan being acquired to its alarm being
+	// detected and from there to the outputs being written (ms), the bound
+	// on the first (ms) and how many alarms exceeded it, then the first
+	// ones logged with their scan index
+	if (alarms.IsActive())
+	{
+		const AlarmEvent * event;
+		char section[32];
+		char key[32];
+		char value[64];
+		int n;
+
+		sprintf(key, "Alarms%ld", serialNumber);
+		sprintf(value, "%lu,%.3f,%.3f,%.3f,%lu", alarms.GetTotalEvents(), alarms.GetWorstDetectMs(),
+			alarms.GetWorstWriteMs(), alarms.GetDetectBoundMs(), alarms.GetLateEvents());
+		DriverSettings::PutString("Diagnostics", key, value);
+
+		sprintf(section, "AlarmLog%ld", serialNumber);
+		DriverSettings::PutInt(section, "Events", alarms.GetNumEvents());
+		for (n = 0; n < alarms.GetNumEvents(); n++)
+		{
+			event = alarms.GetEvent(n);
+			sprintf(key, "Event%d", n);
+			sprintf(value, "%d,%lu,%.6f,%.3f,%.3f", event->rule, event->scanIndex, event->value, event->detectMs, event->writeMs);
+			DriverSettings::PutString(section, key, value);
+		}
+		alarms.Disable();
+	}
+
+	// Trigger events and the share of the scans they forwarded (%)
+	if (trigger.IsActive())
+	{
+		char key[32];
+		char value[64];
+		sprintf(key, "Trigger%ld", serialNumber);
+		sprintf(value, "%lu,%.3f", trigger.GetEvents(),
+			trigger.GetScansSeen() > 0 ? 100.0 * trigger.GetScansForwarded() / trigger.GetScansSeen() : 0.0);
+		DriverSettings::PutString("Diagnostics", key, value);
+		trigger.Disable();
+	}
+
+	// Samples of a burst and the time to capture and to deliver them (ms)
+	if (burst.IsActive())
+	{
+		char key[32];
+		char value[64];
+		sprintf(key, "Burst%ld", serialNumber);
+		sprintf(value, "%lu,%.1f,%.1f", burst.GetCapacity(), burst.GetCapturedMs(), burst.GetDeliveredMs());
+		DriverSettings::PutString("Diagnostics", key, value);
+		burst.Disable();
+	}
+
+	// Capture windows of a block mode experiment, scans dropped between
+	// them and the mean time a window took to open once allowed (us)
+	if (captureWindow.IsActive())
+	{
+		char key[32];
+		char value[64];
+		sprintf(key, "CaptureWindows%ld", serialNumber);
+		sprintf(value, "%lu,%lu,%.1f", captureWindow.GetWindows(), captureWindow.GetSkippedScans(),
+			captureWindow.GetMeanRearmMs() * 1000);
+		DriverSettings::PutString("Diagnostics", key, value);
+		captureWindow.Disable();
+	}
+
+	// Stream callback time per delivered scan (us) while filtering
+	if (filteredScans > 0)
+	{
+		char key[32];
+		char value[32];
+		sprintf(key, "FilterCpu%ld", serialNumber);
+		sprintf(value, "%.3f", filterMs * 1000 / filteredScans);
+		DriverSettings::PutString("Diagnostics", key, value);
+	}
+
 	maxBlocks = 0;
+	windowBlocksRead = 0;
 }
 
 /**
@@ -627,7 +942,6 @@ bool LabJackLayer::ConfirmDataStructure()
 {
 	DWORD minBuffer;
 	DWORD blockSize;
-	int c, i;						  /* for-loop variables */
 
 	/* initialization complete */
 	if (!open)
@@ -654,7 +968,7 @@ bool LabJackLayer::ConfirmDataStructure()
 		return FALSE;
 	}
 	/* check if any channel is active */
-	/*if (numAINRequested == 0 && numDIRequested == 0)
+	/*if (plan.GetNumAnalogInputs() == 0 && plan.GetNumDigitalInputs() == 0)
 	{
 		infoStruct->Error = DRV_ERR_NOCHANNEL;
 		return FALSE;
@@ -714,27 +1028,17 @@ bool LabJackLayer::ConfirmDataStructure()
 	//OutputDigital = (BOOL) (infoStruct->DO_Channel != (DWORD) 0);
 	//Counter = (BOOL) (infoStruct->CT_Channel != (DWORD) 0);
 
-	/* check and store which channels to poll in local array (access-time) */
-	// TODO: Need constants!
-	for (c = 0, i = 0; i < 32; i++)
-	{
-		if (IsRequestingAIN(i))
-		{
-			analogInputScanList[c] = i;
-			c++;
-		}
-	}
-	numAINRequested = c;
+	/* work out scan lists, conversion and timing once for the experiment */
+	plan.Invalidate();
+	CompilePlan();
 
-	for (c = 0, i = 0; i < 32; i++)
+	/* run at a rate the device clock produces exactly */
+	if (negotiateFrequency)
 	{
-		if (IsRequestingDI(i))
-		{
-			digitalInputScanList[c] = i;
-			c++;
-		}
+		FillFrequencyList(plan.GetNumScanChannels());
+		if (!NegotiateFrequency(plan.GetNumScanChannels()))
+			return FALSE;
 	}
-	numDIRequested = c;
 
 	/* calculate sizes in sample */
 	//blockSizeInSamples = infoStruct->ADI_BlockSize;
@@ -748,54 +1052,85 @@ bool LabJackLayer::ConfirmDataStructure()
 /**
  * Name: StreamCallback(long scansAvailable, double userValue)
  * Desc: Stream callback function that places values read by LabJack 
- *		 into DASYLab buffer
+ *		 into DASYLab buffer, through streamData which BeginExperiment
+ *		 sized from the plan
 **/
 void LabJackLayer::StreamCallback(long scansAvailable, double userValue)
 {
 	
-	long lngErrorcode;
-	int i,n;
-	double dblScansAvailable = (double)scansAvailable;
-	double adblData[40000]; // TODO: Dynamic allocation
-	long padblData = (long)adblData;
+	long lngErrorcode, scansLeft;
+	int n;
+	double dblScansRead;
+	double scanMs;
+	const double * scan;
+	const double * resampled;
+	Stopwatch callbackTimer;
 
 	UNUSED(userValue);
 
-	int numStreamChannels = numAINRequested;
-	if (numDIRequested > 0)
-		numStreamChannels++;
+	int numStreamChannels = GetNumStreamChannels();
 
-	// If there is no data available, skip
-	if (scansAvailable <= 0)
+	// A negative count reports a stream error, let the watchdog reopen the device
+	if (scansAvailable < 0)
+	{
+		recovery.RequestRecovery(-scansAvailable);
 		return;
+	}
 
-	lngErrorcode = eGet(lngHandle, LJ_ioGET_STREAM_DATA, LJ_chALL_CHANNELS, &dblScansAvailable, padblData);
-	ErrorHandler(lngErrorcode);
-	
-	for(n=1; n<=scansAvailable; n++)
+	// If there is no data available or the device is being reopened, skip
+	if (scansAvailable == 0 || recovery.IsRecovering())
+		return;
+
+	// Every device scan is timed from the start of the stream by its
+	// index, on the device's clock
+	scanMs = 1000.0 / GetDeviceScanFrequency();
+
+	// A backlog larger than streamData is read in several pieces
+	for (scansLeft = scansAvailable; scansLeft > 0; scansLeft -= (long)dblScansRead)
 	{
-		// Convert analog input values and place into buffer
-		for(i=0; i<numAINRequested; i++)
-		{
-			AddToInputBuffer(ConvertAIValue(adblData[i*n], i));
-		}
+		dblScansRead = scansLeft < streamDataScans ? scansLeft : streamDataScans;
+		lngErrorcode = eGet(lngHandle, LJ_ioGET_STREAM_DATA, LJ_chALL_CHANNELS, &dblScansRead, (long)&streamData[0]);
+		ErrorHandler(lngErrorcode);
+		if (lngErrorcode != LJE_NOERROR || dblScansRead <= 0)
+			break;
+		recovery.NoteData();
 
-		// Determine states of digital input on channel 193
-		double diData = adblData[i*n+1];
-		for(i=0; i<numDIRequested; i++)
+		// Scans are interleaved: every scan holds each stream channel in scan list order
+		for(n=0; n<(int)dblScansRead; n++)
 		{
-			// Feed channel value in FIFO buffer
-			inputBufferAdr[inputStoreIndex] = CheckBitHigh(diData, digitalInputScanList[i]);
+			scan = &streamData[n*numStreamChannels];
+			alarmScanMs = streamStartMs + streamScansRead * scanMs;
+			streamScansRead++;
 
-			// increment FIFO index and wrap around
-			inputStoreIndex++;
-			if (inputStoreIndex == infoStruct->DriverBufferSize)
+			// Oversampled scans become one scan at the requested rate
+			if (decimator.IsActive())
 			{
-				inputStoreIndex = 0;
-				wrapAround = TRUE;
+				scan = decimator.Process(scan);
+				if (scan == NULL)
+					continue;
 			}
+
+			// Convert the analog inputs and the digital lines of channel 193
+			// and place into buffer
+			if (resampler.IsActive())
+			{
+				resampler.Push(scan);
+				while ((resampled = resampler.Pop()) != NULL)
+				{
+					DeliverScan(resampled);
+					filteredScans++;
+				}
+				continue;
+			}
+
+			DeliverScan(scan);
+			if (decimator.IsActive())
+				filteredScans++;
 		}
 	}
+
+	if (decimator.IsActive() || resampler.IsActive())
+		filterMs += callbackTimer.GetElapsedMs();
 }
 
 /**
@@ -807,56 +1142,107 @@ void LabJackLayer::ErrorHandler (LJ_ERROR lngErrorcode)
 	if (lngErrorcode != LJE_NOERROR)
 	{
  		SetError(lngErrorcode);
-		DRV_ShowError();
+
+		// A modal box would stall the experiment; recover in the background instead
+		if (recovery.IsWatching())
+			recovery.RequestRecovery(lngErrorcode);
+		else
+			DRV_ShowError();
 	}
 }
 
 /**
- * Name: IsRequestingAIN(int channel)
- * Desc: Returns True if the user is polling/streaming the given AIN
-		 channel or False otherwise.
+ * Name: CompilePlan()
+ * Desc: (private) Compiles the experiment plan from the information
+ *		 structure unless it is already up to date
 **/
-bool LabJackLayer::IsRequestingAIN(int channel)
+void LabJackLayer::CompilePlan()
 {
-	return (infoStruct->AI_Channel[0] & (1 << channel)) > 0;
+	InputOptions options;
+	int n;
+
+	if (plan.IsCompiled() || model == NULL)
+		return;
+
+	ReadSlowChannels(options.slowChannels);
+
+	// Read the cold junction when DASYLab asks for it or a thermocouple
+	// needs it
+	ReadThermocouples(options.thermocouples);
+	options.coldJunction = (infoStruct->HWSetup & SETUP_THERMOMEAS) != 0;
+	for (n = 0; n < numOwnedChannels && !options.coldJunction; n++)
+		options.coldJunction = Thermocouples::Find(options.thermocouples[n]) >= 0;
+
+	plan.Compile(infoStruct, model, numOwnedChannels, &options);
+	ReadControlLoops();
 }
 
 /**
- * Name: IsRequestingDI(int channel)
- * Desc: Returns True if the user is polling/streaming the given digital
- *		 channel as input or False otherwise.
+ * Name: ReadSlowChannels(WORD * slowChannels)
+ * Desc: (private) Fills a bitmap like AI_Channel with the analog inputs to
+ *		 deliver at the slowdown rate when [Hybrid] Enabled is set: the
+ *		 internal temperature sensor unless TemperatureSlow is 0, and the
+ *		 comma separated DASYLab channels of SlowChannels
 **/
-bool LabJackLayer::IsRequestingDI(int channel)
+void LabJackLayer::ReadSlowChannels(WORD * slowChannels)
 {
-	return (infoStruct->DI_Channel & (1 << channel)) > 0;
+	CString list;
+	const char * next;
+	char * end;
+	long channel;
+
+	memset(slowChannels, 0, sizeof(WORD) * ExperimentPlan::NUM_AI_WORDS);
+	if (!DriverSettings::GetInt("Hybrid", "Enabled", 0))
+		return;
+
+	if (DriverSettings::GetInt("Hybrid", "TemperatureSlow", 1) && model->temperatureChannel >= 0)
+		slowChannels[model->temperatureChannel / 16] |= (WORD)(1 << (model->temperatureChannel % 16));
+
+	list = DriverSettings::GetString("Hybrid", "SlowChannels", "");
+	next = list;
+	while (*next != '\0')
+	{
+		channel = strtol(next, &end, 10);
+		if (end == next)
+		{
+			next++;
+			continue;
+		}
+		if (channel >= 0 && channel < ExperimentPlan::NUM_AI_WORDS * 16)
+			slowChannels[channel / 16] |= (WORD)(1 << (channel % 16));
+		next = end;
+	}
 }
 
 /**
- * Name: ConvertAIValue
- * Desc: Converts a normal double into a value
- *		 suitable for DASYLab AIN use.
+ * Name: ReadThermocouples(char * types)
+ * Desc: (private) Fills the type letter of every DASYLab channel from the
+ *		 comma separated channel:type pairs of [Thermocouple] Channels, for
+ *		 example "0:K,1:K,4:J". Channels not listed read volts (0).
 **/
-SAMPLE LabJackLayer::ConvertAIValue(double value, UINT channel)
+void LabJackLayer::ReadThermocouples(char * types)
 {
-	//SAMPLE returnArray[2];
-	double maxValue;
-
-	// Apply range
-	if(infoStruct->AI_ChSetup[channel].GainCode != 0)
-		value = value * infoStruct->GainInfo[infoStruct->AI_ChSetup[channel].GainCode];
-
-	// Calculate range
-	double inputRange = infoStruct->AI_ChInfo[channel].InputRange_Max - infoStruct->AI_ChInfo[channel].InputRange_Min;
-	double bitsAvailable = sizeof(SAMPLE) * 8;
+	CString list;
+	const char * next;
+	char * end;
+	long channel;
 
-	// Find the maximum value
-	if (infoStruct->AI_ChInfo[channel].InputRange_Min < 0)
-		maxValue = pow(2.0, bitsAvailable-1);
-	else
-		maxValue = pow(2.0, bitsAvailable);
+	memset(types, 0, ExperimentPlan::NUM_AI_WORDS * 16);
 
-	// Return the converted value
-	return (SAMPLE)(maxValue / inputRange * value);
+	list = DriverSettings::GetString("Thermocouple", "Channels", "");
+	next = list;
+	while (*next != '\0')
+	{
+		channel = strtol(next, &end, 10);
+		if (end == next || *end != ':')
+		{
+			next = end == next ? next + 1 : end;
+			continue;
+		}
+		if (channel >= 0 && channel < ExperimentPlan::NUM_AI_WORDS * 16 && end[1] != '\0')
+			types[channel] = end[1];
+		next = end + 1;
+	}
 }
 
 /**
@@ -936,15 +1322,6 @@ void LabJackLayer::SetError(DWORD newError)
 		infoStruct->Error = 0;
 }
 
-/**
- * Name: CheckBitHigh(float value, int position)
- * Desc: Returns true if bit at position is 1 or false otherwise
-**/
-bool LabJackLayer::CheckBitHigh(double value, int position)
-{
-	return std::bitset<sizeof(double)>(value).test(position);
-}
-
 /**
  * Name: IsFrequencyValid()
  * Desc: Returns true if the device is capable of streaming at the
@@ -952,110 +1329,227 @@ bool LabJackLayer::CheckBitHigh(double value, int position)
 **/
 bool LabJackLayer::IsFrequencyValid()
 {
-	return infoStruct->AI_Frequency <= MAX_SCANS_PER_SECOND;
+	double sampleRate;
+
+	CompilePlan();
+	sampleRate = GetScanFrequency() * GetNumStreamChannels();
+
+	if (model == NULL)
+		return sampleRate <= MAX_SCANS_PER_SECOND;
+
+	return DeviceModels::PlanStream(model, sampleRate) != NULL;
 }
 
 /**
- * Name: StartStreaming()
- * Desc: Configures and starts analog/digital input streaming
+ * Name: NegotiateFrequency(int numScanChannels)
+ * Desc: Moves AI_Frequency to the nearest rate the device clock produces
+ *		 exactly when the given number of channels share each scan, so
+ *		 DASYLab's time axis matches the real sample times. Only streaming
+ *		 experiments are paced by the device clock, and a resampled one
+ *		 keeps the rate asked for.
+ * Retn: TRUE if AI_Frequency was already achievable, FALSE if it was
+ *		 changed (Error is DRV_WARN_CHANGEFREQ)
 **/
-void LabJackLayer::StartStreaming()
+bool LabJackLayer::NegotiateFrequency(int numScanChannels)
 {
-	long lngErrorcode, lngIOType, lngChannel;
-	double dblValue;
-	int i;
-
-    // Configure all analog inputs for 12-bit resolution
-    lngErrorcode = AddRequest(lngHandle, LJ_ioPUT_CONFIG, LJ_chAIN_RESOLUTION, 12, 0, 0);
-    ErrorHandler(lngErrorcode);
+	double achievable;
 
-	int numStreamChannels = numAINRequested;
-	if (numDIRequested > 0)
-		numStreamChannels++;
+	if (model == NULL || numScanChannels <= 0 || !RequiresStreaming() || IsResampling())
+		return TRUE;
 
-    // Set the scan rate.
-    lngErrorcode = AddRequest(lngHandle, LJ_ioPUT_CONFIG, LJ_chSTREAM_SCAN_FREQUENCY, infoStruct->AI_Frequency/numStreamChannels, 0, 0);
-    ErrorHandler(lngErrorcode);
+	achievable = DeviceModels::QuantizeScanRate(model, infoStruct->AI_Frequency / numScanChannels) * numScanChannels;
+	if (fabs(achievable - infoStruct->AI_Frequency) <= infoStruct->AI_Frequency * FREQUENCY_TOLERANCE)
+		return TRUE;
 
-    // Give the driver a 5 second buffer (scanRate * channels * 5 seconds).
-    lngErrorcode = AddRequest(lngHandle, LJ_ioPUT_CONFIG, LJ_chSTREAM_BUFFER_SIZE, numStreamChannels*infoStruct->AI_Frequency*5, 0, 0);
-    ErrorHandler(lngErrorcode);
-
-    // Configure reads to retrieve whatever data is available without waiting
-    lngErrorcode = AddRequest(lngHandle, LJ_ioPUT_CONFIG, LJ_chSTREAM_WAIT_MODE, LJ_swNONE, 0, 0);
-    ErrorHandler(lngErrorcode);
+	infoStruct->AI_Frequency = achievable;
+	infoStruct->Error = DRV_WARN_CHANGEFREQ;
+	plan.Invalidate();
+	return FALSE;
+}
 
-	// Clear stream channels
-	lngErrorcode = AddRequest(lngHandle, LJ_ioCLEAR_STREAM_CHANNELS, 0, 0, 0, 0);
-    ErrorHandler(lngErrorcode);
+/**
+ * Name: FillFrequencyList(int numScanChannels)
+ * Desc: Offers DASYLab the FREQUENCY_CHOICES the device can reach, each
+ *		 moved to the exact rate it streams at with the given number of
+ *		 channels. Command-response rates are paced by the PC and left as
+ *		 they are, as is every rate when resampling.
+**/
+void LabJackLayer::FillFrequencyList(int numScanChannels)
+{
+	bool resampling = IsResampling();
+	double frequency;
+	int n;
 
-    // Define the analog input scan list
-	for(i=0; i<numAINRequested; i++)
+	for (n = 0; n < 8; n++)
 	{
-		lngErrorcode = AddRequest(lngHandle, LJ_ioADD_STREAM_CHANNEL, analogInputScanList[i], 0, 0, 0);
-		ErrorHandler(lngErrorcode);
-	}
+		frequency = FREQUENCY_CHOICES[n];
+		if (frequency > infoStruct->MaxFreq)
+			frequency = infoStruct->MaxFreq;
 
-	// Define the digital input scan list
-	if (numDIRequested > 0)
-	{
-		lngErrorcode = AddRequest(lngHandle, LJ_ioADD_STREAM_CHANNEL, 193, 0, 0, 0); // Channel 193 provides FIO/EIO data (sec. 3.2.1 of user's gude)
-		ErrorHandler(lngErrorcode);
-	}
+		if (model != NULL && numScanChannels > 0 && frequency >= START_STREAM_FREQUENCY && !resampling)
+			frequency = DeviceModels::QuantizeScanRate(model, frequency / numScanChannels) * numScanChannels;
 
-	//Execute the list of requests.
-    lngErrorcode = GoOne(lngHandle);
-    ErrorHandler(lngErrorcode);
-    
-	//Get all the results just to check for errors.
-	lngErrorcode = GetFirstResult(lngHandle, &lngIOType, &lngChannel, &dblValue, 0, 0);
-	ErrorHandler(lngErrorcode);
-	while(lngErrorcode < LJE_MIN_GROUP_ERROR)
-	{
-		lngErrorcode = GetNextResult(lngHandle, &lngIOType, &lngChannel, &dblValue, 0, 0);
-		if(lngErrorcode != LJE_NO_MORE_DATA_AVAILABLE)
-			ErrorHandler(lngErrorcode);
+		infoStruct->AiFreqList[n] = frequency;
 	}
-    
-	// Put in the callback. If the X1 parameter is set to something other than 0
-	// the driver will call the specified function after that number of scans
-	// have been reached.
-	//long pCallback = void (*StreamCallback)(long ScansAvailable, double UserData);
-	//pCallback = &StreamCallback;
-    lngErrorcode = ePut(lngHandle, LJ_ioSET_STREAM_CALLBACK, (long)StreamCallbackWrapper, 0, infoStruct->ADI_BlockSize/numStreamChannels);
-	ErrorHandler(lngErrorcode);
-
-	//Start the stream.
-    lngErrorcode = eGet(lngHandle, LJ_ioSTART_STREAM, 0, &dblValue, 0);
-    ErrorHandler(lngErrorcode);
+}
 
-	isStreaming = TRUE;
+/**
+ * Name: SetFrequencyNegotiation(bool enabled)
+ * Desc: Turns the rounding of AI_Frequency in ConfirmDataStructure on or
+ *		 off. The DeviceRegistry turns it off when several devices share
+ *		 the scan rate and negotiates for all of them instead.
+**/
+void LabJackLayer::SetFrequencyNegotiation(bool enabled)
+{
+	negotiateFrequency = enabled;
+}
 
-	// Indicate that we have started measuring
-	measRun = TRUE;
+/**
+ * Name: GetNumStreamChannels()
+ * Desc: (private) Returns the number of channels in one stream scan: every
+ *		 analog input plus one channel (193) carrying all digital inputs
+**/
+int LabJackLayer::GetNumStreamChannels()
+{
+	return plan.GetNumStreamChannels();
 }
 
 /**
- * Name: StartCommandResponse()
- * Desc: Begin reading analog/digital input through command response
+ * Name: GetScanFrequency()
+ * Desc: (private) Returns the stream scan rate. The DeviceRegistry sets it
+ *		 explicitly when several devices share AI_Frequency, otherwise it
+ *		 is AI_Frequency divided amongst the stream channels.
 **/
-void LabJackLayer::StartCommandResponse()
+double LabJackLayer::GetScanFrequency()
 {
-	// Find smallest channel
-	if (numAINRequested > 0)
-	{
-		smallestChannel = analogInputScanList[0];
-		smallestChannelType = ANALOG;
-	}
-	else
-	{
-		smallestChannel = digitalInputScanList[0];
-		smallestChannelType = DIGITAL;
-	}
+	if (scanFrequency > 0)
+		return scanFrequency;
 
-	// Install MultiMedia interrupt handler
-	if ( ! InstallTimerInterruptHandler() )
-	{
+	return plan.GetScanFrequency();
+}
+
+/**
+ * Name: StartStreaming()
+ * Desc: Configures and starts analog/digital input streaming. When the
+ *		 device is still set up for the same stream as last time (warm
+ *		 start) the configuration is skipped and the stream just started.
+**/
+void LabJackLayer::StartStreaming()
+{
+	long lngErrorcode, lngIOType, lngChannel;
+	double dblValue;
+	StreamSetup setup;
+	bool configured;
+	int i;
+
+	// Take the stream this experiment needs from the plan
+	setup.numChannels = plan.GetNumStreamChannels();
+	setup.channels.assign(plan.GetStreamChannels(), plan.GetStreamChannels() + setup.numChannels);
+	setup.scanFrequency = GetDeviceScanFrequency();
+	setup.bufferSize = setup.numChannels*setup.scanFrequency*5;
+	setup.callbackScans = GetStreamCallbackScans();
+	setup.userValue = registryIndex;
+
+	if (configShadow.HasStream(&setup))
+		warmStarts++;
+	else
+	{
+		coldStarts++;
+		configShadow.ForgetStream();
+
+		// Set the scan rate.
+		lngErrorcode = AddRequest(lngHandle, LJ_ioPUT_CONFIG, LJ_chSTREAM_SCAN_FREQUENCY, setup.scanFrequency, 0, 0);
+		ErrorHandler(lngErrorcode);
+
+		// Give the driver a 5 second buffer (scanRate * channels * 5 seconds).
+		lngErrorcode = AddRequest(lngHandle, LJ_ioPUT_CONFIG, LJ_chSTREAM_BUFFER_SIZE, setup.bufferSize, 0, 0);
+		ErrorHandler(lngErrorcode);
+
+		// Configure reads to retrieve whatever data is available without waiting
+		lngErrorcode = AddRequest(lngHandle, LJ_ioPUT_CONFIG, LJ_chSTREAM_WAIT_MODE, LJ_swNONE, 0, 0);
+		ErrorHandler(lngErrorcode);
+
+		// Clear stream channels
+		lngErrorcode = AddRequest(lngHandle, LJ_ioCLEAR_STREAM_CHANNELS, 0, 0, 0, 0);
+		ErrorHandler(lngErrorcode);
+
+		// Define the analog and digital input scan list
+		for(i=0; i<setup.numChannels; i++)
+		{
+			lngErrorcode = AddRequest(lngHandle, LJ_ioADD_STREAM_CHANNEL, setup.channels[i], 0, 0, 0);
+			ErrorHandler(lngErrorcode);
+		}
+
+		//Execute the list of requests.
+		lngErrorcode = GoOne(lngHandle);
+		ErrorHandler(lngErrorcode);
+		configured = lngErrorcode == LJE_NOERROR;
+
+		//Get all the results just to check for errors.
+		lngErrorcode = GetFirstResult(lngHandle, &lngIOType, &lngChannel, &dblValue, 0, 0);
+		ErrorHandler(lngErrorcode);
+		configured = configured && lngErrorcode == LJE_NOERROR;
+		while(lngErrorcode < LJE_MIN_GROUP_ERROR)
+		{
+			lngErrorcode = GetNextResult(lngHandle, &lngIOType, &lngChannel, &dblValue, 0, 0);
+			if(lngErrorcode != LJE_NO_MORE_DATA_AVAILABLE)
+			{
+				ErrorHandler(lngErrorcode);
+				configured = configured && lngErrorcode == LJE_NOERROR;
+			}
+		}
+
+		// Put in the callback. If the X1 parameter is set to something other than 0
+		// the driver will call the specified function after that number of scans
+		// have been reached. The user value identifies this device in the registry.
+		lngErrorcode = ePut(lngHandle, LJ_ioSET_STREAM_CALLBACK, (long)StreamCallbackWrapper, setup.userValue, setup.callbackScans);
+		ErrorHandler(lngErrorcode);
+		configured = configured && lngErrorcode == LJE_NOERROR;
+
+		if (configured)
+			configShadow.RememberStream(&setup);
+	}
+
+	//Start the stream. The first scan is taken no earlier than now.
+	streamStartMs = Stopwatch::GetTimeMs();
+	streamScansRead = 0;
+	lngErrorcode = eGet(lngHandle, LJ_ioSTART_STREAM, 0, &dblValue, 0);
+	ErrorHandler(lngErrorcode);
+
+	// The device may have lost its setup, configure it fully next time
+	if (lngErrorcode != LJE_NOERROR)
+		configShadow.ForgetStream();
+
+	isStreaming = TRUE;
+
+	// Indicate that we have started measuring
+	measRun = TRUE;
+}
+
+/**
+ * Name: StartCommandResponse()
+ * Desc: Begin reading analog/digital input through command response
+**/
+void LabJackLayer::StartCommandResponse()
+{
+	// One reading per analog input and a word for the digital lines
+	polledScan.resize(plan.GetScanWidth());
+
+	// Find smallest channel
+	if (plan.GetNumAnalogInputs() > 0)
+	{
+		smallestChannel = plan.GetAnalogInputs()[0].channel;
+		smallestChannelType = ANALOG;
+	}
+	else
+	{
+		smallestChannel = plan.GetDigitalInputs()[0];
+		smallestChannelType = DIGITAL;
+	}
+
+	// Install MultiMedia interrupt handler
+	if ( ! InstallTimerInterruptHandler(GetTickPeriod()) )
+	{
 		infoStruct->Error = DRV_ERR_HARD_CONFLICT;
 		MessageBeep((UINT)-1);
 		measRun = FALSE;
@@ -1065,32 +1559,35 @@ void LabJackLayer::StartCommandResponse()
 }
 
 /**
- * Name: InstallTimerInterruptHandler()
- * Desc: Starts software timer to poll device
+ * Name: InstallTimerInterruptHandler(UINT period)
+ * Desc: Starts software timer to poll device every period (ms)
  * Note: This is mostly copied from the DASYLab example driver code
 **/
-bool LabJackLayer::InstallTimerInterruptHandler()
+bool LabJackLayer::InstallTimerInterruptHandler(UINT period)
 {
-	// TODO: DASYLab used a value of 10 for the resolution but I don't see why a minimum could not be found (0.1)
+	// DASYLab used a resolution of 10 ms; control loops need the timer's
+	// best to keep their period
 	if ( hTimerID == 0 )
 	{
 		TIMECAPS capabilities;
 
+		timerResolution = loops.empty() ? TIMER_RESOLUTION : CONTROL_TIMER_RESOLUTION;
+
 		if ( timeGetDevCaps ( &capabilities, sizeof(capabilities)) == TIMERR_NOCANDO )
 			return FALSE;
-		if ( capabilities.wPeriodMin > 10 || capabilities.wPeriodMax < 10 )
+		if ( capabilities.wPeriodMin > timerResolution || capabilities.wPeriodMax < timerResolution )
 			return FALSE;
 
-		if ( timeBeginPeriod (10) == TIMERR_NOCANDO )
+		if ( timeBeginPeriod (timerResolution) == TIMERR_NOCANDO )
 		{
-			timeEndPeriod (10);
+			timeEndPeriod (timerResolution);
 			return FALSE;
 		}
 
-		hTimerID = timeSetEvent ( (UINT)(1.0/infoStruct->AI_Frequency*1000), 10, CommandResponseCallbackWrapper, (DWORD_PTR)this, TIME_PERIODIC);
+		hTimerID = timeSetEvent ( period, timerResolution, CommandResponseCallbackWrapper, (DWORD_PTR)this, TIME_PERIODIC);
 		if ( hTimerID == 0 )
 		{
-			timeEndPeriod (10);
+			timeEndPeriod (timerResolution);
 			return FALSE;
 		}
 	}		 
@@ -1108,7 +1605,7 @@ void LabJackLayer::RemoveTimerInterruptHandler ()
 	if ( hTimerID != 0 )
 	{
 		timeKillEvent( hTimerID );
-		timeEndPeriod (10);
+		timeEndPeriod (timerResolution);
 
 		hTimerID = 0;
 	}	
@@ -1124,55 +1621,298 @@ void LabJackLayer::CommandResponseCallback()
 	LJ_ERROR lngErrorcode;
 	int i;
 	double dblValue;
+	double * scan;
+	DWORD lineStates;
+	int numAIN = plan.GetNumAnalogInputs();
+	int numDI = plan.GetNumDigitalInputs();
+	const AnalogInputPlan * analogInputs = plan.GetAnalogInputs();
+	const int * digitalInputs = plan.GetDigitalInputs();
 
 	// TODO: Try to use PostMessage
+
+	// Leave the device alone while the watchdog reopens it
+	if (recovery.IsRecovering() || polledScan.empty())
+		return;
+	scan = &polledScan[0];
+
+	// The tick owns the handle and the loop setpoints until it is done
+	EnterCriticalSection(&handleLock);
+
+	// The outputs worked out last tick go out in this tick's transaction,
+	// ahead of the reads
+	if (!loops.empty())
+	{
+		controlTiming.Start(Stopwatch::GetTimeMs());
+		for (i = 0; i < (int)loops.size(); i++)
+		{
+			lngErrorcode = AddRequest(lngHandle, LJ_ioPUT_DAC, loops[i].GetOutputChannel(), loops[i].GetOutput(), 0, 0);
+			ErrorHandler(lngErrorcode);
+		}
+	}
 	
-	// Make requests for the channels that the experiment is reading
-	for(i=0; i<numAINRequested; i++)
+	// Make requests for the channels that the experiment is reading; slow
+	// inputs are read by DeliverScan when they are due
+	for(i=0; i<numAIN; i++)
 	{
-		lngErrorcode = AddRequest(lngHandle, LJ_ioGET_AIN, analogInputScanList[i], 0, 0, 0);
+		if (analogInputs[i].slow)
+			continue;
+		lngErrorcode = AddRequest(lngHandle, LJ_ioGET_AIN, analogInputs[i].udChannel, 0, 0, 0);
 		ErrorHandler(lngErrorcode);
 	}
 
-	for(i=0; i<numDIRequested; i++)
+	for(i=0; i<numDI; i++)
 	{
-		lngErrorcode = AddRequest(lngHandle, LJ_ioGET_DIGITAL_BIT, digitalInputScanList[i], 0, 0, 0);
+		lngErrorcode = AddRequest(lngHandle, LJ_ioGET_DIGITAL_BIT, digitalInputs[i], 0, 0, 0);
 		ErrorHandler(lngErrorcode);
 	}
 
 	//Execute the requests.
+	alarmScanMs = Stopwatch::GetTimeMs();
 	lngErrorcode = GoOne(lngHandle);
 	ErrorHandler(lngErrorcode);
+	if (lngErrorcode != LJE_NOERROR)
+	{
+		LeaveCriticalSection(&handleLock);
+		return;
+	}
+	recovery.NoteData();
+
+	// Read back the results into a scan laid out like a device scan, the
+	// digital lines packed into one word as channel 193 would
+	for(i=0; i<numAIN; i++)
+	{
+		if (analogInputs[i].slow)
+			continue;
+		lngErrorcode = GetResult(lngHandle, LJ_ioGET_AIN, analogInputs[i].udChannel, &scan[analogInputs[i].source]);
+		ErrorHandler(lngErrorcode);
+		autoRanger.Observe(i, scan[analogInputs[i].source]);
+	}
 
-	// Read back the results
-	for(i=0; i<numAINRequested; i++)
+	lineStates = 0;
+	for(i=0; i<numDI; i++)
 	{
-		lngErrorcode = GetResult(lngHandle, LJ_ioGET_AIN, analogInputScanList[i], &dblValue);
+		lngErrorcode = GetResult(lngHandle, LJ_ioGET_DIGITAL_BIT, digitalInputs[i], &dblValue);
 		ErrorHandler(lngErrorcode);
-		AddToInputBuffer(ConvertAIValue(dblValue, analogInputScanList[i])); // TODO: We ought to have a channel variable in here
+		if (dblValue != 0)
+			lineStates |= 1UL << digitalInputs[i];
+	}
+	if (numDI > 0)
+		scan[plan.GetDigitalSource()] = lineStates;
+
+	if (!loops.empty())
+	{
+		for (i = 0; i < (int)loops.size(); i++)
+			loops[i].Update(scan[loops[i].GetInput()]);
+		controlTiming.Finish(Stopwatch::GetTimeMs());
+	}
+
+	DeliverScan(scan);
+
+	// New ranges take effect where a DASYLab block starts, so every block
+	// is scaled to one range
+	if (autoRanger.Update(Stopwatch::GetTimeMs()))
+		rangesPending = TRUE;
+	if (rangesPending && inputStoreIndex % plan.GetBlockSize() == 0)
+		ApplyAutoRanges();
+	LeaveCriticalSection(&handleLock);
+}
+
+/**
+ * Name: DeliverScan(const double * scan)
+ * Desc: (private) Converts one scan into the FIFO, adding the latest value
+ *		 of every slow input after the stream channels
+**/
+void LabJackLayer::DeliverScan(const double * scan)
+{
+	int numSamples = channels.GetNumEntries();
+	int numSlow = slowInputs.GetNumInputs();
+	int j, numScans, numTrips;
+
+	if (numSlow > 0)
+	{
+		if (UpdateSlowInputs(scan) && plan.GetColdJunction() >= 0)
+			UpdateColdJunction();
+		memcpy(&deviceScan[0], scan, sizeof(double) * GetNumStreamChannels());
+		memcpy(&deviceScan[GetNumStreamChannels()], slowInputs.GetValues(), sizeof(double) * numSlow);
+		scan = &deviceScan[0];
+	}
+
+	// Every scan is checked against the limits, whatever reaches the FIFO
+	if (alarms.IsActive())
+	{
+		numTrips = alarms.Check(scan);
+		if (numTrips > 0)
+			RespondToAlarms(scan, numTrips);
+		alarmScanIndex++;
+	}
+
+	// Only the scans around trigger events go on to the FIFO
+	if (scanSink == NULL && trigger.IsActive())
+	{
+		numScans = trigger.Process(scan, channels.ConvertScan(scan));
+		for (j = 0; j < numScans; j++)
+		{
+			if (AcceptCaptureScan(numSamples))
+				StoreScan(trigger.GetOutput(j, numScans), numSamples);
+		}
+		return;
+	}
+
+	// Between capture windows the stream runs on but nothing is stored;
+	// merged scans are gated by the DeviceRegistry
+	if (scanSink == NULL && !AcceptCaptureScan(numSamples))
+		return;
+
+	StoreScan(channels.ConvertScan(scan), numSamples);
+}
+
+/**
+ * Name: StoreScan(const SAMPLE * samples, int numSamples)
+ * Desc: (private) Passes one converted scan on: into the burst capture
+ *		 while one runs, otherwise to the FIFO or the merge queue
+**/
+void LabJackLayer::StoreScan(const SAMPLE * samples, int numSamples)
+{
+	int i;
+
+	if (burst.IsActive())
+	{
+		burst.Store(samples, numSamples);
+		return;
+	}
+
+	for(i=0; i<numSamples; i++)
+		AddToInputBuffer(samples[i]);
+}
+
+/**
+ * Name: UpdateSlowInputs(const double * scan)
+ * Desc: (private) Takes a new reading of the slow inputs every
+ *		 SlowDownCount scans: a command-response read, or the average of
+ *		 their stream readings when the model cannot read them while
+ *		 streaming
+ * Retn: TRUE if a new reading was taken
+**/
+bool LabJackLayer::UpdateSlowInputs(const double * scan)
+{
+	const SlowInputPlan * slow = plan.GetSlowInputs();
+	bool polling = plan.IsPollingSlowInputs() || !experimentStreaming;
+	int n;
+
+	if (!polling)
+	{
+		for (n = 0; n < slowInputs.GetNumInputs(); n++)
+			slowInputs.Accumulate(n, scan[slow[n].streamIndex]);
 	}
 
-	for(i=0; i<numDIRequested; i++)
+	if (!slowInputs.IsDue())
+		return FALSE;
+
+	if (polling)
+		PollSlowInputs();
+	else
+		slowInputs.Publish();
+	return TRUE;
+}
+
+/**
+ * Name: UpdateColdJunction()
+ * Desc: (private) Compensates the thermocouples with the latest reading of
+ *		 the internal temperature sensor, which the UD driver returns in
+ *		 kelvin, and reports it to DASYLab in CJValue. [Thermocouple]
+ *		 ColdJunctionOffset corrects for the screw terminals being at a
+ *		 different temperature than the sensor.
+**/
+void LabJackLayer::UpdateColdJunction()
+{
+	double celsius;
+
+	celsius = slowInputs.GetValues()[plan.GetColdJunction()] - KELVIN_OFFSET + coldJunctionOffset;
+	channels.SetColdJunction(celsius);
+	measInfo.CJValue = (long)floor(celsius * 10 + 0.5);
+}
+
+/**
+ * Name: PollSlowInputs()
+ * Desc: (private) Reads every slow input in one command-response
+ *		 transaction, which the UD driver interleaves with the stream
+**/
+void LabJackLayer::PollSlowInputs()
+{
+	const SlowInputPlan * slow = plan.GetSlowInputs();
+	LJ_ERROR lngErrorcode;
+	double dblValue;
+	int n;
+
+	for (n = 0; n < slowInputs.GetNumInputs(); n++)
 	{
-		lngErrorcode = GetResult(lngHandle, LJ_ioGET_DIGITAL_BIT, digitalInputScanList[i], &dblValue);
+		lngErrorcode = AddRequest(lngHandle, LJ_ioGET_AIN, slow[n].udChannel, 0, 0, 0);
 		ErrorHandler(lngErrorcode);
-		AddToInputBuffer((SAMPLE)dblValue);
 	}
 
+	lngErrorcode = GoOne(lngHandle);
+	ErrorHandler(lngErrorcode);
+	if (lngErrorcode != LJE_NOERROR)
+		return;
+
+	for (n = 0; n < slowInputs.GetNumInputs(); n++)
+	{
+		lngErrorcode = GetResult(lngHandle, LJ_ioGET_AIN, slow[n].udChannel, &dblValue);
+		ErrorHandler(lngErrorcode);
+		slowInputs.Set(n, dblValue);
+		if (slow[n].analogInput >= 0)
+			autoRanger.Observe(slow[n].analogInput, dblValue);
+	}
 }
 
 /**
  * Name: AddToInputBuffer(SAMPLE newValue)
- * Desc: Adds a new reading to DASYLab's input buffer
+ * Desc: Adds a new reading to DASYLab's input buffer or, when this device
+ *		 is one of several, to the queue it is merged from
 **/
 void LabJackLayer::AddToInputBuffer(SAMPLE newValue)
+{
+	if (scanSink != NULL)
+		scanSink->Push(newValue);
+	else
+		StoreInFifo(newValue);
+}
+
+/**
+ * Name: WriteInputScan(const SAMPLE * values, int numValues)
+ * Desc: Places already converted values directly into DASYLab's input
+ *		 buffer. Used by the DeviceRegistry to write merged scans.
+**/
+void LabJackLayer::WriteInputScan(const SAMPLE * values, int numValues)
+{
+	int i;
+
+	for (i = 0; i < numValues; i++)
+		StoreInFifo(values[i]);
+}
+
+/**
+ * Name: AcceptCaptureScan(int numValues)
+ * Desc: Returns true if the next scan of numValues samples is to be
+ *		 stored: always, except between capture windows in block mode
+**/
+bool LabJackLayer::AcceptCaptureScan(int numValues)
+{
+	return !captureWindow.IsActive() || captureWindow.Accept(numValues);
+}
+
+/**
+ * Name: StoreInFifo(SAMPLE newValue)
+ * Desc: (private) Places a value in DASYLab's input buffer
+**/
+void LabJackLayer::StoreInFifo(SAMPLE newValue)
 {
 	// Feed channel value in FIFO buffer
 	inputBufferAdr[inputStoreIndex] = newValue;
 
 	// increment FIFO index and wrap around
 	inputStoreIndex++;
-	if (inputStoreIndex == infoStruct->DriverBufferSize)
+	if (inputStoreIndex == plan.GetBufferSize())
 	{
 		inputStoreIndex = 0;
 		wrapAround = TRUE;
@@ -1188,7 +1928,11 @@ void LabJackLayer::WriteDigitalOutput(UINT chan, DWORD outVal)
 	long lngErrorcode;
 
 	// TODO: AddRequest did not work here but this should be changed in a future release
+	EnterCriticalSection(&handleLock);
 	lngErrorcode = ePut(lngHandle, LJ_ioPUT_DIGITAL_BIT, chan, outVal, 0);
+	if (lngErrorcode == LJE_NOERROR)
+		configShadow.NoteOutput(LJ_ioPUT_DIGITAL_BIT, chan, outVal);
+	LeaveCriticalSection(&handleLock);
 	ErrorHandler(lngErrorcode);
 }
 
@@ -1200,13 +1944,31 @@ void LabJackLayer::WriteDAC(UINT chan, DWORD outVal)
 {
 	long lngErrorcode = 0;
 	double convertedVoltage;
+	int n;
 
 	// Convert Voltage
 	convertedVoltage = ConvertAOValue(outVal, chan);
 
+	// A DAC driven by a control loop takes the value as its setpoint; the
+	// lock keeps the tick from reading it half written
+	for (n = 0; n < (int)loops.size(); n++)
+	{
+		if (loops[n].GetOutputChannel() == (long)chan)
+		{
+			EnterCriticalSection(&handleLock);
+			loops[n].SetSetpoint(convertedVoltage);
+			LeaveCriticalSection(&handleLock);
+			return;
+		}
+	}
+
 	// Write the value for the given channel
+	EnterCriticalSection(&handleLock);
 	lngErrorcode = AddRequest(lngHandle, LJ_ioPUT_DAC, chan, convertedVoltage, 0, 0);
 	GoOne(lngHandle); // TODO: Potential performance issue
+	if (lngErrorcode == LJE_NOERROR)
+		configShadow.NoteOutput(LJ_ioPUT_DAC, chan, convertedVoltage);
+	LeaveCriticalSection(&handleLock);
 	ErrorHandler(lngErrorcode);
 }
 
@@ -1230,29 +1992,49 @@ double LabJackLayer::ConvertAOValue(DWORD value, UINT channel)
 **/
 void LabJackLayer::OpenDevice(long newDeviceType, int id)
 {
+	Stopwatch phaseTimer;
+	char idString[16];
+
 	if(open)
 		Close();
+	open = FALSE;
 
 	// Save the id and indicate that usb is used
 	localID = id;
 	isUsingEthernet = false;
 
-	// Open the LabJack and create buffer
-	SetError(OpenLabJack (newDeviceType, LJ_ctUSB, ToCharArray(id), 1, &lngHandle));
-	if (!GetError() && AllocateInputBuffer (DEFAULT_BUFFER_SIZE)) 
-		open = TRUE;
+	// Open the LabJack
+	SetError(OpenLabJack (newDeviceType, LJ_ctUSB, ToCharArray(id, idString), 1, &lngHandle));
+	openPhaseTimes[OPEN_PHASE_CONNECT] = phaseTimer.GetElapsedMs();
 
-	// Save the device type
-	deviceType = newDeviceType;
+	FinishOpen(newDeviceType);
+}
 
-	// Get the cal constants TODO: check size of array for UE9
-	//long pCalMem = (long)&calConstants[0];
-	//lngErrorcode = eGet(lngHandle, LJ_ioGET_CONFIG, LJ_chCAL_CONSTANTS, 0, pCalMem);
-    //ErrorHandler(lngErrorcode);
+/**
+ * Name: OpenDeviceBySerial(long newDeviceType, long serial)
+ * Desc: Closes the current device (if any) and opens the USB device of
+ *		 the given type with the given serial number, whatever its local
+ *		 ID or place in the enumeration
+**/
+void LabJackLayer::OpenDeviceBySerial(long newDeviceType, long serial)
+{
+	Stopwatch phaseTimer;
+	double dblValue = 0;
+	char serialString[16];
 
-	// Reset the InfoStructure
-	// Fill the information structure
-	FillInfoStructure();
+	if(open)
+		Close();
+	open = FALSE;
+
+	isUsingEthernet = false;
+
+	// Open the LabJack and learn its local ID for the setup dialog
+	SetError(OpenLabJack (newDeviceType, LJ_ctUSB, ToCharArray(serial, serialString), 0, &lngHandle));
+	if (!GetError() && eGet(lngHandle, LJ_ioGET_CONFIG, LJ_chLOCALID, &dblValue, 0) == LJE_NOERROR)
+		localID = (int)dblValue;
+	openPhaseTimes[OPEN_PHASE_CONNECT] = phaseTimer.GetElapsedMs();
+
+	FinishOpen(newDeviceType);
 }
 
 /**
@@ -1262,152 +2044,958 @@ void LabJackLayer::OpenDevice(long newDeviceType, int id)
 **/
 void LabJackLayer::OpenEthernetDevice(long newDeviceType, CString address)
 {
+	Stopwatch phaseTimer;
+
 	if(open)
 		Close();
+	open = FALSE;
+
+	// Show that we are using ethernet and save the ip address to the
+	// instance variable ipAddress
+	// TODO: These names could be confusing
+	isUsingEthernet = true;
+	ipAddress = address;
 
-	// Open the LabJack and create buffer
+	// Open the LabJack and keep a silent UE9 from stalling later requests
 	SetError(OpenLabJack (newDeviceType, LJ_ctETHERNET, address.GetBuffer(0), 1, &lngHandle));
+	if (!GetError())
+		ePut(lngHandle, LJ_ioPUT_CONFIG, LJ_chCOMMUNICATION_TIMEOUT, ETHERNET_TIMEOUT, 0);
+	openPhaseTimes[OPEN_PHASE_CONNECT] = phaseTimer.GetElapsedMs();
+
+	FinishOpen(newDeviceType);
+}
+
+/**
+ * Name: FinishOpen(long newDeviceType)
+ * Desc: (private) Common open code run once OpenLabJack has returned:
+ *		 creates the buffer, reads the serial number and fills the
+ *		 information structure, timing each phase
+**/
+void LabJackLayer::FinishOpen(long newDeviceType)
+{
+	Stopwatch phaseTimer;
+
+	// Create buffer
 	if (!GetError() && AllocateInputBuffer (DEFAULT_BUFFER_SIZE)) 
 		open = TRUE;
+	openPhaseTimes[OPEN_PHASE_BUFFER] = phaseTimer.GetElapsedMs();
 
-	// Save the device type and show that we are using ethernet
+	// Save the device type
 	deviceType = newDeviceType;
-	isUsingEthernet = true;
 
-	// Save the ip address to the instance variable ipAddress
-	// TODO: These names could be confusing
-	ipAddress = address;
+	phaseTimer.Start();
+	ReadSerialNumber();
+	openPhaseTimes[OPEN_PHASE_SERIAL] = phaseTimer.GetElapsedMs();
+
+	// Nothing is known about the configuration of a freshly opened device
+	configShadow.Invalidate();
+	plan.Invalidate();
+
+	// Get the cal constants, from the INI file for a device seen before
+	phaseTimer.Start();
+	if (open)
+		calibration.Load(lngHandle, deviceType, serialNumber);
+	else
+		calibration.Clear();
+	openPhaseTimes[OPEN_PHASE_CALIBRATION] = phaseTimer.GetElapsedMs();
 
 	// Reset the InfoStructure
 	// Fill the information structure
+	phaseTimer.Start();
 	FillInfoStructure();
+	openPhaseTimes[OPEN_PHASE_INFO] = phaseTimer.GetElapsedMs();
 }
 
 /**
- * Name: GetDeviceType()
- * Desc: Returns the device type of the device currently
- *		 in operation
+ * Name: RestartAcquisition()
+ * Desc: Called by the StreamRecovery watchdog after a stall or error.
+ *		 Reopens the device by serial number or IP address, reapplies the
+ *		 range configuration and restarts the stream. The FIFO indices are
+ *		 left alone so DASYLab carries on with the same buffer; a timer
+ *		 driven experiment simply resumes on the next tick. The old stream
+ *		 is stopped before handleLock is taken: stopping waits for its
+ *		 callback, which may itself be waiting for the lock.
+ * Retn: TRUE if the device is acquiring again and FALSE otherwise
 **/
-long LabJackLayer::GetDeviceType()
+bool LabJackLayer::RestartAcquisition()
 {
-	return deviceType;
+	LJ_ERROR lngErrorcode;
+	long newHandle;
+	char idString[16];
+
+	// Stop what is left of the stream, errors are expected here
+	if (isStreaming)
+	{
+		eGet(lngHandle, LJ_ioSTOP_STREAM, 0, 0, 0);
+		isStreaming = FALSE;
+	}
+
+	// Reopen the same device. Close() would close every device in use so
+	// the handle is refreshed with OpenLabJack alone.
+	EnterCriticalSection(&handleLock);
+	if (isUsingEthernet)
+		lngErrorcode = OpenLabJack(deviceType, LJ_ctETHERNET, ipAddress.GetBuffer(0), 0, &newHandle);
+	else if (serialNumber != 0)
+		lngErrorcode = OpenLabJack(deviceType, LJ_ctUSB, ToCharArray(serialNumber, idString), 0, &newHandle);
+	else
+		lngErrorcode = OpenLabJack(deviceType, LJ_ctUSB, ToCharArray(localID, idString), localID == 0, &newHandle);
+	if (lngErrorcode != LJE_NOERROR)
+	{
+		LeaveCriticalSection(&handleLock);
+		return FALSE;
+	}
+
+	lngHandle = newHandle;
+	if (isUsingEthernet)
+		ePut(lngHandle, LJ_ioPUT_CONFIG, LJ_chCOMMUNICATION_TIMEOUT, ETHERNET_TIMEOUT, 0);
+
+	// Reapply the configuration and restart into the same FIFO. The device
+	// may have been power cycled so every setting is sent again, with the
+	// outputs the experiment wrote.
+	SetError(0);
+	configShadow.Reopened();
+	configShadow.RequireOutputs();
+	ConfigureRange();
+	if (experimentStreaming)
+		StartStreaming();
+	LeaveCriticalSection(&handleLock);
+
+	return GetError() == 0;
 }
 
 /**
- * Name: IsUsingEthernet()
- * Desc: Returns true if the device is in use through ethernet
- *		 or false otherwise
+ * Name: GetStartLatency()
+ * Desc: Returns the milliseconds the last BeginExperiment took from
+ *		 configuring the device to acquiring
 **/
-bool LabJackLayer::IsUsingEthernet()
+double LabJackLayer::GetStartLatency()
 {
-	return isUsingEthernet;
+	return startLatency;
 }
 
 /**
- * Name: ConfigureRange()
- * Desc: Changes the information structure's range
+ * Name: SetupAutoRange()
+ * Desc: (private) Gives the auto-ranger the ranges of the device and, when
+ *		 auto-ranging is turned on in the INI file, hands it every analog
+ *		 input left at unity gain:
+ *
+ *		 [AutoRange]
+ *		 Enabled=1
+ *		 HoldMs=2000	; time a narrower range must fit before switching
+ *
+ *		 Only a command-response experiment of one device auto-ranges: a
+ *		 stream's ranges cannot change while it runs, and a trigger or burst
+ *		 would hand DASYLab scans converted before a switch in the blocks
+ *		 after it.
 **/
-void LabJackLayer::ConfigureRange()
+void LabJackLayer::SetupAutoRange()
 {
-	int n;
-	long lngErrorcode;
+	AutoRange ranges[8];
+	int n, count;
 
-	for (n=0; n < numAINRequested; n++) 
+	// The model lists its gains with the widest range first
+	count = 0;
+	for (n = 0; model != NULL && n < model->numGains && count < 8; n++)
 	{
-		//infoStruct->AI_ChInfo[n].InputRange_Max = CalMaxAIValue(n);
-		//infoStruct->AI_ChInfo[n].InputRange_Min = CalMinAIValue(n);
-		long udRange = ConvertToUDRange(infoStruct->GainInfo[infoStruct->AI_ChSetup[n].GainCode]);
-		lngErrorcode = AddRequest(lngHandle, LJ_ioPUT_AIN_RANGE, n, udRange, 0, 0);
-		ErrorHandler(lngErrorcode);
-	}
+		if (GetRangeLimits(model->gains[n].udRange, &ranges[count].minVolts, &ranges[count].maxVolts))
+		{
+			ranges[count].udRange = model->gains[n].udRange;
+			count++;
+		}
+	}
+	autoRanger.SetRanges(ranges, count);
+	autoRanger.Reset(plan.GetNumAnalogInputs(), DriverSettings::GetInt("AutoRange", "HoldMs", AUTO_RANGE_HOLD));
+	rangesPending = FALSE;
+
+	if (!DriverSettings::GetInt("AutoRange", "Enabled", 0) || experimentStreaming || scanSink != NULL ||
+		DriverSettings::GetInt("Trigger", "Enabled", 0) || DriverSettings::GetInt("Burst", "Enabled", 0))
+		return;
+
+	for (n = 0; n < plan.GetNumAnalogInputs(); n++)
+	{
+		if (plan.GetAnalogInputs()[n].gainCode == 0)
+			autoRanger.Enable(n);
+	}
+}
+
+/**
+ * Name: ApplyAutoRanges()
+ * Desc: (private) Puts the ranges the auto-ranger chose into effect where
+ *		 a DASYLab block starts. The device reads on them from the next
+ *		 tick, each auto-ranged input is scaled to the full SAMPLE span of
+ *		 its range so a narrower range adds resolution, and the range is
+ *		 reported as the channel's input limits for the blocks that follow.
+**/
+void LabJackLayer::ApplyAutoRanges()
+{
+	const AnalogInputPlan * analogInputs = plan.GetAnalogInputs();
+	double minVolts, maxVolts, maxValue;
+	int n;
+
+	rangesPending = FALSE;
+	ConfigureRange();
+
+	for (n = 0; n < plan.GetNumAnalogInputs(); n++)
+	{
+		if (!autoRanger.IsEnabled(n) || !GetRangeLimits(autoRanger.GetRange(n), &minVolts, &maxVolts))
+			continue;
+
+		maxValue = pow(2.0, (double)(sizeof(SAMPLE) * 8));
+		if (minVolts < 0)
+			maxValue /= 2;
+		channels.SetScale(n, maxValue / (maxVolts - minVolts));
+
+		infoStruct->AI_ChInfo[analogInputs[n].channel].InputRange_Min = minVolts;
+		infoStruct->AI_ChInfo[analogInputs[n].channel].InputRange_Max = maxVolts;
+	}
+}
+
+/**
+ * Name: RestoreAutoRangeLimits()
+ * Desc: (private) Reports the unity gain limits again for every
+ *		 auto-ranged input, which the next experiment is planned from
+**/
+void LabJackLayer::RestoreAutoRangeLimits()
+{
+	const AnalogInputPlan * analogInputs = plan.GetAnalogInputs();
+	double minVolts, maxVolts;
+	int n;
+
+	if (model == NULL || model->numGains == 0 || !GetRangeLimits(model->gains[0].udRange, &minVolts, &maxVolts))
+		return;
+
+	for (n = 0; n < plan.GetNumAnalogInputs(); n++)
+	{
+		if (!autoRanger.IsEnabled(n))
+			continue;
+		infoStruct->AI_ChInfo[analogInputs[n].channel].InputRange_Min = minVolts;
+		infoStruct->AI_ChInfo[analogInputs[n].channel].InputRange_Max = maxVolts;
+	}
+}
+
+/**
+ * Name: SetupResampler()
+ * Desc: (private) Streams at the nearest rate the device produces and
+ *		 resamples to exactly the requested rate when [Resampler] Enabled
+ *		 is set and the two differ. Quality picks the filter tier.
+**/
+void LabJackLayer::SetupResampler()
+{
+	double requested, achievable;
+
+	resampler.Disable();
+	filterMs = 0;
+	filteredScans = 0;
+
+	if (!experimentStreaming || model == NULL || !IsResampling())
+		return;
+
+	requested = GetScanFrequency();
+	achievable = DeviceModels::QuantizeScanRate(model, requested);
+	if (fabs(achievable - requested) <= requested * FREQUENCY_TOLERANCE)
+		return;
+
+	resampler.Configure(plan.GetNumStreamAnalogInputs(), GetNumStreamChannels() - plan.GetNumStreamAnalogInputs(),
+		achievable, requested, DriverSettings::GetInt("Resampler", "Quality", Resampler::QUALITY_NORMAL));
+}
+
+/**
+ * Name: SetupDecimator()
+ * Desc: (private) Streams faster than requested and filters back down when
+ *		 [Oversampling] Enabled is set, by the largest factor up to
+ *		 MaxFactor that the device produces exactly. The filter is
+ *		 TapsPerFactor times the factor long. Set up after the resampler,
+ *		 whose input rate it oversamples.
+**/
+void LabJackLayer::SetupDecimator()
+{
+	int factor;
+
+	decimator.Disable();
+
+	if (!experimentStreaming || model == NULL || !DriverSettings::GetInt("Oversampling", "Enabled", 0))
+		return;
+
+	factor = DeviceModels::FindOversampling(model, resampler.IsActive() ? resampler.GetInputRate() : GetScanFrequency(),
+		GetNumStreamChannels(), DriverSettings::GetInt("Oversampling", "MaxFactor", MAX_OVERSAMPLING));
+	if (factor <= 1)
+		return;
+
+	decimator.Configure(plan.GetNumStreamAnalogInputs(), GetNumStreamChannels() - plan.GetNumStreamAnalogInputs(),
+		factor, DriverSettings::GetInt("Oversampling", "TapsPerFactor", TAPS_PER_FACTOR));
+}
+
+/**
+ * Name: SetupTrigger()
+ * Desc: (private) Arms the software trigger when [Trigger] Enabled is set.
+ *		 PreScans and PostScans give the scans forwarded before and after
+ *		 the triggering scan; Conditions says how many conditions follow,
+ *		 any of which fires the trigger. A condition on a channel that is
+ *		 not acquired is left out, and without any the experiment runs
+ *		 untriggered. Only a device writing DASYLab's FIFO itself triggers.
+**/
+void LabJackLayer::SetupTrigger()
+{
+	std::vector<TriggerCondition> conditions;
+	TriggerCondition condition;
+	int n, numConditions;
+
+	trigger.Disable();
+
+	if (scanSink != NULL || !DriverSettings::GetInt("Trigger", "Enabled", 0))
+		return;
+
+	numConditions = DriverSettings::GetInt("Trigger", "Conditions", 1);
+	for (n = 0; n < numConditions; n++)
+	{
+		if (ReadTriggerCondition(n, &condition))
+			conditions.push_back(condition);
+	}
+	if (conditions.empty())
+		return;
+
+	trigger.Configure(channels.GetNumEntries(), DriverSettings::GetInt("Trigger", "PreScans", 0),
+		DriverSettings::GetInt("Trigger", "PostScans", 0), &conditions[0], (int)conditions.size());
+}
+
+/**
+ * Name: ReadTriggerCondition(int index, TriggerCondition * condition)
+ * Desc: (private) Reads condition index of [Trigger], for example for
+ *		 index 0:
+ *
+ *		 Type0=Edge				; Level, Edge, Window or Pattern
+ *		 Channel0=2				; DASYLab analog input (not for Pattern)
+ *		 Level0=1.5				; Level and Edge threshold (V)
+ *		 Slope0=1				; 1 above/rising, -1 below/falling, 0 either
+ *		 Low0=-1				; Window edges (V)
+ *		 High0=1
+ *		 Inside0=0				; Window fires inside instead of outside
+ *		 Mask0=0x0F				; Pattern: digital lines compared
+ *		 Pattern0=0x05			; Pattern: their states
+ * Retn: TRUE if the condition is valid for the planned scan
+**/
+bool LabJackLayer::ReadTriggerCondition(int index, TriggerCondition * condition)
+{
+	const AnalogInputPlan * analogInputs = plan.GetAnalogInputs();
+	CString type;
+	char key[16];
+	int i, channel;
+
+	sprintf(key, "Type%d", index);
+	type = DriverSettings::GetString("Trigger", key, "Level");
+	if (type.CompareNoCase("Edge") == 0)
+		condition->type = TriggerEngine::CONDITION_EDGE;
+	else if (type.CompareNoCase("Window") == 0)
+		condition->type = TriggerEngine::CONDITION_WINDOW;
+	else if (type.CompareNoCase("Pattern") == 0)
+		condition->type = TriggerEngine::CONDITION_PATTERN;
+	else
+		condition->type = TriggerEngine::CONDITION_LEVEL;
+
+	sprintf(key, "Level%d", index);
+	condition->low = DriverSettings::GetDouble("Trigger", key, 0);
+	condition->high = condition->low;
+	sprintf(key, "Slope%d", index);
+	condition->slope = DriverSettings::GetInt("Trigger", key, 1);
+	sprintf(key, "Inside%d", index);
+	condition->inside = DriverSettings::GetInt("Trigger", key, 0) != 0;
+	if (condition->type == TriggerEngine::CONDITION_WINDOW)
+	{
+		sprintf(key, "Low%d", index);
+		condition->low = DriverSettings::GetDouble("Trigger", key, 0);
+		sprintf(key, "High%d", index);
+		condition->high = DriverSettings::GetDouble("Trigger", key, 0);
+	}
+
+	sprintf(key, "Mask%d", index);
+	condition->mask = strtoul(DriverSettings::GetString("Trigger", key, "0"), NULL, 0);
+	sprintf(key, "Pattern%d", index);
+	condition->pattern = strtoul(DriverSettings::GetString("Trigger", key, "0"), NULL, 0) & condition->mask;
+
+	// The digital lines are one word of the device scan
+	if (condition->type == TriggerEngine::CONDITION_PATTERN)
+	{
+		condition->source = plan.GetDigitalSource();
+		return plan.GetNumDigitalInputs() > 0;
+	}
+
+	sprintf(key, "Channel%d", index);
+	channel = DriverSettings::GetInt("Trigger", key, 0);
+	for (i = 0; i < plan.GetNumAnalogInputs(); i++)
+	{
+		if (analogInputs[i].channel == channel)
+		{
+			condition->source = analogInputs[i].source;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/**
+ * Name: SetupBurst()
+ * Desc: (private) Captures a stop-after-N experiment into memory when
+ *		 [Burst] Enabled is set. The buffer holds every block of the
+ *		 experiment and is kept for the next burst if it is big enough.
+ *		 Without the memory the experiment runs through the FIFO as usual.
+**/
+void LabJackLayer::SetupBurst()
+{
+	DWORD samples;
+
+	burst.Disable();
+
+	if (scanSink != NULL || plan.GetMaxBlocks() == 0 || !DriverSettings::GetInt("Burst", "Enabled", 0))
+		return;
+
+	samples = plan.GetMaxBlocks() * plan.GetBlockSize();
+	if (samples > burstBufferSize)
+	{
+		KillBuffer(burstBufferAdr);
+		burstBufferSize = 0;
+		burstBufferAdr = AllocLockedMem(samples, infoStruct);
+		if (burstBufferAdr == NULL)
+		{
+			infoStruct->Error = 0;
+			return;
+		}
+		burstBufferSize = samples;
+	}
+
+	burst.Configure(burstBufferAdr, samples);
+}
+
+/**
+ * Name: DrainBurst()
+ * Desc: (private) Moves captured samples into the FIFO while DASYLab polls
+ *		 for input, up to half the FIFO at a time so it never overruns
+**/
+void LabJackLayer::DrainBurst()
+{
+	const SAMPLE * next;
+	long delta, room;
+	DWORD count, n;
+
+	delta = inputStoreIndex - aiRetrieveIndex;
+	if (wrapAround)
+		delta += plan.GetBufferSize();
+
+	room = (long)(plan.GetBufferSize() / 2) - delta;
+	if (room <= 0)
+		return;
+
+	count = burst.GetAvailable();
+	if (count > (DWORD)room)
+		count = (DWORD)room;
+
+	next = burst.GetNext();
+	for (n = 0; n < count; n++)
+		StoreInFifo(next[n]);
+	burst.Consume(count);
+}
+
+/**
+ * Name: IsControlEnabled()
+ * Desc: (private) Returns true if [Control] Enabled is set
+**/
+bool LabJackLayer::IsControlEnabled()
+{
+	return DriverSettings::GetInt("Control", "Enabled", 0) != 0;
+}
+
+/**
+ * Name: SetupControl()
+ * Desc: (private) Sets up the control loops of [Control] for a
+ *		 command-response experiment; Loops says how many follow. Each
+ *		 tick reads the inputs and writes the outputs of the previous tick
+ *		 in one UD transaction, so an output lags its measurement by one
+ *		 period. A loop whose input is not acquired is left out, and no
+ *		 loop runs above 1 kHz, the fastest tick the timer keeps.
+**/
+void LabJackLayer::SetupControl()
+{
+	ControlLoop loop;
+	int n;
+	UINT period;
+
+	loops.clear();
+
+	if (experimentStreaming || scanSink != NULL || !HasControlLoops())
+		return;
+
+	period = GetTickPeriod();
+	for (n = 0; n < (int)controlSettings.size(); n++)
+	{
+		loop.Configure(&controlSettings[n], period / 1000.0);
+		loops.push_back(loop);
+	}
+
+	controlTiming.Reset(period);
+}
+
+/**
+ * Name: HasControlLoops()
+ * Desc: (private) Returns true if the compiled plan has a control loop
+ *		 to run
+**/
+bool LabJackLayer::HasControlLoops()
+{
+	return !controlSettings.empty();
+}
+
+/**
+ * Name: ReadControlLoops()
+ * Desc: (private) Reads the loops of [Control] once the plan is compiled,
+ *		 keeping those whose input is acquired. None are kept when the
+ *		 tick of the experiment would be shorter than
+ *		 CONTROL_TIMER_RESOLUTION.
+**/
+void LabJackLayer::ReadControlLoops()
+{
+	ControlSettings settings;
+	int n, numLoops;
+
+	controlSettings.clear();
+
+	if (!IsControlEnabled() || plan.GetAIFrequency() <= 0 ||
+		plan.GetAIFrequency() * CONTROL_TIMER_RESOLUTION > 1000)
+		return;
+
+	numLoops = DriverSettings::GetInt("Control", "Loops", 1);
+	for (n = 0; n < numLoops; n++)
+		if (ReadControlLoop(n, &settings))
+			controlSettings.push_back(settings);
+}
+
+/**
+ * Name: GetTickPeriod()
+ * Desc: (private) Returns the command-response timer period: the
+ *		 experiment's period rounded to whole ms, at least 1 ms
+**/
+UINT LabJackLayer::GetTickPeriod()
+{
+	double periodMs = plan.GetAIFrequency() > 0 ? 1000.0 / plan.GetAIFrequency() : 1;
+
+	if (periodMs < 1)
+		periodMs = 1;
+
+	return (UINT)(periodMs + 0.5);
+}
+
+/**
+ * Name: SetupAlarms()
+ * Desc: (private) Compiles the limit rules of [Alarms] when Enabled is
+ *		 set; Rules says how many follow. A rule whose channel is not
+ *		 acquired is left out.
+ *
+ *		 Scans are checked as they are delivered, so a scan waits up to one
+ *		 stream callback block, or one tick in command-response, before it
+ *		 is checked. That is the bound the table counts late alarms
+ *		 against; a scan also late by USB transfer or a stream backlog
+ *		 exceeds it. An alarm then takes one UD transaction to write its
+ *		 outputs, which is logged separately.
+**/
+void LabJackLayer::SetupAlarms()
+{
+	std::vector<AlarmRule> rules;
+	AlarmRule rule;
+	int n, numRules;
+	double boundMs;
+
+	alarms.Disable();
+	alarmScanIndex = 0;
+	InterlockedExchange(&alarmError, LJE_NOERROR);
+
+	if (DriverSettings::GetInt("Alarms", "Enabled", 0) == 0)
+		return;
+
+	numRules = DriverSettings::GetInt("Alarms", "Rules", 1);
+	for (n = 0; n < numRules; n++)
+	{
+		if (ReadAlarmRule(n, &rule))
+			rules.push_back(rule);
+	}
+
+	if (experimentStreaming)
+		boundMs = GetStreamCallbackScans() * 1000.0 / GetDeviceScanFrequency();
+	else
+		boundMs = GetTickPeriod();
+
+	if (!rules.empty())
+		alarms.Configure(&rules[0], (int)rules.size(), boundMs);
+}
+
+/**
+ * Name: ReadAlarmRule(int index, AlarmRule * rule)
+ * Desc: (private) Reads rule index of [Alarms], for example for index 0:
+ *
+ *		 Channel0=2				; DASYLab analog input checked
+ *		 Low0=-1				; Limits (V), unlimited when left out; a
+ *		 High0=4.5				; thermocouple is checked in volts too
+ *		 Hysteresis0=0.1		; Back inside the limits by this to clear (V)
+ *		 Action0=DO				; DO, DAC or None to only log the alarm
+ *		 Output0=4				; Digital line or DAC written
+ *		 Value0=1				; Line state or DAC volts
+ * Retn: TRUE if the channel is acquired
+**/
+bool LabJackLayer::ReadAlarmRule(int index, AlarmRule * rule)
+{
+	const AnalogInputPlan * analogInputs = plan.GetAnalogInputs();
+	CString action;
+	char key[16];
+	int i, channel;
+
+	sprintf(key, "Low%d", index);
+	rule->low = DriverSettings::GetDouble("Alarms", key, -HUGE_VAL);
+	sprintf(key, "High%d", index);
+	rule->high = DriverSettings::GetDouble("Alarms", key, HUGE_VAL);
+	sprintf(key, "Hysteresis%d", index);
+	rule->hysteresis = DriverSettings::GetDouble("Alarms", key, 0);
+	sprintf(key, "Output%d", index);
+	rule->channel = DriverSettings::GetInt("Alarms", key, 0);
+	sprintf(key, "Value%d", index);
+	rule->value = DriverSettings::GetDouble("Alarms", key, 0);
+
+	sprintf(key, "Action%d", index);
+	action = DriverSettings::GetString("Alarms", key, "None");
+	if (action.CompareNoCase("DO") == 0)
+		rule->action = AlarmTable::ACTION_DIGITAL;
+	else if (action.CompareNoCase("DAC") == 0)
+		rule->action = AlarmTable::ACTION_DAC;
+	else
+		rule->action = AlarmTable::ACTION_NONE;
+
+	sprintf(key, "Channel%d", index);
+	channel = DriverSettings::GetInt("Alarms", key, 0);
+	for (i = 0; i < plan.GetNumAnalogInputs(); i++)
+	{
+		if (analogInputs[i].channel == channel)
+		{
+			rule->source = analogInputs[i].source;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/**
+ * Name: RespondToAlarms(const double * scan, int numTrips)
+ * Desc: (private) Writes the outputs of the rules the scan tripped,
+ *		 all in one UD transaction so that the time to respond is that of
+ *		 one transaction however many rules trip together, then logs them.
+ *		 Runs in the stream callback or the command-response tick, which
+ *		 is the thread that detected the alarm, and holds handleLock so the
+ *		 transaction is not mixed with DASYLab's output writes. Each alarm
+ *		 is logged with the time from its scan being acquired, by the
+ *		 device's clock in a stream, to its detection, and the time from
+ *		 there to the outputs being written. A failed write is only
+ *		 recorded here; GetInputStatus reports it on DASYLab's thread so a
+ *		 message box cannot hold up acquisition.
+**/
+void LabJackLayer::RespondToAlarms(const double * scan, int numTrips)
+{
+	const AlarmRule * rule;
+	long lngErrorcode;
+	long error = LJE_NOERROR;
+	double detectedMs, writtenMs;
+	int n;
+	bool writing = FALSE;
+
+	detectedMs = Stopwatch::GetTimeMs();
+	EnterCriticalSection(&handleLock);
+	for (n = 0; n < numTrips; n++)
+	{
+		rule = alarms.GetRule(alarms.GetTrip(n));
+		if (rule->action == AlarmTable::ACTION_DIGITAL)
+			lngErrorcode = AddRequest(lngHandle, LJ_ioPUT_DIGITAL_BIT, rule->channel, rule->value != 0, 0, 0);
+		else if (rule->action == AlarmTable::ACTION_DAC)
+			lngErrorcode = AddRequest(lngHandle, LJ_ioPUT_DAC, rule->channel, rule->value, 0, 0);
+		else
+			continue;
+		if (lngErrorcode != LJE_NOERROR)
+			error = lngErrorcode;
+		writing = TRUE;
+	}
+
+	if (writing)
+	{
+		lngErrorcode = GoOne(lngHandle);
+		if (lngErrorcode != LJE_NOERROR)
+			error = lngErrorcode;
+	}
+
+	// A reopened device gets the alarm outputs back with DASYLab's
+	if (writing && error == LJE_NOERROR)
+	{
+		for (n = 0; n < numTrips; n++)
+		{
+			rule = alarms.GetRule(alarms.GetTrip(n));
+			if (rule->action == AlarmTable::ACTION_DIGITAL)
+				configShadow.NoteOutput(LJ_ioPUT_DIGITAL_BIT, rule->channel, rule->value != 0);
+			else if (rule->action == AlarmTable::ACTION_DAC)
+				configShadow.NoteOutput(LJ_ioPUT_DAC, rule->channel, rule->value);
+		}
+	}
+	LeaveCriticalSection(&handleLock);
+	writtenMs = Stopwatch::GetTimeMs();
+
+	if (error != LJE_NOERROR)
+		InterlockedExchange(&alarmError, error);
+
+	for (n = 0; n < numTrips; n++)
+	{
+		rule = alarms.GetRule(alarms.GetTrip(n));
+		alarms.Log(alarms.GetTrip(n), alarmScanIndex, scan[rule->source], detectedMs - alarmScanMs, writtenMs - detectedMs);
+	}
+
+	// Show the last alarm in DASYLab's status bar
+	_snprintf(measInfo.Message, sizeof(measInfo.Message) - 1, "Alarm %d", alarms.GetTrip(numTrips - 1));
+	measInfo.Message[sizeof(measInfo.Message) - 1] = '\0';
+}
+
+/**
+ * Name: ReadControlLoop(int index, ControlSettings * settings)
+ * Desc: (private) Reads loop index of [Control], for example for index 0:
+ *
+ *		 Input0=0				; DASYLab analog input measured
+ *		 Output0=0				; DAC driven; DASYLab writing it sets Setpoint0
+ *		 Setpoint0=1.0			; Initial setpoint (V)
+ *		 Kp0=1					; Proportional gain (V/V)
+ *		 Ki0=0					; Integral gain (1/s)
+ *		 Kd0=0					; Derivative gain (s)
+ *		 OutMin0=0				; Output limits (V), the DAC range by default
+ *		 OutMax0=5
+ * Retn: TRUE if the input is acquired and polled every tick
+**/
+bool LabJackLayer::ReadControlLoop(int index, ControlSettings * settings)
+{
+	const AnalogInputPlan * analogInputs = plan.GetAnalogInputs();
+	char key[16];
+	int i, channel;
+
+	sprintf(key, "Output%d", index);
+	settings->output = DriverSettings::GetInt("Control", key, index);
+	sprintf(key, "Setpoint%d", index);
+	settings->setpoint = DriverSettings::GetDouble("Control", key, 0);
+	sprintf(key, "Kp%d", index);
+	settings->kp = DriverSettings::GetDouble("Control", key, 1);
+	sprintf(key, "Ki%d", index);
+	settings->ki = DriverSettings::GetDouble("Control", key, 0);
+	sprintf(key, "Kd%d", index);
+	settings->kd = DriverSettings::GetDouble("Control", key, 0);
+	sprintf(key, "OutMin%d", index);
+	settings->outMin = DriverSettings::GetDouble("Control", key, model != NULL ? model->aoMinVolts : 0);
+	sprintf(key, "OutMax%d", index);
+	settings->outMax = DriverSettings::GetDouble("Control", key, model != NULL ? model->aoMaxVolts : 5);
+
+	sprintf(key, "Input%d", index);
+	channel = DriverSettings::GetInt("Control", key, 0);
+	for (i = 0; i < plan.GetNumAnalogInputs(); i++)
+	{
+		if (analogInputs[i].channel == channel && !analogInputs[i].slow)
+		{
+			settings->input = analogInputs[i].source;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/**
+ * Name: GetStreamCallbackScans()
+ * Desc: (private) Returns the scans the UD driver is asked to pass to each
+ *		 stream callback: one DASYLab block, times the oversampling factor
+ *		 so that oversampling does not make callbacks more frequent
+**/
+long LabJackLayer::GetStreamCallbackScans()
+{
+	long scans = plan.GetCallbackScans();
+
+	if (decimator.IsActive())
+		scans *= decimator.GetFactor();
+
+	return scans > 0 ? scans : 1;
+}
+
+/**
+ * Name: GetDeviceScanFrequency()
+ * Desc: (private) Returns the scan rate the device streams at: the
+ *		 requested one, or the nearest exact rate when resampling, times
+ *		 the oversampling factor
+**/
+double LabJackLayer::GetDeviceScanFrequency()
+{
+	double frequency = resampler.IsActive() ? resampler.GetInputRate() : GetScanFrequency();
+
+	if (decimator.IsActive())
+		frequency *= decimator.GetFactor();
+
+	return frequency;
+}
+
+/**
+ * Name: IsResampling()
+ * Desc: (private) Returns true if the requested rate is kept and resampled
+ *		 to instead of being rounded to a rate the device produces
+**/
+bool LabJackLayer::IsResampling()
+{
+	return DriverSettings::GetInt("Resampler", "Enabled", 0) != 0;
+}
+
+/**
+ * Name: GetRangeLimits(long udRange, double * minVolts, double * maxVolts)
+ * Desc: (private) Gets the input limits of a range, calibrated if the
+ *		 device's constants cover it and nominal otherwise
+ * Retn: TRUE if the range is known and FALSE otherwise
+**/
+bool LabJackLayer::GetRangeLimits(long udRange, double * minVolts, double * maxVolts)
+{
+	const InputRange * range;
+
+	if (calibration.GetRange(udRange, minVolts, maxVolts))
+		return TRUE;
+
+	range = DeviceModels::FindRange(udRange);
+	if (range == NULL || udRange == LJ_rgAUTO)
+		return FALSE;
+
+	*minVolts = range->minVolts;
+	*maxVolts = range->maxVolts;
+	return TRUE;
+}
+
+/**
+ * Name: GetOpenPhaseTime(int phase)
+ * Desc: Returns the milliseconds the last open spent in the given
+ *		 OPEN_PHASE_ or 0 for an unknown phase
+**/
+double LabJackLayer::GetOpenPhaseTime(int phase)
+{
+	if (phase < 0 || phase >= NUM_OPEN_PHASES)
+		return 0;
+	return openPhaseTimes[phase];
 }
 
 /**
- * Name: CalMaxAIValue(int channel)
- * Desc: Gets the calibrated max value for the given channel
+ * Name: ReadSerialNumber()
+ * Desc: (private) Reads the serial number of the device just opened so it
+ *		 can be found again regardless of local ID or enumeration order
 **/
-double LabJackLayer::CalMaxAIValue(int channel)
+void LabJackLayer::ReadSerialNumber()
 {
-	double posSlope, center;
-	long dasyLabRangeCode, ljRangeCode;
-	dasyLabRangeCode = infoStruct->GainInfo[infoStruct->AI_ChSetup[channel].GainCode];
-	ljRangeCode = ConvertToUDRange(dasyLabRangeCode);
-	posSlope = calConstants[posSlopeConstLocations[ljRangeCode]];
-	center = calConstants[centerConstLocations[ljRangeCode]];
+	double dblValue = 0;
 
-	return (MAX_BIT_VALUE - center) * posSlope;
+	serialNumber = 0;
+	if (open && eGet(lngHandle, LJ_ioGET_CONFIG, LJ_chSERIAL_NUMBER, &dblValue, 0) == LJE_NOERROR)
+		serialNumber = (long)dblValue;
 }
 
 /**
- * Name: CalMinAIValue(int channel)
- * Desc: Returns the calibrated min value for the given range
+ * Name: GetSerialNumber()
+ * Desc: Returns the serial number of the open device or 0 if unknown
 **/
-double LabJackLayer::CalMinAIValue(int channel)
+long LabJackLayer::GetSerialNumber()
 {
-	double negSlope, center;
-	long dasyLabRangeCode, ljRangeCode;
+	return serialNumber;
+}
 
-	dasyLabRangeCode = infoStruct->GainInfo[infoStruct->AI_ChSetup[channel].GainCode];
-	ljRangeCode = ConvertToUDRange(dasyLabRangeCode);
-	negSlope = calConstants[negSlopeConstLocations[ljRangeCode]];
-	center = calConstants[centerConstLocations[ljRangeCode]];
+/**
+ * Name: GetDeviceType()
+ * Desc: Returns the device type of the device currently
+ *		 in operation
+**/
+long LabJackLayer::GetDeviceType()
+{
+	return deviceType;
+}
 
-	return (center - MIN_BIT_VALUE) * negSlope;
+/**
+ * Name: IsUsingEthernet()
+ * Desc: Returns true if the device is in use through ethernet
+ *		 or false otherwise
+**/
+bool LabJackLayer::IsUsingEthernet()
+{
+	return isUsingEthernet;
 }
 
 /**
- * Name: MapCalConstants()
- * Desc: Loads the locations for various calibration constants
- *		 for the current device type.
+ * Name: ConfigureRange()
+ * Desc: Sets the range of every analog input in the scan list and the
+ *		 resolution, sending only what differs from the last configuration
+ *		 in one transaction along with anything else already required.
+ *		 Each failed setting is reported with its channel.
 **/
-//void LabJackLayer::MapCalConstants()
-//{
-//	// The following values map the ranges defined in the UD driver header
-//	// to the number of bytes from the starting byte (0) as returned from the
-//	// UD driver
-//	switch(deviceType)
-//	{
-//	case LJ_dtU3:
-//		break; // TODO: Support special range
-//
-//	case LJ_dtU6:
-//
-//		// Clear maps
-//		posSlopeConstLocations.clear();
-//		negSlopeConstLocations.clear();
-//		centerConstLocations.clear();
-//
-//		// Bipolar 10 V
-//		posSlopeConstLocations.insert(pair<long, long>(LJ_rgBIP10V, 0));
-//		negSlopeConstLocations.insert(pair<long, long>(LJ_rgBIP10V, 8));
-//		centerConstLocations.insert(pair<long, long>(LJ_rgBIP10V, 9));
-//		
-//		// Bipolar 1 V
-//		posSlopeConstLocations.insert(pair<long, long>(LJ_rgBIP1V, 3));
-//		negSlopeConstLocations.insert(pair<long, long>(LJ_rgBIP1V, 11));
-//		centerConstLocations.insert(pair<long, long>(LJ_rgBIP1V, 12));
-//		
-//		// Bipolar 100 mV
-//		posSlopeConstLocations.insert(pair<long, long>(LJ_rgBIPP1V, 5));
-//		negSlopeConstLocations.insert(pair<long, long>(LJ_rgBIPP1V, 13));
-//		centerConstLocations.insert(pair<long, long>(LJ_rgBIPP1V, 14));
-//		
-//		// Bipolar 10 mV
-//		posSlopeConstLocations.insert(pair<long, long>(LJ_rgBIPP01V, 7));
-//		negSlopeConstLocations.insert(pair<long, long>(LJ_rgBIPP01V, 15));
-//		centerConstLocations.insert(pair<long, long>(LJ_rgBIPP01V, 16));
-//		
-//		break;
-//	}
-//}
+void LabJackLayer::ConfigureRange()
+{
+	const AnalogInputPlan * analogInputs = plan.GetAnalogInputs();
+	ConfigChange * change;
+	CString message;
+	char err[255], line[300];
+	int n;
+
+	for (n=0; n < plan.GetNumAnalogInputs(); n++) 
+	{
+		if (autoRanger.IsEnabled(n))
+			configShadow.RequireRange(analogInputs[n].udChannel, autoRanger.GetRange(n));
+		else
+			configShadow.RequireRange(analogInputs[n].udChannel, analogInputs[n].udRange);
+	}
+
+	// Stream every analog input at the planned resolution. Polled reads
+	// use [CommandResponse] Resolution (0 for the device's default), set
+	// every time so they do not depend on what streamed last or on the
+	// device having been reset.
+	if (experimentStreaming)
+		configShadow.RequireResolution(streamRate != NULL ? streamRate->resolution : DEFAULT_STREAM_RESOLUTION);
+	else
+		configShadow.RequireResolution(DriverSettings::GetInt("CommandResponse", "Resolution", 0));
+
+	if (configShadow.Apply(lngHandle))
+		return;
+
+	message = "The LabJack could not be configured:\n";
+	for (n = 0; n < configShadow.GetNumChanges(); n++)
+	{
+		change = configShadow.GetChange(n);
+		if (change->error == LJE_NOERROR)
+			continue;
+
+		SetError(change->error);
+		ErrorToString(change->error, err);
+		if (change->ioType == LJ_ioPUT_AIN_RANGE)
+			sprintf(line, "\nAIN%ld range: %s", change->channel, err);
+		else if (change->ioType == LJ_ioPUT_DAC)
+			sprintf(line, "\nDAC%ld: %s", change->channel, err);
+		else if (change->ioType == LJ_ioPUT_DIGITAL_BIT)
+			sprintf(line, "\nDigital line %ld: %s", change->channel, err);
+		else
+			sprintf(line, "\nResolution: %s", err);
+		message += line;
+	}
+
+	// A modal box would stall the experiment; recover in the background instead
+	if (recovery.IsWatching())
+		recovery.RequestRecovery(GetError() - LABJACK_ERROR_PREFIX);
+	else
+		MessageBox (GetActiveWindow (), message, "LabJack Error", MB_OK | MB_ICONSTOP);
+}
 
 /**
- * Name: ConvertToUDRange(long dasyRange)
- * Desc: Converts a DASYLab range to a range code needed for the UD driver
+ * Name: GetGainRange(int gainIndex)
+ * Desc: Returns the range selected by the given GainInfo entry or NULL
+ *		 if the model has no such gain
 **/
-long LabJackLayer::ConvertToUDRange(long dasyRange)
+const InputRange * LabJackLayer::GetGainRange(int gainIndex)
 {
-	return dasyLJGainCodes[dasyRange];
+	if (model == NULL || gainIndex < 0 || gainIndex >= model->numGains)
+		return NULL;
+
+	return DeviceModels::FindRange(model->gains[gainIndex].udRange);
 }
 
 /**
@@ -1434,4 +3022,81 @@ int LabJackLayer::GetDeviceID()
 		return localID;
 	else
 		return NULL;
-}
\ No newline at end of file
+}
+
+/**
+ * Name: SetRegistryIndex(int index)
+ * Desc: Records the position of this device in the DeviceRegistry so
+ *		 that stream callbacks can be routed back to it
+**/
+void LabJackLayer::SetRegistryIndex(int index)
+{
+	registryIndex = index;
+}
+
+/**
+ * Name: SetInfoStruct(DRV_INFOSTRUCT * structAddress)
+ * Desc: Switches the information structure this device reads and fills,
+ *		 only while it is not acquiring
+**/
+void LabJackLayer::SetInfoStruct(DRV_INFOSTRUCT * structAddress)
+{
+	infoStruct = structAddress;
+}
+
+/**
+ * Name: SetScanSink(ScanQueue * sink)
+ * Desc: Sends acquired scans to the given queue instead of DASYLab's
+ *		 buffer, or back to DASYLab's buffer if sink is NULL
+**/
+void LabJackLayer::SetScanSink(ScanQueue * sink)
+{
+	scanSink = sink;
+}
+
+/**
+ * Name: SetScanFrequency(double newScanFrequency)
+ * Desc: Fixes the stream scan rate, or derives it from AI_Frequency
+ *		 again if newScanFrequency is 0
+**/
+void LabJackLayer::SetScanFrequency(double newScanFrequency)
+{
+	scanFrequency = newScanFrequency;
+}
+
+/**
+ * Name: SetOwnedChannels(int numChannels)
+ * Desc: Limits this device to the first numChannels DASYLab AI channels
+ *		 of its information structure
+**/
+void LabJackLayer::SetOwnedChannels(int numChannels)
+{
+	numOwnedChannels = numChannels;
+}
+
+/**
+ * Name: GetOwnedChannels()
+ * Desc: Returns the number of DASYLab AI channels that belong to this device
+**/
+int LabJackLayer::GetOwnedChannels()
+{
+	return numOwnedChannels;
+}
+
+/**
+ * Name: GetNumAINRequested()
+ * Desc: Returns the number of analog inputs in each scan
+**/
+int LabJackLayer::GetNumAINRequested()
+{
+	return plan.GetNumAnalogInputs();
+}
+
+/**
+ * Name: GetNumDIRequested()
+ * Desc: Returns the number of digital inputs in each scan
+**/
+int LabJackLayer::GetNumDIRequested()
+{
+	return plan.GetNumDigitalInputs();
+}
@@ -24,11 +24,29 @@
 #include <windows.h>
 #include <windowsx.h>
 #include <mmsystem.h>
-#include <map>
+#include <vector>
 
 //	DASYLab driver interface
 #include "treiber.h"
 
+// Application
+#include "ScanQueue.h"
+#include "StreamRecovery.h"
+#include "CalibrationCache.h"
+#include "DeviceConfigShadow.h"
+#include "AutoRanger.h"
+#include "ExperimentPlan.h"
+#include "ChannelTable.h"
+#include "Resampler.h"
+#include "Decimator.h"
+#include "SlowInputs.h"
+#include "CaptureWindow.h"
+#include "TriggerEngine.h"
+#include "BurstCapture.h"
+#include "ControlLoop.h"
+#include "AlarmTable.h"
+#include "DeviceModel.h"
+
 /**
  * Name: LabJackLayer
  * Desc: Class to abstract and manage control of LabJack and its communication
@@ -39,20 +57,25 @@
 
 using namespace std;
 
-typedef std::map <long, int> calMapType;
-
 class LabJackLayer {
 		
 		// Constants
 		const static int START_STREAM_FREQUENCY = 100;	// Start streaming at 100 Hz
-		const static int HV_CHANNELS = 4;
-		const static int MAX_SCANS_PER_SECOND = 50000;
+		const static int MAX_SCANS_PER_SECOND = 50000;	// Stream limit of a model without a table
+		const static long DEFAULT_STREAM_RESOLUTION = 12;	// Resolution streamed by a model without a table
 		const static DWORD DEFAULT_BUFFER_SIZE = 4096;	// Default buffer size (bytes)
 		const static int ANALOG = 1;
 		const static int DIGITAL = 2;
 		const static int MAX_BIT_VALUE = 65534;
 		const static int MIN_BIT_VALUE = 0;
 		const static int CHANNEL_RESOLUTION = 32768;
+		const static int ETHERNET_TIMEOUT = 2000;		// UE9 ethernet communication timeout (ms)
+		const static int AUTO_RANGE_HOLD = 2000;		// Default time a narrower range must fit before auto-ranging to it (ms)
+		const static int MAX_OVERSAMPLING = 16;			// Default largest oversampling factor
+		const static int TAPS_PER_FACTOR = 8;			// Default decimation filter length per unit of the factor
+		const static UINT TIMER_RESOLUTION = 10;		// Command-response timer accuracy (ms)
+		const static UINT CONTROL_TIMER_RESOLUTION = 1;	// Timer accuracy while control loops run (ms)
+		const static long STREAM_READ_CALLBACKS = 2;	// Callbacks of scans streamData holds
 
 		// Instance variables
 		DWORD aoStoreIndex;								// The index of the next available position for analog ouput in
@@ -80,6 +103,21 @@ class LabJackLayer {
 		int aoCounter;									// Number of analog output values sent
 		int doCounter;									// Number of digital values sent
 		int maxBlocks;
+		DWORD windowBlocksRead;							// Blocks of the current capture window DASYLab has read
+		CaptureWindow captureWindow;					// Gates the FIFO into windows in block mode
+		TriggerEngine trigger;							// Forwards only the scans around trigger events
+		BurstCapture burst;								// Holds a stop-after-N experiment until DASYLab takes it
+		LPSAMPLE burstBufferAdr;						// Locked memory of the burst capture
+		DWORD burstBufferSize;							// Samples burstBufferAdr holds
+		std::vector<ControlLoop> loops;					// Control loops run in the command-response tick
+		std::vector<ControlSettings> controlSettings;	// Loops of [Control] with an acquired input, read with the plan
+		LoopTiming controlTiming;						// Latency and jitter of the control tick
+		AlarmTable alarms;								// Limit rules checked on every scan
+		unsigned long alarmScanIndex;					// Scans checked against the alarms this experiment
+		double alarmScanMs;								// When the scan being checked was acquired
+		volatile LONG alarmError;						// Failed interlock write, reported on DASYLab's thread
+		double streamStartMs;							// When the stream was started, the time of its first scan
+		unsigned long streamScansRead;					// Device scans read since the stream started
 		DWORD doStartDelay;								// How long to wait (ms?) before starting digital output
 		DWORD nSamples;									// Number of samples in buffer (taken from exmaple, still needed?)
 		DWORD maxRamSize;
@@ -90,29 +128,52 @@ class LabJackLayer {
 		int doCount;									// Number of digital output values written
 		DWORD startTime;								// Starting time of DASYLab experiment
 		bool isStreaming;								// Indicates if we are streaming (TRUE) or using command-response (FALSE)
-		int numAINRequested;							// The number of analog input channels we are polling/streaming
-		int numDIRequested;								// The number of digital input channels we are polling/streaming
 		int smallestChannel;							// The lowest channel number that we are polling/streaming
-		int analogInputScanList[32];					// list of analog channel numbers to acquire
-		int digitalInputScanList[32];					// list of digital channel numbers to acquire
 		int smallestChannelType;						// ANALOG or DIGITAL
 														// TODO: This ought to be an enumerated type :)
-		double calConstants[64];
 		short GAIN_INFO[8];								// TODO: Need config
 		UINT hTimerID;									// TODO: This might need to be static?
-		calMapType posSlopeConstLocations;				// Maps LabJack range values to their locations in the cal constants
-		calMapType negSlopeConstLocations;	
-		calMapType centerConstLocations;
-		calMapType dasyLJGainCodes;						// Maps a DASYLab "real gain" to the gain code used by the UD driver
+		UINT timerResolution;							// Accuracy the timer was installed with (ms)
 		//double debugValue;
 		//ofstream debugFile;
 		int localID;									// The local id of the device that this LabJackLayer wraps
+		long serialNumber;								// Serial number of the open device or 0 if unknown
+		double openPhaseTimes[5];						// Milliseconds spent in each OPEN_PHASE_ of the last open
+		CalibrationCache calibration;					// Calibration constants of the open device
+		DeviceConfigShadow configShadow;				// Settings already made on the open device
+		AutoRanger autoRanger;							// Chooses the range of auto-ranged analog inputs
+		bool rangesPending;								// The auto-ranger chose ranges not yet in effect
+		ExperimentPlan plan;							// Experiment compiled from DASYLab's structure by ConfirmDataStructure
+		ChannelTable channels;							// Conversion of each value of a scan, built from the plan
+		std::vector<double> polledScan;					// Command-response readings laid out like a device scan
+		std::vector<double> deviceScan;					// Stream scan followed by the slow input values
+		std::vector<double> streamData;					// Scans read from the UD stream buffer
+		long streamDataScans;							// Scans streamData holds
+		SlowInputs slowInputs;							// Latest values of the inputs read at the slowdown rate
+		double coldJunctionOffset;						// Added to the internal temperature sensor for the cold junction (C)
 		CString ipAddress;								// The IP address of a UE device opened, if applicable. null otherise
 		bool isUsingEthernet;							// Indicates if the device is connected by ethernet
+		int numOwnedChannels;							// Number of DASYLab AI channels (from 0) that belong to this device
+		const DeviceModel * model;						// Table of the open model or NULL
+		const StreamRate * streamRate;					// Stream setting planned for the running experiment or NULL
+		bool negotiateFrequency;						// ConfirmDataStructure rounds AI_Frequency to an exact stream rate
+		Decimator decimator;							// Filters oversampled stream scans down to the requested rate
+		Resampler resampler;							// Converts stream scans to the requested rate when it is not exact
+		double filterMs;								// Time spent in the stream callback while a filter ran
+		DWORD filteredScans;							// Scans delivered while a filter ran
+		int registryIndex;								// Position of this device in the DeviceRegistry (passed to callbacks)
+		ScanQueue * scanSink;							// When set, scans go here for merging instead of into DASYLab's buffer
+		double scanFrequency;							// Scan rate set by the DeviceRegistry or 0 to derive it from AI_Frequency
+		bool experimentStreaming;						// The running experiment streams (TRUE) or uses command-response (FALSE)
+		StreamRecovery recovery;						// Watchdog that reopens the device if acquisition fails
+		CRITICAL_SECTION handleLock;					// Held while lngHandle is replaced, polled by the timer or written to, and around the loop setpoints
+		double startLatency;							// Milliseconds from configuring to running in the last BeginExperiment
+		DWORD warmStarts;								// Streams started without reconfiguring the device
+		DWORD coldStarts;								// Streams started after a full configuration
 
 	public:
 		LabJackLayer(DRV_INFOSTRUCT * structAddress);
-		//~LabJackLayer(void);
+		~LabJackLayer();
 		void AdvanceInputBuf();
 		void AdvanceAnalogOutputBuf();
 		void AdvanceDigitalOutputBuf();
@@ -123,15 +184,19 @@ class LabJackLayer {
 		LPSAMPLE GetInputBuf();
 		bool GetInputStatus();
 		DRV_MEASINFO * GetMeasInfo();
+		void ReportDataLost();
 		bool IsOpen();
 		long GetError();
 		void CleanUp();
+		void Release();
 		void AllocateAOBuffer(UDWORD nSamples);
 		void SetDigitalOutputBufferMode(DWORD numSamples, DWORD startDelay);
 		bool AllocateInputBuffer(DWORD size);
 		bool IsMeasuring();
+		bool HasReachedMaxBlocks();
 		void SetDeviceType(int type);
 		void BeginExperiment();
+		void BeginExperiment(bool useStreaming);
 		void StopExperiment();
 		bool ConfirmDataStructure();
 		void StreamCallback(long scansAvailable, double userValue);
@@ -145,38 +210,90 @@ class LabJackLayer {
 		long GetDeviceType();
 		bool IsUsingEthernet();
 		void OpenEthernetDevice(long newDeviceType, CString value);
-		long ConvertToUDRange(long dasyLabRangeCode);
+		void OpenDeviceBySerial(long newDeviceType, long serial);
+		const InputRange * GetGainRange(int gainIndex);
 		CString GetIPAddress();
 		int GetDeviceID();
+		long GetSerialNumber();
+		void SetRegistryIndex(int index);
+		void SetInfoStruct(DRV_INFOSTRUCT * structAddress);
+		void SetScanSink(ScanQueue * sink);
+		bool NegotiateFrequency(int numScanChannels);
+		void FillFrequencyList(int numScanChannels);
+		void SetFrequencyNegotiation(bool enabled);
+		void SetScanFrequency(double newScanFrequency);
+		void SetOwnedChannels(int numChannels);
+		int GetOwnedChannels();
+		int GetNumAINRequested();
+		int GetNumDIRequested();
+		void WriteInputScan(const SAMPLE * values, int numValues);
+		bool AcceptCaptureScan(int numValues);
+		bool RestartAcquisition();
+		double GetStartLatency();
+
+		double GetOpenPhaseTime(int phase);
 
 		// Public constants
 		const static int LABJACK_ERROR_PREFIX = 5000;	// Starting error number so that DASYLab does
 														// not confuse LabJack errors with its internal
 														// errors
+		const static int OPEN_PHASE_CONNECT = 0;		// OpenLabJack
+		const static int OPEN_PHASE_BUFFER = 1;			// AllocateInputBuffer
+		const static int OPEN_PHASE_SERIAL = 2;			// ReadSerialNumber
+		const static int OPEN_PHASE_CALIBRATION = 3;	// CalibrationCache::Load
+		const static int OPEN_PHASE_INFO = 4;			// FillInfoStructure, including U3 HV detection
+		const static int NUM_OPEN_PHASES = 5;
 
 	private:
 		void FillInfoStructure();
-		void FillU3Info();
-		void FillU6Info();
-		void FillUE9Info();
+		void ReadSerialNumber();
+		void FinishOpen(long newDeviceType);
 		void KillBuffer(LPSAMPLE & addr);
 		void ErrorHandler(long lngErrorcode);
-		bool IsRequestingAIN(int channel);
-		bool IsRequestingDI(int channel);
-		SAMPLE ConvertAIValue(double value, UINT channel);
+		void CompilePlan();
+		void ApplyCalibratedLimits();
+		void ApplyThermocoupleLimits();
 		void FreeLockedMem (LPSAMPLE bufferadr);
 		LPSAMPLE AllocLockedMem (DWORD nSamples, DRV_INFOSTRUCT * infoStruct);
-		bool CheckBitHigh(double value, int position);
 		void StartStreaming();
 		void StartCommandResponse();
-		bool InstallTimerInterruptHandler();
+		bool InstallTimerInterruptHandler(UINT period);
 		void RemoveTimerInterruptHandler();
 		void AddToInputBuffer(SAMPLE newValue);
 		void AddToInputBuffer(SAMPLE * newValue);
+		void StoreInFifo(SAMPLE newValue);
+		int GetNumStreamChannels();
+		double GetScanFrequency();
 		double ConvertAOValue(DWORD value, UINT channel);
 		void ConfigureRange();
-		//void MapCalConstants();
-		double CalMaxAIValue(int channel);
-		double CalMinAIValue(int channel);
+		void SetupAutoRange();
+		void ApplyAutoRanges();
+		void RestoreAutoRangeLimits();
+		void SetupResampler();
+		void SetupDecimator();
+		void SetupTrigger();
+		void SetupBurst();
+		void DrainBurst();
+		void SetupControl();
+		bool ReadControlLoop(int index, ControlSettings * settings);
+		bool IsControlEnabled();
+		bool HasControlLoops();
+		void ReadControlLoops();
+		UINT GetTickPeriod();
+		void SetupAlarms();
+		bool ReadAlarmRule(int index, AlarmRule * rule);
+		void RespondToAlarms(const double * scan, int numTrips);
+		void StoreScan(const SAMPLE * samples, int numSamples);
+		bool ReadTriggerCondition(int index, TriggerCondition * condition);
+		void ReadSlowChannels(WORD * slowChannels);
+		void ReadThermocouples(char * types);
+		void DeliverScan(const double * scan);
+		bool UpdateSlowInputs(const double * scan);
+		void UpdateColdJunction();
+		void PollSlowInputs();
+		long GetStreamCallbackScans();
+		double GetDeviceScanFrequency();
+		bool IsResampling();
+		bool GetRangeLimits(long udRange, double * minVolts, double * maxVolts);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,280 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: Resampler.cpp
+ * Desc: Fractional rate conversion of stream scans
+ * Note: Built without the precompiled header so that it stays portable
+**/
+
+// Compiler
+#include <math.h>
+
+// Class header file
+#include "Resampler.h"
+
+// Application
+#include "FirMath.h"
+
+/** Quality tiers, indexed by QUALITY_ **/
+static const ResamplerQuality QUALITIES[] = {
+	{ 8, 64, 0.75, 0.4 },						// QUALITY_FAST
+	{ 16, 128, 0.85, 0.6 },						// QUALITY_NORMAL
+	{ 32, 256, 0.9, 0.75 }						// QUALITY_BEST
+};
+static const int NUM_QUALITIES = sizeof(QUALITIES) / sizeof(QUALITIES[0]);
+
+/** Frequencies checked per phase by GetPassbandError **/
+static const int PASSBAND_POINTS = 32;
+
+static const double PI = 3.14159265358979323846;
+
+/**
+ * Name: Resampler()
+ * Desc: Creates an inactive resampler
+**/
+Resampler::Resampler()
+{
+	active = false;
+	numFiltered = 0;
+	numHeld = 0;
+	inputRate = 0;
+	outputRate = 0;
+	step = 1;
+	quality = QUALITIES[QUALITY_NORMAL];
+	half = quality.taps / 2;
+	writeIndex = 0;
+	position = 0;
+	primed = false;
+}
+
+/**
+ * Name: Configure(int filtered, int held, double newInputRate,
+ *				   double newOutputRate, int tier)
+ * Desc: Starts converting scans of filtered interpolated channels followed
+ *		 by held channels from newInputRate to newOutputRate (Hz) with the
+ *		 filters of the given QUALITY_ tier. Everything is allocated here,
+ *		 nothing while scans are converted.
+**/
+void Resampler::Configure(int filtered, int held, double newInputRate, double newOutputRate, int tier)
+{
+	if (tier < 0 || tier >= NUM_QUALITIES)
+		tier = QUALITY_NORMAL;
+
+	numFiltered = filtered;
+	numHeld = held;
+	inputRate = newInputRate;
+	outputRate = newOutputRate;
+	step = inputRate / outputRate;
+	quality = QUALITIES[tier];
+	half = quality.taps / 2;
+
+	BuildBank();
+	history.assign(numFiltered * 2 * quality.taps, 0.0f);
+	heldHistory.assign(numHeld * 2 * quality.taps, 0.0);
+	output.assign(numFiltered + numHeld > 0 ? numFiltered + numHeld : 1, 0.0);
+	writeIndex = 0;
+	position = 0;
+	primed = false;
+	active = true;
+}
+
+/**
+ * Name: BuildBank()
+ * Desc: (private) Computes the Blackman windowed sinc filter of every
+ *		 fractional position. Filter p produces the output p / phases of an
+ *		 input scan after the window's middle; each is scaled to unity gain
+ *		 at DC so a constant input comes out unchanged.
+**/
+void Resampler::BuildBank()
+{
+	double cutoff, distance, value, sum;
+	int p, j;
+	float * filter;
+
+	// Cycles per input scan at the -6 dB point, below both Nyquist rates
+	cutoff = 0.5 * quality.cutoff * (step > 1 ? 1 / step : 1);
+
+	bank.resize((quality.phases + 1) * quality.taps);
+	for (p = 0; p <= quality.phases; p++)
+	{
+		filter = &bank[p * quality.taps];
+		sum = 0;
+		for (j = 0; j < quality.taps; j++)
+		{
+			distance = j - half + 1 - (double)p / quality.phases;
+			value = FirMath::WindowedSinc(cutoff, distance, quality.taps);
+			filter[j] = (float)value;
+			sum += value;
+		}
+
+		for (j = 0; j < quality.taps; j++)
+			filter[j] = (float)(filter[j] / sum);
+	}
+}
+
+/**
+ * Name: Disable()
+ * Desc: Stops resampling; scans then go straight to conversion
+**/
+void Resampler::Disable()
+{
+	active = false;
+}
+
+/**
+ * Name: IsActive()
+ * Desc: Returns true between Configure and Disable
+**/
+bool Resampler::IsActive()
+{
+	return active;
+}
+
+/**
+ * Name: Push(const double * scan)
+ * Desc: Adds the next input scan. Call Pop until it returns NULL before
+ *		 pushing the next one. The first scan fills the whole window so the
+ *		 output starts without a transient.
+**/
+void Resampler::Push(const double * scan)
+{
+	int taps = quality.taps;
+	int c, n, fill;
+	float * filtered;
+	double * held;
+
+	fill = primed ? 1 : taps;
+	for (n = 0; n < fill; n++)
+	{
+		for (c = 0; c < numFiltered; c++)
+		{
+			filtered = &history[c * 2 * taps];
+			filtered[writeIndex] = filtered[writeIndex + taps] = (float)scan[c];
+		}
+		for (c = 0; c < numHeld; c++)
+		{
+			held = &heldHistory[c * 2 * taps];
+			held[writeIndex] = held[writeIndex + taps] = scan[numFiltered + c];
+		}
+		writeIndex = (writeIndex + 1) % taps;
+	}
+
+	// Outputs are due once their window reaches the newest input
+	if (primed)
+		position -= 1;
+	else
+		position = -half;
+	primed = true;
+}
+
+/**
+ * Name: Pop()
+ * Desc: Returns the next output scan if the inputs pushed so far cover it
+ * Retn: The numFiltered + numHeld values of the scan, valid until the next
+ *		 call, or NULL if another input is needed
+**/
+const double * Resampler::Pop()
+{
+	int taps = quality.taps;
+	double whole, fraction;
+	int c, phase, nearest;
+
+	if (!primed || position >= -half + 1)
+		return NULL;
+
+	// position is in [-half, -half + 1): the window is the whole history
+	whole = floor(position);
+	fraction = position - whole;
+	phase = (int)(fraction * quality.phases + 0.5);
+
+	for (c = 0; c < numFiltered; c++)
+		output[c] = FirMath::DotProduct(&history[c * 2 * taps + writeIndex], &bank[phase * taps], taps);
+
+	nearest = taps - 1 - half + (fraction >= 0.5 ? 1 : 0);
+	for (c = 0; c < numHeld; c++)
+		output[numFiltered + c] = heldHistory[c * 2 * taps + writeIndex + nearest];
+
+	position += step;
+	return &output[0];
+}
+
+/**
+ * Name: GetInputRate()
+ * Desc: Returns the rate scans are pushed at (Hz)
+**/
+double Resampler::GetInputRate()
+{
+	return inputRate;
+}
+
+/**
+ * Name: GetOutputRate()
+ * Desc: Returns the rate scans are returned at (Hz)
+**/
+double Resampler::GetOutputRate()
+{
+	return outputRate;
+}
+
+/**
+ * Name: GetTaps()
+ * Desc: Returns the filter length of the configured tier
+**/
+int Resampler::GetTaps()
+{
+	return quality.taps;
+}
+
+/**
+ * Name: GetLatencyMs()
+ * Desc: Returns how far an output lags its newest input (ms)
+**/
+double Resampler::GetLatencyMs()
+{
+	return inputRate > 0 ? half * 1000.0 / inputRate : 0;
+}
+
+/**
+ * Name: GetPassbandError()
+ * Desc: Returns the largest deviation of any filter of the bank from an
+ *		 ideal fractional delay over the passband, as a fraction of the
+ *		 signal (0.001 = 0.1%). Includes ripple, droop and the error of
+ *		 rounding the position to the nearest phase.
+**/
+double Resampler::GetPassbandError()
+{
+	double edge, frequency, distance, re, im, error, worst;
+	int p, j, k;
+
+	if (!active)
+		return 0;
+
+	edge = 0.5 * quality.passband * (step > 1 ? 1 / step : 1);
+
+	worst = 0;
+	for (p = 0; p < quality.phases; p++)
+	{
+		for (k = 0; k <= PASSBAND_POINTS; k++)
+		{
+			frequency = edge * k / PASSBAND_POINTS;
+
+			// Response relative to the exact position, half a phase off
+			// at worst, which the ideal filter would delay by 0
+			re = 0;
+			im = 0;
+			for (j = 0; j < quality.taps; j++)
+			{
+				distance = j - half + 1 - (p + 0.5) / quality.phases;
+				re += bank[p * quality.taps + j] * cos(2 * PI * frequency * distance);
+				im -= bank[p * quality.taps + j] * sin(2 * PI * frequency * distance);
+			}
+
+			error = sqrt((re - 1) * (re - 1) + im * im);
+			if (error > worst)
+				worst = error;
+		}
+	}
+
+	return worst;
+}
@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: Resampler.h
+ * Desc: Header file for Resampler object class
+**/
+
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+//	Compiler
+#include <vector>
+
+/**
+ * Name: ResamplerQuality
+ * Desc: Filter size of one quality tier. More taps give a flatter and
+ *		 wider passband at the cost of latency and CPU time.
+**/
+struct ResamplerQuality {
+	int taps;										// Input samples per output sample, multiple of 4
+	int phases;										// Fractional positions in the filter bank
+	double cutoff;									// -6 dB point, fraction of the lower Nyquist rate
+	double passband;								// Edge of the passband, fraction of the lower Nyquist rate
+};
+
+/**
+ * Name: Resampler
+ * Desc: Converts scans from the rate the device streams at to exactly the
+ *		 rate DASYLab asked for. Each output is a windowed sinc interpolation
+ *		 of the inputs around it, with the filter of its fractional
+ *		 position taken from a bank computed in Configure, so the inner loop
+ *		 is one dot product per channel. Channels that must not be
+ *		 filtered, like the state word of the digital lines, follow the
+ *		 nearest input scan.
+ *
+ *		 The class has no Windows or DASYLab dependencies and is not thread
+ *		 safe, so it can be exercised off target.
+**/
+class Resampler {
+
+		// Instance variables
+		bool active;
+		int numFiltered;								// Leading channels of a scan that are interpolated
+		int numHeld;									// Trailing channels that follow the nearest scan
+		double inputRate;								// Device scan rate (Hz)
+		double outputRate;								// Scan rate delivered (Hz)
+		double step;									// Input scans per output scan
+		ResamplerQuality quality;
+		int half;										// quality.taps / 2
+		std::vector<float> bank;						// (phases + 1) filters of quality.taps coefficients
+		std::vector<float> history;						// Last taps inputs of each filtered channel, stored twice
+		std::vector<double> heldHistory;				// Last taps inputs of each held channel, stored twice
+		int writeIndex;									// Next slot of the histories; the window starts here
+		double position;								// Time of the next output in input scans, 0 = newest input
+		bool primed;									// An input was pushed since Configure
+		std::vector<double> output;						// The last scan returned by Pop
+
+	public:
+		const static int QUALITY_FAST = 0;
+		const static int QUALITY_NORMAL = 1;
+		const static int QUALITY_BEST = 2;
+
+		Resampler();
+		void Configure(int filtered, int held, double newInputRate, double newOutputRate, int tier);
+		void Disable();
+		bool IsActive();
+		void Push(const double * scan);
+		const double * Pop();
+		double GetInputRate();
+		double GetOutputRate();
+		int GetTaps();
+		double GetLatencyMs();
+		double GetPassbandError();
+
+	private:
+		void BuildBank();
+};
+#endif
@@ -0,0 +1,302 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: ScanAligner.cpp
+ * Desc: Host time base alignment of scans from several free running devices
+ * Note: Built without the precompiled header so that it stays portable
+**/
+
+// Compiler
+#include <math.h>
+
+// Class header file
+#include "ScanAligner.h"
+
+/** Filter settings **/
+static const double OFFSET_GAIN = 0.005;		// Fraction of the timing error applied to the offset
+static const double PERIOD_GAIN = 0.0000125;	// Fraction of the timing error applied to the period
+static const double MAX_DRIFT = 0.001;			// Largest believable clock error (1000 ppm)
+static const double MAX_LAG_MS = 500;			// Longest wait for a silent device before inserting (ms)
+static const double RELOCK_MS = 250;			// Timing error treated as a stall rather than drift (ms)
+static const double EARLY_WEIGHT = 16;			// Gain multiplier for batches arriving earlier than predicted
+static const double SLIP_PERIODS = 0.75;		// Misalignment (in scans) that makes a device slip a scan
+
+/**
+ * Name: ScanAligner()
+ * Desc: Creates an aligner for a single device. Reset must be called
+ *		 before each experiment.
+**/
+ScanAligner::ScanAligner()
+{
+	Reset(1, 1);
+}
+
+/**
+ * Name: Reset(int devices, double scanRate)
+ * Desc: Forgets every clock estimate and counter and sets the number of
+ *		 devices and their common nominal scan rate (Hz)
+**/
+void ScanAligner::Reset(int devices, double scanRate)
+{
+	int n;
+
+	numDevices = devices < MAX_DEVICES ? devices : MAX_DEVICES;
+	nominalPeriod = scanRate > 0 ? 1000.0 / scanRate : 1000.0;
+	minLagScans = MAX_LAG_MS / nominalPeriod;
+	if (minLagScans < 1)
+		minLagScans = 1;
+
+	for (n = 0; n < MAX_DEVICES; n++)
+	{
+		locked[n] = false;
+		refIndex[n] = 0;
+		refTime[n] = 0;
+		period[n] = nominalPeriod;
+		producedScans[n] = 0;
+		consumedScans[n] = 0;
+		maxBatch[n] = 0;
+		batches[n] = 0;
+		insertedScans[n] = 0;
+		droppedScans[n] = 0;
+		relocks[n] = 0;
+	}
+}
+
+/**
+ * Name: AddBatch(int device, long numScans, double hostTime)
+ * Desc: Stamps a batch of numScans scans that arrived at hostTime (ms). The
+ *		 last scan of the batch is taken to have been acquired at hostTime;
+ *		 the error against the prediction corrects the device's offset and
+ *		 period. A large error (a stalled or restarted stream) restarts the
+ *		 estimate from this batch.
+**/
+void ScanAligner::AddBatch(int device, long numScans, double hostTime)
+{
+	double lastIndex, predicted, error, span, relockLimit;
+	double offsetGain, periodGain;
+	bool settled;
+
+	if (device < 0 || device >= numDevices || numScans <= 0)
+		return;
+
+	producedScans[device] += numScans;
+	lastIndex = producedScans[device] - 1;
+	if (numScans > maxBatch[device])
+		maxBatch[device] = numScans;
+
+	if (!locked[device])
+	{
+		refIndex[device] = lastIndex;
+		refTime[device] = hostTime;
+		period[device] = nominalPeriod;
+		locked[device] = true;
+		batches[device] = 1;
+		return;
+	}
+
+	span = lastIndex - refIndex[device];
+	predicted = refTime[device] + span * period[device];
+	error = hostTime - predicted;
+
+	relockLimit = nominalPeriod * maxBatch[device];
+	if (relockLimit < RELOCK_MS)
+		relockLimit = RELOCK_MS;
+
+	if (fabs(error) > relockLimit)
+	{
+		refIndex[device] = lastIndex;
+		refTime[device] = hostTime;
+		batches[device] = 1;
+		relocks[device]++;
+		return;
+	}
+
+	// Start with the gains of a least squares fit over the batches so far and
+	// settle on the steady state gains once they are smaller
+	batches[device]++;
+	offsetGain = 2.0 * (2 * batches[device] - 1) / (batches[device] * (batches[device] + 1.0));
+	periodGain = 6.0 / (batches[device] * (batches[device] + 1.0));
+	if (offsetGain < OFFSET_GAIN)
+		offsetGain = OFFSET_GAIN;
+	if (periodGain < PERIOD_GAIN)
+		periodGain = PERIOD_GAIN;
+
+	// Batches only ever arrive late, so once settled track the early edge
+	// of the arrival times: early errors pull harder than late ones. While
+	// the fit is still converging both sides weigh the same, or a drifting
+	// device's late errors are ignored and its estimate falls behind.
+	settled = offsetGain <= OFFSET_GAIN;
+	if (settled && error < 0)
+	{
+		offsetGain *= EARLY_WEIGHT;
+		periodGain *= EARLY_WEIGHT;
+	}
+	else if (settled)
+	{
+		offsetGain /= EARLY_WEIGHT;
+		periodGain /= EARLY_WEIGHT;
+	}
+	if (offsetGain > 1)
+		offsetGain = 1;
+	if (periodGain > 1)
+		periodGain = 1;
+
+	refTime[device] = predicted + offsetGain * error;
+	refIndex[device] = lastIndex;
+	period[device] += periodGain * error / span;
+
+	// Arrival jitter must never pull the period beyond what a crystal can do
+	if (period[device] > nominalPeriod * (1 + MAX_DRIFT))
+		period[device] = nominalPeriod * (1 + MAX_DRIFT);
+	else if (period[device] < nominalPeriod * (1 - MAX_DRIFT))
+		period[device] = nominalPeriod * (1 - MAX_DRIFT);
+}
+
+/**
+ * Name: Align(int device, int reference, long available, long referenceAvailable)
+ * Desc: Decides what the device contributes to the reference device's next
+ *		 scan. available and referenceAvailable are the scans each has
+ *		 waiting. A device that has fallen silent is only waited for while
+ *		 the reference has less than GetMaxLag scans queued, which bounds
+ *		 the buffering.
+ * Retn: One of the ALIGN_ constants
+**/
+int ScanAligner::Align(int device, int reference, long available, long referenceAvailable)
+{
+	double difference;
+
+	if (device == reference)
+		return ALIGN_USE;
+
+	if (available <= 0 || !locked[device])
+	{
+		if (referenceAvailable > GetMaxLag(device, reference))
+			return ALIGN_INSERT;
+		return ALIGN_WAIT;
+	}
+
+	difference = GetScanTime(device, consumedScans[device]) -
+				 GetScanTime(reference, consumedScans[reference]);
+
+	// The band is wider than one scan so that after a slip the device is
+	// well inside it and timing noise cannot make it slip straight back
+	if (difference < -SLIP_PERIODS * nominalPeriod)
+		return ALIGN_DROP;
+	if (difference > SLIP_PERIODS * nominalPeriod)
+		return ALIGN_INSERT;
+	return ALIGN_USE;
+}
+
+/**
+ * Name: Commit(int device, int action)
+ * Desc: Records that the caller carried out the action Align returned
+**/
+void ScanAligner::Commit(int device, int action)
+{
+	if (device < 0 || device >= numDevices)
+		return;
+
+	switch (action)
+	{
+	case ALIGN_USE:
+		consumedScans[device]++;
+		break;
+	case ALIGN_DROP:
+		consumedScans[device]++;
+		droppedScans[device]++;
+		break;
+	case ALIGN_INSERT:
+		insertedScans[device]++;
+		break;
+	}
+}
+
+/**
+ * Name: GetScanTime(int device, double scanIndex)
+ * Desc: Returns the estimated host time (ms) at which the device acquired
+ *		 the given scan
+**/
+double ScanAligner::GetScanTime(int device, double scanIndex)
+{
+	return refTime[device] + (scanIndex - refIndex[device]) * period[device];
+}
+
+/**
+ * Name: GetOffset(int device, int reference)
+ * Desc: Returns how much later (ms) the device's first scan was acquired
+ *		 than the reference device's first scan
+**/
+double ScanAligner::GetOffset(int device, int reference)
+{
+	return GetScanTime(device, 0) - GetScanTime(reference, 0);
+}
+
+/**
+ * Name: GetDrift(int device, int reference)
+ * Desc: Returns how much slower the device's clock runs than the reference
+ *		 device's clock in parts per million
+**/
+double ScanAligner::GetDrift(int device, int reference)
+{
+	return ( period[device] / period[reference] - 1 ) * 1e6;
+}
+
+/**
+ * Name: GetInsertedScans(int device)
+ * Desc: Returns the scans repeated for the device since Reset
+**/
+unsigned long ScanAligner::GetInsertedScans(int device)
+{
+	return insertedScans[device];
+}
+
+/**
+ * Name: GetDroppedScans(int device)
+ * Desc: Returns the scans of the device thrown away since Reset
+**/
+unsigned long ScanAligner::GetDroppedScans(int device)
+{
+	return droppedScans[device];
+}
+
+/**
+ * Name: GetRelocks(int device)
+ * Desc: Returns the times the device's clock estimate was restarted
+**/
+unsigned long ScanAligner::GetRelocks(int device)
+{
+	return relocks[device];
+}
+
+/**
+ * Name: GetTotalAdjustments()
+ * Desc: Returns the scans inserted and dropped on every device since Reset
+**/
+unsigned long ScanAligner::GetTotalAdjustments()
+{
+	unsigned long total = 0;
+	int n;
+
+	for (n = 0; n < numDevices; n++)
+		total += insertedScans[n] + droppedScans[n];
+
+	return total;
+}
+
+/**
+ * Name: GetMaxLag(int device, int reference)
+ * Desc: (private) Returns the reference scans to hold back while waiting for
+ *		 the device: half a second or two of the largest batches, whichever
+ *		 is more
+**/
+long ScanAligner::GetMaxLag(int device, int reference)
+{
+	long batch = maxBatch[device] > maxBatch[reference] ? maxBatch[device] : maxBatch[reference];
+	double lag = 2.0 * batch;
+
+	if (lag < minLagScans)
+		lag = minLagScans;
+
+	return (long)lag;
+}
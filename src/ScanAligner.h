@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: ScanAligner.h
+ * Desc: Header file for ScanAligner object class
+**/
+
+#ifndef SCANALIGNER_H
+#define SCANALIGNER_H
+
+/**
+ * Name: ScanAligner
+ * Desc: Lines up the scans of several devices streaming at the same nominal
+ *		 rate. Every batch of scans a device delivers is stamped with the
+ *		 host time it arrived at, and each device's clock offset and period
+ *		 are tracked with an alpha-beta filter. Merging follows a reference
+ *		 device: for each of its scans the other devices contribute the scan
+ *		 nearest in time, drop scans that fall before it or repeat their last
+ *		 scan when theirs falls after it. Drops and insertions are counted.
+ *
+ *		 The class has no Windows or DASYLab dependencies and is not thread
+ *		 safe; the caller serializes AddBatch, Align and Commit. Host times
+ *		 are passed in, so drifting devices can be simulated off target as
+ *		 ScanAlignerTest.cpp does.
+**/
+class ScanAligner {
+
+		// Constants
+		const static int MAX_DEVICES = 4;
+
+		// Instance variables
+		int numDevices;
+		double nominalPeriod;							// Scan period all devices are set to (ms)
+		double minLagScans;								// Reference scans to wait for a silent device before inserting
+		bool locked[MAX_DEVICES];						// A device has delivered at least one batch
+		double refIndex[MAX_DEVICES];					// Index of the last scan stamped
+		double refTime[MAX_DEVICES];					// Filtered host time of that scan (ms)
+		double period[MAX_DEVICES];						// Filtered scan period (ms)
+		double producedScans[MAX_DEVICES];				// Scans delivered since Reset
+		double consumedScans[MAX_DEVICES];				// Scans used or dropped since Reset
+		long maxBatch[MAX_DEVICES];						// Largest batch seen, bounds the wait for a device
+		long batches[MAX_DEVICES];						// Batches stamped since the estimate (re)started
+		unsigned long insertedScans[MAX_DEVICES];		// Scans repeated because the device fell behind
+		unsigned long droppedScans[MAX_DEVICES];		// Scans thrown away because the device ran ahead
+		unsigned long relocks[MAX_DEVICES];				// Times a device's clock estimate was restarted
+
+	public:
+		// Public constants, results of Align
+		const static int ALIGN_WAIT = 0;				// The device has no scan yet, merge later
+		const static int ALIGN_USE = 1;					// Use the device's next scan
+		const static int ALIGN_DROP = 2;				// Throw the device's next scan away and ask again
+		const static int ALIGN_INSERT = 3;				// Repeat the device's previous scan
+
+		ScanAligner();
+		void Reset(int devices, double scanRate);
+		void AddBatch(int device, long numScans, double hostTime);
+		int Align(int device, int reference, long available, long referenceAvailable);
+		void Commit(int device, int action);
+		double GetScanTime(int device, double scanIndex);
+		double GetOffset(int device, int reference);
+		double GetDrift(int device, int reference);
+		unsigned long GetInsertedScans(int device);
+		unsigned long GetDroppedScans(int device);
+		unsigned long GetRelocks(int device);
+		unsigned long GetTotalAdjustments();
+
+	private:
+		long GetMaxLag(int device, int reference);
+};
+#endif
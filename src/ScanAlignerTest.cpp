@@ -0,0 +1,195 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: ScanAlignerTest.cpp
+ * Desc: Off target check of ScanAligner with two simulated devices whose
+ *		 clocks drift apart, for several drifts, batch sizes and amounts of
+ *		 USB arrival jitter. Not part of the driver project; build and run
+ *		 it anywhere with:
+ *
+ *		 g++ -o ScanAlignerTest ScanAlignerTest.cpp ScanAligner.cpp
+ *		 ./ScanAlignerTest
+ *
+ * Retn: 0 if every check passed, 1 otherwise
+ * Note: Built without the precompiled header so that it stays portable
+**/
+
+// Compiler
+#include <math.h>
+#include <stdio.h>
+
+// Application
+#include "ScanAligner.h"
+
+/** Simulation settings **/
+static const double SCAN_RATE = 1000;			// Nominal rate of both devices (Hz)
+static const double START_OFFSET_MS = 3.3;		// How much later device 0 starts
+static const double MIN_DELAY_MS = 1;			// Least time from a batch's last scan to its arrival
+static const double RUN_MS = 120000;			// Simulated experiment length
+static const double SETTLE_MS = 20000;			// Time allowed to converge before checking
+static const double MAX_ERROR_PERIODS = 1;		// Largest misalignment allowed after settling (scans)
+static const double JITTER_ERROR_PERIODS = 1;	// Extra misalignment allowed when arrivals jitter (scans)
+static const double MAX_DRIFT_ERROR_PPM = 50;	// Largest error of the drift estimate
+
+/**
+ * Name: SimulatedDevice
+ * Desc: A free running device: scan i is acquired at start + i * period
+ *		 and arrives in batches, late by a delay and some jitter
+**/
+struct SimulatedDevice {
+	double start;									// Acquisition time of scan 0 (ms)
+	double period;									// True scan period (ms)
+	long produced;									// Scans delivered in batches so far
+	long consumed;									// Scans taken out of the queue so far
+	double lastTime;								// Acquisition time of the scan merged last (ms)
+};
+
+static unsigned long seed = 12345;
+
+/**
+ * Name: NextRandom()
+ * Desc: Returns a reproducible pseudo random number in [0, 1)
+**/
+static double NextRandom()
+{
+	seed = seed * 1103515245UL + 12345UL;
+	return ((seed >> 16) & 0x7FFF) / 32768.0;
+}
+
+/**
+ * Name: NextArrival(const SimulatedDevice * device, long batchScans)
+ * Desc: Returns when the device's next batch arrives (ms)
+**/
+static double NextArrival(const SimulatedDevice * device, long batchScans)
+{
+	return device->start + (device->produced + batchScans - 1) * device->period + MIN_DELAY_MS;
+}
+
+/**
+ * Name: RunCase(double driftPpm, long batchScans, double jitterMs)
+ * Desc: Streams both devices through the aligner the way
+ *		 DeviceRegistry::MergeScans does, following device 0, and checks
+ *		 how far apart in true time the merged scans are. Device 1's clock
+ *		 runs driftPpm slower; batches of batchScans arrive up to jitterMs
+ *		 late.
+ * Retn: The number of failed checks
+**/
+static int RunCase(double driftPpm, long batchScans, double jitterMs)
+{
+	SimulatedDevice devices[2];
+	ScanAligner aligner;
+	double now, error, maxError, drift, limit;
+	long merged;
+	int n, action, failures;
+
+	devices[0].start = START_OFFSET_MS;
+	devices[0].period = 1000 / SCAN_RATE;
+	devices[1].start = 0;
+	devices[1].period = 1000 / SCAN_RATE * (1 + driftPpm * 1e-6);
+	for (n = 0; n < 2; n++)
+	{
+		devices[n].produced = 0;
+		devices[n].consumed = 0;
+		devices[n].lastTime = 0;
+	}
+
+	aligner.Reset(2, SCAN_RATE);
+	maxError = 0;
+	merged = 0;
+	failures = 0;
+
+	for (;;)
+	{
+		// Deliver whichever batch is due first
+		n = NextArrival(&devices[0], batchScans) <= NextArrival(&devices[1], batchScans) ? 0 : 1;
+		now = NextArrival(&devices[n], batchScans);
+		if (now > RUN_MS)
+			break;
+		devices[n].produced += batchScans;
+		aligner.AddBatch(n, batchScans, now + jitterMs * NextRandom());
+
+		// Merge every reference scan device 1 can be matched with
+		while (devices[0].produced > devices[0].consumed)
+		{
+			do
+			{
+				action = aligner.Align(1, 0, devices[1].produced - devices[1].consumed,
+									   devices[0].produced - devices[0].consumed);
+				if (action == ScanAligner::ALIGN_DROP)
+				{
+					devices[1].lastTime = devices[1].start + devices[1].consumed * devices[1].period;
+					devices[1].consumed++;
+					aligner.Commit(1, action);
+				}
+			} while (action == ScanAligner::ALIGN_DROP);
+
+			if (action == ScanAligner::ALIGN_WAIT)
+				break;
+
+			devices[0].lastTime = devices[0].start + devices[0].consumed * devices[0].period;
+			devices[0].consumed++;
+			aligner.Commit(0, ScanAligner::ALIGN_USE);
+
+			if (action == ScanAligner::ALIGN_USE)
+			{
+				devices[1].lastTime = devices[1].start + devices[1].consumed * devices[1].period;
+				devices[1].consumed++;
+			}
+			aligner.Commit(1, action);
+
+			merged++;
+			error = fabs(devices[1].lastTime - devices[0].lastTime);
+			if (devices[0].lastTime > SETTLE_MS && devices[1].consumed > 0 && error > maxError)
+				maxError = error;
+		}
+	}
+
+	drift = aligner.GetDrift(1, 0);
+	printf("%+6.0f ppm, %3ld scans, %2.0f ms jitter: drift %+7.1f ppm, worst %.3f ms, %lu inserted, %lu dropped\n",
+		   driftPpm, batchScans, jitterMs, drift, maxError, aligner.GetInsertedScans(1), aligner.GetDroppedScans(1));
+
+	if (merged < (long)((RUN_MS - SETTLE_MS) * SCAN_RATE / 1000))
+	{
+		printf("FAIL: merging stalled\n");
+		failures++;
+	}
+	limit = jitterMs > 0 ? MAX_ERROR_PERIODS + JITTER_ERROR_PERIODS : MAX_ERROR_PERIODS;
+	if (maxError > limit * 1000 / SCAN_RATE)
+	{
+		printf("FAIL: misalignment above %.1f scans\n", limit);
+		failures++;
+	}
+	if (fabs(drift - driftPpm) > MAX_DRIFT_ERROR_PPM)
+	{
+		printf("FAIL: drift estimate off by more than %.0f ppm\n", MAX_DRIFT_ERROR_PPM);
+		failures++;
+	}
+	if (aligner.GetRelocks(1) != 0)
+	{
+		printf("FAIL: clock estimate restarted without a stall\n");
+		failures++;
+	}
+
+	return failures;
+}
+
+/**
+ * Name: main()
+ * Desc: Runs every combination of drift, batch size and jitter
+**/
+int main()
+{
+	const double drifts[] = { 200, -200, 50, -500 };
+	const long batches[] = { 16, 64, 256 };
+	const double jitters[] = { 0, 8 };
+	int d, b, j, failures = 0;
+
+	for (d = 0; d < (int)(sizeof(drifts) / sizeof(drifts[0])); d++)
+		for (b = 0; b < (int)(sizeof(batches) / sizeof(batches[0])); b++)
+			for (j = 0; j < (int)(sizeof(jitters) / sizeof(jitters[0])); j++)
+				failures += RunCase(drifts[d], batches[b], jitters[j]);
+
+	printf(failures ? "FAILED\n" : "PASSED\n");
+	return failures ? 1 : 0;
+}
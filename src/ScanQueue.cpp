@@ -0,0 +1,200 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: ScanQueue.cpp
+ * Desc: Ring of converted samples that holds one device's scans until
+ *		 they are merged into DASYLab's buffer
+**/
+
+// Windows
+#include "stdafx.h"
+#include <windows.h>
+
+// Class header file
+#include "ScanQueue.h"
+
+/**
+ * Name: ScanQueue()
+ * Desc: Creates an empty queue. Allocate must be called before use.
+**/
+ScanQueue::ScanQueue()
+{
+	buffer = NULL;
+	capacity = 0;
+	scanWidth = 0;
+	InitializeCriticalSection(&lock);
+	Clear();
+}
+
+/**
+ * Name: ~ScanQueue()
+ * Desc: Frees the ring storage
+**/
+ScanQueue::~ScanQueue()
+{
+	delete [] buffer;
+	DeleteCriticalSection(&lock);
+}
+
+/**
+ * Name: Allocate(DWORD numScans, DWORD newScanWidth)
+ * Desc: Sizes the ring for numScans scans of newScanWidth samples each
+ *		 and empties it
+ * Retn: TRUE if successful and FALSE if memory could not be allocated
+**/
+bool ScanQueue::Allocate(DWORD numScans, DWORD newScanWidth)
+{
+	EnterCriticalSection(&lock);
+
+	if (capacity != numScans * newScanWidth)
+	{
+		delete [] buffer;
+		capacity = numScans * newScanWidth;
+		buffer = capacity > 0 ? new SAMPLE[capacity] : NULL;
+	}
+	scanWidth = newScanWidth;
+
+	LeaveCriticalSection(&lock);
+
+	Clear();
+
+	return capacity == 0 || buffer != NULL;
+}
+
+/**
+ * Name: Clear()
+ * Desc: Throws away any waiting samples and resets the statistics
+**/
+void ScanQueue::Clear()
+{
+	EnterCriticalSection(&lock);
+	storeIndex = 0;
+	retrieveIndex = 0;
+	count = 0;
+	droppedScans = 0;
+	totalScans = 0;
+	partialCount = 0;
+	dropping = FALSE;
+	LeaveCriticalSection(&lock);
+}
+
+/**
+ * Name: Push(SAMPLE value)
+ * Desc: Adds the next sample of the scan being acquired. A scan only
+ *		 becomes visible to PopScan once all of its samples are present.
+ *		 If there is no room for a whole scan the scan is dropped and
+ *		 counted in droppedScans.
+**/
+void ScanQueue::Push(SAMPLE value)
+{
+	if (scanWidth == 0)
+		return;
+
+	EnterCriticalSection(&lock);
+
+	// Decide at the start of each scan if there is room for all of it
+	if (partialCount == 0)
+	{
+		dropping = ( capacity - count < scanWidth );
+		if (dropping)
+			droppedScans++;
+	}
+
+	if (!dropping)
+	{
+		buffer[storeIndex] = value;
+		storeIndex++;
+		if (storeIndex == capacity)
+			storeIndex = 0;
+	}
+
+	partialCount++;
+	if (partialCount == scanWidth)
+	{
+		if (!dropping)
+		{
+			count += scanWidth;
+			totalScans++;
+		}
+		partialCount = 0;
+	}
+
+	LeaveCriticalSection(&lock);
+}
+
+/**
+ * Name: PopScan(SAMPLE * dest)
+ * Desc: Copies the oldest complete scan into dest (scanWidth samples)
+ * Retn: TRUE if a scan was available and FALSE otherwise
+**/
+bool ScanQueue::PopScan(SAMPLE * dest)
+{
+	DWORD i;
+
+	EnterCriticalSection(&lock);
+
+	if (count < scanWidth || scanWidth == 0)
+	{
+		LeaveCriticalSection(&lock);
+		return FALSE;
+	}
+
+	for (i = 0; i < scanWidth; i++)
+	{
+		dest[i] = buffer[retrieveIndex];
+		retrieveIndex++;
+		if (retrieveIndex == capacity)
+			retrieveIndex = 0;
+	}
+	count -= scanWidth;
+
+	LeaveCriticalSection(&lock);
+
+	return TRUE;
+}
+
+/**
+ * Name: GetScansAvailable()
+ * Desc: Returns the number of complete scans waiting in the queue
+**/
+DWORD ScanQueue::GetScansAvailable()
+{
+	DWORD scans;
+
+	if (scanWidth == 0)
+		return 0;
+
+	EnterCriticalSection(&lock);
+	scans = count / scanWidth;
+	LeaveCriticalSection(&lock);
+
+	return scans;
+}
+
+/**
+ * Name: GetScanWidth()
+ * Desc: Returns the number of samples in one scan
+**/
+DWORD ScanQueue::GetScanWidth()
+{
+	return scanWidth;
+}
+
+/**
+ * Name: GetDroppedScans()
+ * Desc: Returns the number of scans dropped since the last Clear
+**/
+DWORD ScanQueue::GetDroppedScans()
+{
+	return droppedScans;
+}
+
+/**
+ * Name: GetTotalScans()
+ * Desc: Returns the number of whole scans kept since the last Clear
+**/
+DWORD ScanQueue::GetTotalScans()
+{
+	return totalScans;
+}
@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: ScanQueue.h
+ * Desc: Header file for ScanQueue object class
+**/
+
+#ifndef SCANQUEUE_H
+#define SCANQUEUE_H
+
+//	Windows
+#include "stdafx.h"
+#include <windows.h>
+
+//	DASYLab driver interface
+#include "treiber.h"
+
+/**
+ * Name: ScanQueue
+ * Desc: Fixed size ring of converted samples that holds one device's scans
+ *		 until they can be merged with the scans of the other devices.
+ *		 Samples are pushed one at a time by the device's acquisition thread
+ *		 and popped a whole scan at a time by the merging thread.
+**/
+class ScanQueue {
+
+		// Instance variables
+		SAMPLE * buffer;								// Ring storage
+		DWORD capacity;									// Size of the ring in samples (multiple of scanWidth)
+		DWORD scanWidth;								// Number of samples in one scan
+		DWORD storeIndex;								// Next position to write
+		DWORD retrieveIndex;							// Next position to read
+		DWORD count;									// Number of samples waiting
+		DWORD droppedScans;								// Scans thrown away because the ring was full
+		DWORD totalScans;								// Scans kept since the last Clear
+		DWORD partialCount;								// Samples of the scan currently being pushed
+		bool dropping;									// The scan being pushed is being thrown away
+		CRITICAL_SECTION lock;
+
+	public:
+		ScanQueue();
+		~ScanQueue();
+		bool Allocate(DWORD numScans, DWORD newScanWidth);
+		void Clear();
+		void Push(SAMPLE value);
+		bool PopScan(SAMPLE * dest);
+		DWORD GetScansAvailable();
+		DWORD GetScanWidth();
+		DWORD GetDroppedScans();
+		DWORD GetTotalScans();
+};
+#endif
@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: SlowInputs.cpp
+ * Desc: Latest values of analog inputs read at the slowdown rate
+ * Note: Built without the precompiled header so that it stays portable
+**/
+
+// Compiler
+#include <stdlib.h>
+
+// Class header file
+#include "SlowInputs.h"
+
+/**
+ * Name: SlowInputs()
+ * Desc: Creates an empty set of slow inputs
+**/
+SlowInputs::SlowInputs()
+{
+	Reset(0, 1);
+}
+
+/**
+ * Name: Reset(int inputs, unsigned long newSlowDown)
+ * Desc: Starts over with the given number of inputs, read every
+ *		 newSlowDown scans beginning with the first
+**/
+void SlowInputs::Reset(int inputs, unsigned long newSlowDown)
+{
+	numInputs = inputs;
+	slowDown = newSlowDown > 0 ? newSlowDown : 1;
+	countdown = 0;
+	sum.assign(inputs > 0 ? inputs : 1, 0.0);
+	count.assign(inputs > 0 ? inputs : 1, 0);
+	values.assign(inputs > 0 ? inputs : 1, 0.0);
+}
+
+/**
+ * Name: IsDue()
+ * Desc: Called once per scan
+ * Retn: TRUE if a new reading should be taken for this scan
+**/
+bool SlowInputs::IsDue()
+{
+	if (numInputs == 0)
+		return false;
+
+	if (countdown > 0)
+	{
+		countdown--;
+		return false;
+	}
+
+	countdown = slowDown - 1;
+	return true;
+}
+
+/**
+ * Name: Accumulate(int input, double volts)
+ * Desc: Adds a streamed reading to the average Publish takes
+**/
+void SlowInputs::Accumulate(int input, double volts)
+{
+	sum[input] += volts;
+	count[input]++;
+}
+
+/**
+ * Name: Publish()
+ * Desc: Makes the average of the accumulated readings the latest value of
+ *		 each input and starts a new average
+**/
+void SlowInputs::Publish()
+{
+	int n;
+
+	for (n = 0; n < numInputs; n++)
+	{
+		if (count[n] > 0)
+			values[n] = sum[n] / count[n];
+		sum[n] = 0;
+		count[n] = 0;
+	}
+}
+
+/**
+ * Name: Set(int input, double volts)
+ * Desc: Makes a polled reading the latest value of the input
+**/
+void SlowInputs::Set(int input, double volts)
+{
+	values[input] = volts;
+}
+
+/**
+ * Name: GetValues()
+ * Desc: Returns the latest value of every input, valid until Reset
+**/
+const double * SlowInputs::GetValues()
+{
+	return &values[0];
+}
+
+/**
+ * Name: GetNumInputs()
+ * Desc: Returns the number of slow inputs
+**/
+int SlowInputs::GetNumInputs()
+{
+	return numInputs;
+}
@@ -0,0 +1,46 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: SlowInputs.h
+ * Desc: Header file for SlowInputs object class
+**/
+
+#ifndef SLOWINPUTS_H
+#define SLOWINPUTS_H
+
+//	Compiler
+#include <vector>
+
+/**
+ * Name: SlowInputs
+ * Desc: Latest values of the analog inputs delivered at the slowdown rate.
+ *		 IsDue is asked once per scan and says when to take a new reading,
+ *		 which either is set directly (a polled read) or is the average of
+ *		 the readings accumulated since the last one (a streamed input).
+ *		 Between readings every scan repeats the latest values.
+ *
+ *		 The class has no Windows or DASYLab dependencies and is not thread
+ *		 safe, so it can be exercised off target.
+**/
+class SlowInputs {
+
+		// Instance variables
+		int numInputs;
+		unsigned long slowDown;							// Scans per reading
+		unsigned long countdown;						// Scans until the next reading
+		std::vector<double> sum;						// Readings accumulated since the last reading (V)
+		std::vector<unsigned long> count;
+		std::vector<double> values;						// Latest reading of each input (V)
+
+	public:
+		SlowInputs();
+		void Reset(int inputs, unsigned long newSlowDown);
+		bool IsDue();
+		void Accumulate(int input, double volts);
+		void Publish();
+		void Set(int input, double volts);
+		const double * GetValues();
+		int GetNumInputs();
+};
+#endif
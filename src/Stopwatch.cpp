@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: Stopwatch.cpp
+ * Desc: Elapsed time measurement with the high resolution performance counter
+**/
+
+// Windows
+#include "stdafx.h"
+#include <windows.h>
+
+// Class header file
+#include "Stopwatch.h"
+
+/**
+ * Name: Stopwatch()
+ * Desc: Creates a stopwatch that is already running
+**/
+Stopwatch::Stopwatch()
+{
+	Start();
+}
+
+/**
+ * Name: Start()
+ * Desc: Restarts the measurement from now
+**/
+void Stopwatch::Start()
+{
+	QueryPerformanceCounter(&startCount);
+}
+
+/**
+ * Name: GetElapsedMs()
+ * Desc: Returns the milliseconds since the last Start
+**/
+double Stopwatch::GetElapsedMs()
+{
+	LARGE_INTEGER now, frequency;
+
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&frequency);
+
+	return (double)(now.QuadPart - startCount.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+}
+
+/**
+ * Name: GetTimeMs()
+ * Desc: Returns the performance counter as milliseconds since an
+ *		 arbitrary point, for use as a common time base
+**/
+double Stopwatch::GetTimeMs()
+{
+	LARGE_INTEGER now, frequency;
+
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&frequency);
+
+	return (double)now.QuadPart * 1000.0 / (double)frequency.QuadPart;
+}
@@ -0,0 +1,31 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: Stopwatch.h
+ * Desc: Header file for Stopwatch object class
+**/
+
+#ifndef STOPWATCH_H
+#define STOPWATCH_H
+
+//	Windows
+#include "stdafx.h"
+#include <windows.h>
+
+/**
+ * Name: Stopwatch
+ * Desc: Measures elapsed time with the high resolution performance counter
+**/
+class Stopwatch {
+
+		// Instance variables
+		LARGE_INTEGER startCount;						// Counter value when Start was called
+
+	public:
+		Stopwatch();
+		void Start();
+		double GetElapsedMs();
+		static double GetTimeMs();
+};
+#endif
@@ -0,0 +1,274 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: StreamRecovery.cpp
+ * Desc: Detects stalled or failed acquisition and brings the device back
+ *		 without stopping the DASYLab experiment
+**/
+
+/** Includes **/
+
+// Windows
+#include "stdafx.h"
+#include <windows.h>
+#include <stdio.h>
+
+// Class header file
+#include "StreamRecovery.h"
+
+// Application
+#include "LabJackLayer.h"
+#include "DriverSettings.h"
+
+/**
+ * Name: StreamRecovery()
+ * Desc: Creates an idle watchdog. Attach must be called before Start.
+**/
+StreamRecovery::StreamRecovery()
+{
+	device = NULL;
+	watchdogThread = NULL;
+	stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	lastDataTime = 0;
+	recoveryRequested = FALSE;
+	recovering = FALSE;
+	lastError = 0;
+	stallTimeout = DEFAULT_STALL_TIMEOUT;
+	maxAttempts = 0;
+	failedAttempts = 0;
+	recoveries = 0;
+	enabled = TRUE;
+}
+
+/**
+ * Name: ~StreamRecovery()
+ * Desc: Ends the watchdog thread
+**/
+StreamRecovery::~StreamRecovery()
+{
+	Stop();
+	if (stopEvent != NULL)
+		CloseHandle(stopEvent);
+	if (wakeEvent != NULL)
+		CloseHandle(wakeEvent);
+}
+
+/**
+ * Name: Attach(LabJackLayer * newDevice)
+ * Desc: Sets the device to watch
+**/
+void StreamRecovery::Attach(LabJackLayer * newDevice)
+{
+	device = newDevice;
+}
+
+/**
+ * Name: Start(DWORD dataInterval)
+ * Desc: Starts watching the device at the beginning of an experiment.
+ *		 dataInterval is how often data is expected (ms); four missed
+ *		 intervals, and at least StallTimeoutMs, count as a stall.
+**/
+void StreamRecovery::Start(DWORD dataInterval)
+{
+	DWORD threadID;
+
+	Stop();
+
+	enabled = DriverSettings::GetInt("Recovery", "Enabled", 1) != 0;
+	stallTimeout = DriverSettings::GetInt("Recovery", "StallTimeoutMs", DEFAULT_STALL_TIMEOUT);
+	maxAttempts = DriverSettings::GetInt("Recovery", "MaxAttempts", 0);
+	if (stallTimeout < 4 * dataInterval)
+		stallTimeout = 4 * dataInterval;
+
+	InterlockedExchange(&lastDataTime, (LONG)GetTickCount());
+	InterlockedExchange(&recoveryRequested, FALSE);
+	InterlockedExchange(&recovering, FALSE);
+	failedAttempts = 0;
+	recoveries = 0;
+
+	if (!enabled || device == NULL)
+		return;
+
+	ResetEvent(stopEvent);
+	ResetEvent(wakeEvent);
+	watchdogThread = CreateThread(NULL, 0, WatchdogThread, this, 0, &threadID);
+}
+
+/**
+ * Name: Stop()
+ * Desc: Stops watching at the end of an experiment. A recovery in progress
+ *		 is allowed to finish first.
+**/
+void StreamRecovery::Stop()
+{
+	if (watchdogThread == NULL)
+		return;
+
+	SetEvent(stopEvent);
+	WaitForSingleObject(watchdogThread, INFINITE);
+	CloseHandle(watchdogThread);
+	watchdogThread = NULL;
+
+	SaveStatus();
+}
+
+/**
+ * Name: NoteData()
+ * Desc: Called whenever the device delivers data
+**/
+void StreamRecovery::NoteData()
+{
+	InterlockedExchange(&lastDataTime, (LONG)GetTickCount());
+}
+
+/**
+ * Name: RequestRecovery(long errorCode)
+ * Desc: Asks the watchdog to reopen the device after the given UD error.
+ *		 Requests made while a recovery is already running are ignored.
+**/
+void StreamRecovery::RequestRecovery(long errorCode)
+{
+	if (recovering)
+		return;
+
+	lastError = errorCode;
+	InterlockedExchange(&recoveryRequested, TRUE);
+	SetEvent(wakeEvent);
+}
+
+/**
+ * Name: IsWatching()
+ * Desc: Returns true while the watchdog thread runs with recovery turned
+ *		 on, meaning errors should be recovered from rather than shown
+**/
+bool StreamRecovery::IsWatching()
+{
+	return watchdogThread != NULL && enabled;
+}
+
+/**
+ * Name: IsRecovering()
+ * Desc: Returns true while the device is being reopened or its stream
+ *		 restarted, meaning the callbacks should leave it alone
+**/
+bool StreamRecovery::IsRecovering()
+{
+	return recovering != FALSE;
+}
+
+/**
+ * Name: GetRecoveries()
+ * Desc: Returns the number of successful recoveries in this experiment
+**/
+DWORD StreamRecovery::GetRecoveries()
+{
+	return recoveries;
+}
+
+/**
+ * Name: WatchdogThread(LPVOID param)
+ * Desc: (private) Thread entry point for the watchdog
+**/
+DWORD WINAPI StreamRecovery::WatchdogThread(LPVOID param)
+{
+	((StreamRecovery *)param)->Watch();
+
+	return 0;
+}
+
+/**
+ * Name: Watch()
+ * Desc: (private) Checks the device every CHECK_INTERVAL until stopped and
+ *		 recovers it when needed. Failed attempts are retried after a delay
+ *		 that doubles each time; after MaxAttempts failures in a row the
+ *		 experiment is reported as stopped by an error.
+**/
+void StreamRecovery::Watch()
+{
+	HANDLE events[2];
+	DWORD delay = CHECK_INTERVAL;
+
+	events[0] = stopEvent;
+	events[1] = wakeEvent;
+
+	while (WaitForMultipleObjects(2, events, FALSE, delay) != WAIT_OBJECT_0)
+	{
+		delay = CHECK_INTERVAL;
+
+		if (!recoveryRequested && !IsStalled())
+			continue;
+
+		if (Recover())
+		{
+			failedAttempts = 0;
+			continue;
+		}
+
+		failedAttempts++;
+		if (maxAttempts > 0 && failedAttempts >= maxAttempts)
+		{
+			device->GetMeasInfo()->MeasStatus |= DRV_ERROR_STOP;
+			break;
+		}
+
+		delay = MIN_RETRY_DELAY << (failedAttempts < 6 ? failedAttempts - 1 : 6);
+		if (delay > MAX_RETRY_DELAY)
+			delay = MAX_RETRY_DELAY;
+	}
+}
+
+/**
+ * Name: IsStalled()
+ * Desc: (private) Returns true if no data has arrived for stallTimeout
+**/
+bool StreamRecovery::IsStalled()
+{
+	return GetTickCount() - (DWORD)lastDataTime > stallTimeout;
+}
+
+/**
+ * Name: Recover()
+ * Desc: (private) Reopens the device and restarts acquisition, marking
+ *		 the gap in DASYLab's data
+ * Retn: TRUE if the device is acquiring again and FALSE otherwise
+**/
+bool StreamRecovery::Recover()
+{
+	bool restarted;
+
+	InterlockedExchange(&recovering, TRUE);
+	InterlockedExchange(&recoveryRequested, FALSE);
+
+	device->ReportDataLost();
+	restarted = device->RestartAcquisition();
+
+	InterlockedExchange(&lastDataTime, (LONG)GetTickCount());
+	InterlockedExchange(&recovering, FALSE);
+
+	if (restarted)
+		recoveries++;
+
+	return restarted;
+}
+
+/**
+ * Name: SaveStatus()
+ * Desc: (private) Writes the outcome of the experiment to the INI file:
+ *
+ *		 [Diagnostics]
+ *		 Recoveries320012345=2,1016		; recoveries, last UD error
+**/
+void StreamRecovery::SaveStatus()
+{
+	char key[32];
+	char value[32];
+
+	if (device == NULL)
+		return;
+
+	sprintf(key, "Recoveries%ld", device->GetSerialNumber());
+	sprintf(value, "%lu,%ld", recoveries, lastError);
+	DriverSettings::PutString("Diagnostics", key, value);
+}
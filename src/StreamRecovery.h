@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: StreamRecovery.h
+ * Desc: Header file for StreamRecovery object class
+**/
+
+#ifndef STREAMRECOVERY_H
+#define STREAMRECOVERY_H
+
+//	Windows
+#include "stdafx.h"
+#include <windows.h>
+
+class LabJackLayer;
+
+/**
+ * Name: StreamRecovery
+ * Desc: Watchdog that keeps one device acquiring for the whole experiment.
+ *		 While the experiment runs a thread checks that data keeps arriving.
+ *		 When the stream stalls or a UD call fails, the device is reopened by
+ *		 serial number or IP address and acquisition is restarted into the
+ *		 same FIFO, retrying with a growing delay. The gap is reported to
+ *		 DASYLab through DRV_DATA_LOST instead of a modal error box.
+ *		 The reopen holds the device's handle lock, and Stop waits for it,
+ *		 so DASYLab's thread never sees a half reopened device.
+ *
+ *		 Configured in the driver INI file:
+ *
+ *		 [Recovery]
+ *		 Enabled=1
+ *		 StallTimeoutMs=2000	; least time without data that counts as a stall
+ *		 MaxAttempts=0			; consecutive failed reopens before giving up (0 never)
+**/
+class StreamRecovery {
+
+		// Constants
+		const static DWORD CHECK_INTERVAL = 250;		// How often the watchdog looks at the device (ms)
+		const static DWORD DEFAULT_STALL_TIMEOUT = 2000;
+		const static DWORD MIN_RETRY_DELAY = 500;		// First delay between failed reopens (ms)
+		const static DWORD MAX_RETRY_DELAY = 30000;		// The delay doubles up to this (ms)
+
+		// Instance variables
+		LabJackLayer * device;							// Device being watched
+		HANDLE watchdogThread;							// NULL when not watching
+		HANDLE stopEvent;								// Signaled to end the watchdog thread
+		HANDLE wakeEvent;								// Signaled to act on a request before the next check
+		volatile LONG lastDataTime;						// GetTickCount when data last arrived
+		volatile LONG recoveryRequested;				// Set by RequestRecovery, cleared by the watchdog
+		volatile LONG recovering;						// TRUE while the device is being reopened or restarted
+		LONG lastError;									// UD error that triggered the last request
+		DWORD stallTimeout;								// Time without data that counts as a stall (ms)
+		int maxAttempts;								// Failed reopens in a row before giving up, 0 for never
+		int failedAttempts;								// Failed reopens since the last success
+		DWORD recoveries;								// Successful recoveries in this experiment
+		bool enabled;
+
+	public:
+		StreamRecovery();
+		~StreamRecovery();
+		void Attach(LabJackLayer * newDevice);
+		void Start(DWORD dataInterval);
+		void Stop();
+		void NoteData();
+		void RequestRecovery(long errorCode);
+		bool IsWatching();
+		bool IsRecovering();
+		DWORD GetRecoveries();
+
+	private:
+		static DWORD WINAPI WatchdogThread(LPVOID param);
+		void Watch();
+		bool IsStalled();
+		bool Recover();
+		void SaveStatus();
+};
+#endif
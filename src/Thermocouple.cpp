@@ -0,0 +1,241 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: Thermocouple.cpp
+ * Desc: Thermocouple reference functions and table-driven linearization
+ * Note: Built without the precompiled header so that it stays portable
+**/
+
+// Compiler
+#include <math.h>
+
+// Class header file
+#include "Thermocouple.h"
+
+/** NIST ITS-90 reference function coefficients (mV) **/
+static const double K_BELOW_0[] = {
+	0.0, 3.9450128025e-2, 2.3622373598e-5, -3.2858906784e-7, -4.9904828777e-9,
+	-6.7509059173e-11, -5.7410327428e-13, -3.1088872894e-15, -1.0451609365e-17,
+	-1.9889266878e-20, -1.6322697486e-23
+};
+static const double K_ABOVE_0[] = {
+	-1.7600413686e-2, 3.8921204975e-2, 1.8558770032e-5, -9.9457592874e-8,
+	3.1840945719e-10, -5.6072844889e-13, 5.6075059059e-16, -3.2020720003e-19,
+	9.7151147152e-23, -1.2104721275e-26
+};
+static const double J_ALL[] = {
+	0.0, 5.0381187815e-2, 3.0475836930e-5, -8.5681065720e-8, 1.3228195295e-10,
+	-1.7052958337e-13, 2.0948090697e-16, -1.2538395336e-19, 1.5631725697e-23
+};
+static const double T_BELOW_0[] = {
+	0.0, 3.8748106364e-2, 4.4194434347e-5, 1.1844323105e-7, 2.0032973554e-8,
+	9.0138019559e-10, 2.2651156593e-11, 3.6071154205e-13, 3.8493939883e-15,
+	2.8213521925e-17, 1.4251594779e-19, 4.8768662286e-22, 1.0795539270e-24,
+	1.3945027062e-27, 7.9795153927e-31
+};
+static const double T_ABOVE_0[] = {
+	0.0, 3.8748106364e-2, 3.3292227880e-5, 2.0618243404e-7, -2.1882256846e-9,
+	1.0996880928e-11, -3.0815758772e-14, 4.5479135290e-17, -2.7512901673e-20
+};
+static const double E_BELOW_0[] = {
+	0.0, 5.8665508708e-2, 4.5410977124e-5, -7.7998048686e-7, -2.5800160843e-8,
+	-5.9452583057e-10, -9.3214058667e-12, -1.0287605534e-13, -8.0370123621e-16,
+	-4.3979497391e-18, -1.6414776355e-20, -3.9673619516e-23, -5.5827328721e-26,
+	-3.4657842013e-29
+};
+static const double E_ABOVE_0[] = {
+	0.0, 5.8665508710e-2, 4.5032275582e-5, 2.8908407212e-8, -3.3056896652e-10,
+	6.5024403270e-13, -1.9197495504e-16, -1.2536600497e-18, 2.1489217569e-21,
+	-1.4388041782e-24, 3.5960899481e-28
+};
+
+/** Type K exponential term above 0 C: a0 * exp(a1 * (t - a2)^2) **/
+static const double K_A0 = 1.185976e-1;
+static const double K_A1 = -1.183432e-4;
+static const double K_A2 = 126.9686;
+
+#define COEFFICIENTS(c) sizeof(c) / sizeof(c[0]), c
+
+static const ThermocoupleSegment K_SEGMENTS[] = {
+	{ -270, 0, COEFFICIENTS(K_BELOW_0) },
+	{ 0, 1372, COEFFICIENTS(K_ABOVE_0) }
+};
+static const ThermocoupleSegment J_SEGMENTS[] = {
+	{ -210, 760, COEFFICIENTS(J_ALL) }
+};
+static const ThermocoupleSegment T_SEGMENTS[] = {
+	{ -270, 0, COEFFICIENTS(T_BELOW_0) },
+	{ 0, 400, COEFFICIENTS(T_ABOVE_0) }
+};
+static const ThermocoupleSegment E_SEGMENTS[] = {
+	{ -270, 0, COEFFICIENTS(E_BELOW_0) },
+	{ 0, 1000, COEFFICIENTS(E_ABOVE_0) }
+};
+
+#undef COEFFICIENTS
+#define SEGMENTS(s) sizeof(s) / sizeof(s[0]), s
+
+/** The types, linearized from -200 C where every reference function still rises steeply **/
+static const ThermocoupleType TYPES[] = {
+	{ 'K', -200, 1372, SEGMENTS(K_SEGMENTS), true },
+	{ 'J', -200, 760, SEGMENTS(J_SEGMENTS), false },
+	{ 'T', -200, 400, SEGMENTS(T_SEGMENTS), false },
+	{ 'E', -200, 1000, SEGMENTS(E_SEGMENTS), false }
+};
+static const int NUM_TYPES = sizeof(TYPES) / sizeof(TYPES[0]);
+
+#undef SEGMENTS
+
+/** Bisection steps when inverting, enough for 1e-9 C over any range **/
+static const int INVERT_STEPS = 48;
+
+/**
+ * Name: Find(char letter)
+ * Desc: Returns the index of the type with the given letter (either case)
+ *		 or -1 if it is not supported
+**/
+int Thermocouples::Find(char letter)
+{
+	int n;
+
+	if (letter >= 'a' && letter <= 'z')
+		letter = (char)(letter - 'a' + 'A');
+
+	for (n = 0; n < NUM_TYPES; n++)
+	{
+		if (TYPES[n].letter == letter)
+			return n;
+	}
+
+	return -1;
+}
+
+/**
+ * Name: Get(int type)
+ * Desc: Returns the table of the type with the given index
+**/
+const ThermocoupleType * Thermocouples::Get(int type)
+{
+	return &TYPES[type];
+}
+
+/**
+ * Name: GetNumTypes()
+ * Desc: Returns the number of supported types
+**/
+int Thermocouples::GetNumTypes()
+{
+	return NUM_TYPES;
+}
+
+/**
+ * Name: GetMillivolts(int type, double celsius)
+ * Desc: Returns the reference function of the type: the voltage of a
+ *		 thermocouple with its measuring junction at celsius and its
+ *		 reference junction at 0 C
+**/
+double Thermocouples::GetMillivolts(int type, double celsius)
+{
+	const ThermocoupleType * tc = &TYPES[type];
+	const ThermocoupleSegment * segment;
+	double millivolts;
+	int n;
+
+	// Horner over the segment containing the temperature
+	segment = &tc->segments[tc->numSegments - 1];
+	for (n = 0; n < tc->numSegments - 1; n++)
+	{
+		if (celsius < tc->segments[n].maxCelsius)
+		{
+			segment = &tc->segments[n];
+			break;
+		}
+	}
+
+	millivolts = 0;
+	for (n = segment->numCoefficients - 1; n >= 0; n--)
+		millivolts = millivolts * celsius + segment->coefficients[n];
+
+	if (tc->exponentialTerm && celsius >= 0)
+		millivolts += K_A0 * exp(K_A1 * (celsius - K_A2) * (celsius - K_A2));
+
+	return millivolts;
+}
+
+/**
+ * Name: ThermocoupleLinearizer()
+ * Desc: Creates an empty linearizer
+**/
+ThermocoupleLinearizer::ThermocoupleLinearizer()
+{
+	type = -1;
+	minMillivolts = 0;
+	step = 1;
+}
+
+/**
+ * Name: Build(int newType, int points)
+ * Desc: Fills the table of the given type with points entries spanning
+ *		 its range, each found by bisecting the reference function
+**/
+void ThermocoupleLinearizer::Build(int newType, int points)
+{
+	const ThermocoupleType * tc = Thermocouples::Get(newType);
+	double maxMillivolts, target, low, high, middle;
+	int n, i;
+
+	if (points < 2)
+		points = 2;
+
+	type = newType;
+	minMillivolts = Thermocouples::GetMillivolts(type, tc->minCelsius);
+	maxMillivolts = Thermocouples::GetMillivolts(type, tc->maxCelsius);
+	step = (maxMillivolts - minMillivolts) / (points - 1);
+
+	celsius.resize(points);
+	for (n = 0; n < points; n++)
+	{
+		target = minMillivolts + n * step;
+		low = tc->minCelsius;
+		high = tc->maxCelsius;
+		for (i = 0; i < INVERT_STEPS; i++)
+		{
+			middle = (low + high) / 2;
+			if (Thermocouples::GetMillivolts(type, middle) < target)
+				low = middle;
+			else
+				high = middle;
+		}
+		celsius[n] = (low + high) / 2;
+	}
+}
+
+/**
+ * Name: IsBuilt()
+ * Desc: Returns true once Build has filled the table
+**/
+bool ThermocoupleLinearizer::IsBuilt()
+{
+	return type >= 0;
+}
+
+/**
+ * Name: GetCelsius(double millivolts)
+ * Desc: Returns the temperature of the measuring junction for a voltage
+ *		 referenced to 0 C, limited to the range of the type
+**/
+double ThermocoupleLinearizer::GetCelsius(double millivolts)
+{
+	double position;
+	int n, last = (int)celsius.size() - 1;
+
+	position = (millivolts - minMillivolts) / step;
+	if (position <= 0)
+		return celsius[0];
+	if (position >= last)
+		return celsius[last];
+
+	n = (int)position;
+	return celsius[n] + (celsius[n + 1] - celsius[n]) * (position - n);
+}
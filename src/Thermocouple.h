@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: Thermocouple.h
+ * Desc: Header file for the thermocouple tables and linearizer
+**/
+
+#ifndef THERMOCOUPLE_H
+#define THERMOCOUPLE_H
+
+//	Compiler
+#include <vector>
+
+/**
+ * Name: ThermocoupleSegment
+ * Desc: NIST ITS-90 reference polynomial over one temperature range:
+ *		 E (mV) = sum of coefficients[i] * t^i, t in degrees Celsius
+**/
+struct ThermocoupleSegment {
+	double minCelsius;
+	double maxCelsius;
+	int numCoefficients;
+	const double * coefficients;
+};
+
+/**
+ * Name: ThermocoupleType
+ * Desc: Reference function of one thermocouple type over the range the
+ *		 driver linearizes
+**/
+struct ThermocoupleType {
+	char letter;									// "K", "J", ...
+	double minCelsius;
+	double maxCelsius;
+	int numSegments;
+	const ThermocoupleSegment * segments;
+	bool exponentialTerm;							// Type K adds a term above 0 C
+};
+
+/**
+ * Name: Thermocouples
+ * Desc: Lookups into the reference function tables
+**/
+class Thermocouples {
+
+	public:
+		static int Find(char letter);
+		static const ThermocoupleType * Get(int type);
+		static int GetNumTypes();
+		static double GetMillivolts(int type, double celsius);
+};
+
+/**
+ * Name: ThermocoupleLinearizer
+ * Desc: Inverse reference function of one type as a table of temperatures
+ *		 at evenly spaced voltages, filled once by inverting the reference
+ *		 polynomials, so each conversion is a lookup and one linear
+ *		 interpolation instead of evaluating a polynomial.
+ *
+ *		 The classes have no Windows or DASYLab dependencies, so they can
+ *		 be exercised off target.
+**/
+class ThermocoupleLinearizer {
+
+		// Instance variables
+		int type;										// Index of the type or -1 before Build
+		double minMillivolts;							// Voltage of the first table entry
+		double step;									// Millivolts between entries
+		std::vector<double> celsius;					// Temperature at each entry
+
+	public:
+		ThermocoupleLinearizer();
+		void Build(int newType, int points);
+		bool IsBuilt();
+		double GetCelsius(double millivolts);
+};
+#endif
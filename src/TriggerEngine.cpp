@@ -0,0 +1,213 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: TriggerEngine.cpp
+ * Desc: Software trigger with pre-trigger history over converted scans
+ * Note: Built without the precompiled header so that it stays portable
+**/
+
+// Compiler
+#include <string.h>
+
+// Class header file
+#include "TriggerEngine.h"
+
+/**
+ * Name: TriggerEngine()
+ * Desc: Creates an inactive engine
+**/
+TriggerEngine::TriggerEngine()
+{
+	active = false;
+	scanWidth = 0;
+	ringScans = 1;
+	head = 0;
+	filled = 0;
+	postScans = 0;
+	postLeft = 0;
+	primed = false;
+	events = 0;
+	scansSeen = 0;
+	scansForwarded = 0;
+}
+
+/**
+ * Name: Configure(int newScanWidth, long preScans, long newPostScans,
+ *				   const TriggerCondition * newConditions, int numConditions)
+ * Desc: Arms the engine for scans of newScanWidth samples, forwarding
+ *		 preScans scans before and newPostScans scans after the scan on
+ *		 which any of the conditions fires. Everything is allocated here,
+ *		 nothing while scans are processed.
+**/
+void TriggerEngine::Configure(int newScanWidth, long preScans, long newPostScans, const TriggerCondition * newConditions, int numConditions)
+{
+	if (preScans < 0)
+		preScans = 0;
+	if (newPostScans < 0)
+		newPostScans = 0;
+
+	scanWidth = newScanWidth;
+	ringScans = (int)preScans + 1;
+	ring.assign(ringScans * (scanWidth > 0 ? scanWidth : 1), 0);
+	head = ringScans - 1;
+	filled = 0;
+	postScans = newPostScans;
+	postLeft = 0;
+	conditions.assign(newConditions, newConditions + numConditions);
+	previous.assign(numConditions > 0 ? numConditions : 1, 0.0);
+	primed = false;
+	events = 0;
+	scansSeen = 0;
+	scansForwarded = 0;
+	active = true;
+}
+
+/**
+ * Name: Disable()
+ * Desc: Stops triggering
+**/
+void TriggerEngine::Disable()
+{
+	active = false;
+}
+
+/**
+ * Name: IsActive()
+ * Desc: Returns true between Configure and Disable
+**/
+bool TriggerEngine::IsActive()
+{
+	return active;
+}
+
+/**
+ * Name: Process(const double * scan, const short * samples)
+ * Desc: Takes the next device scan and its converted samples
+ * Retn: The number of scans to forward now, read with GetOutput; the
+ *		 last of them is this scan
+**/
+int TriggerEngine::Process(const double * scan, const short * samples)
+{
+	int count;
+	bool fired;
+
+	scansSeen++;
+	head = head + 1 < ringScans ? head + 1 : 0;
+	memcpy(&ring[head * scanWidth], samples, sizeof(short) * scanWidth);
+
+	// Edges need the previous scan, so conditions are watched even while
+	// a window is being forwarded
+	fired = Fires(scan);
+
+	if (postLeft > 0)
+	{
+		postLeft--;
+		scansForwarded++;
+		return 1;
+	}
+
+	if (filled < ringScans)
+		filled++;
+	if (!fired)
+		return 0;
+
+	events++;
+	count = filled;
+	filled = 0;
+	postLeft = postScans;
+	scansForwarded += count;
+	return count;
+}
+
+/**
+ * Name: GetOutput(int index, int count)
+ * Desc: Returns scan index of the count scans the last Process forwarded,
+ *		 oldest first, valid until the next call to Process
+**/
+const short * TriggerEngine::GetOutput(int index, int count)
+{
+	int slot = head - count + 1 + index;
+
+	if (slot < 0)
+		slot += ringScans;
+	return &ring[slot * scanWidth];
+}
+
+/**
+ * Name: Fires(const double * scan)
+ * Desc: (private) Returns true if any condition holds on this scan. Each
+ *		 condition is reduced to comparisons combined without branching on
+ *		 the outcome, so the cost per scan does not depend on the signal.
+**/
+bool TriggerEngine::Fires(const double * scan)
+{
+	const TriggerCondition * c;
+	double value, last;
+	bool above, below, wasAbove, wasBelow, outside;
+	bool fired = false;
+	int n;
+
+	for (n = 0; n < (int)conditions.size(); n++)
+	{
+		c = &conditions[n];
+		value = scan[c->source];
+		last = primed ? previous[n] : value;
+		previous[n] = value;
+
+		above = value >= c->low;
+		below = value < c->low;
+		wasAbove = last >= c->low;
+		wasBelow = last < c->low;
+
+		switch (c->type)
+		{
+			case CONDITION_LEVEL:
+				fired |= (c->slope >= 0 && above) | (c->slope <= 0 && below);
+				break;
+
+			case CONDITION_EDGE:
+				fired |= (c->slope >= 0 && wasBelow && above) | (c->slope <= 0 && wasAbove && below);
+				break;
+
+			case CONDITION_WINDOW:
+				outside = (value < c->low) | (value > c->high);
+				fired |= outside != c->inside;
+				break;
+
+			case CONDITION_PATTERN:
+				fired |= ((unsigned long)value & c->mask) == c->pattern;
+				break;
+		}
+	}
+
+	primed = true;
+	return fired;
+}
+
+/**
+ * Name: GetEvents()
+ * Desc: Returns the trigger events since Configure
+**/
+unsigned long TriggerEngine::GetEvents()
+{
+	return events;
+}
+
+/**
+ * Name: GetScansSeen()
+ * Desc: Returns the scans processed since Configure
+**/
+unsigned long TriggerEngine::GetScansSeen()
+{
+	return scansSeen;
+}
+
+/**
+ * Name: GetScansForwarded()
+ * Desc: Returns the scans forwarded since Configure
+**/
+unsigned long TriggerEngine::GetScansForwarded()
+{
+	return scansForwarded;
+}
@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: TriggerEngine.h
+ * Desc: Header file for TriggerEngine object class
+**/
+
+#ifndef TRIGGERENGINE_H
+#define TRIGGERENGINE_H
+
+//	Compiler
+#include <vector>
+
+/**
+ * Name: TriggerCondition
+ * Desc: One condition on a value of the device scan. Analog conditions
+ *		 compare volts; a pattern compares the word of the digital lines.
+**/
+struct TriggerCondition {
+	int type;										// TriggerEngine::CONDITION_
+	int source;										// Position of the value in the device scan
+	double low;										// Level, or lower edge of a window (V)
+	double high;									// Upper edge of a window (V)
+	int slope;										// Level/edge: 1 above/rising, -1 below/falling, 0 either
+	bool inside;									// Window: fire inside rather than outside
+	unsigned long mask;								// Pattern: lines compared
+	unsigned long pattern;							// Pattern: their states to fire on
+};
+
+/**
+ * Name: TriggerEngine
+ * Desc: Passes only the scans around trigger events. Every converted scan
+ *		 goes into a ring holding the last preScans scans; when any
+ *		 condition fires, the ring and the triggering scan are forwarded,
+ *		 then the next postScans scans, after which the engine arms again
+ *		 with an empty ring so no scan is forwarded twice.
+ *
+ *		 The class has no Windows or DASYLab dependencies and is not thread
+ *		 safe, so it can be exercised off target.
+**/
+class TriggerEngine {
+
+		// Instance variables
+		bool active;
+		int scanWidth;									// Samples per converted scan
+		int ringScans;									// preScans + 1
+		std::vector<short> ring;						// Last ringScans converted scans
+		int head;										// Slot of the newest scan in the ring
+		int filled;										// Scans in the ring since it was last emptied
+		long postScans;
+		long postLeft;									// Scans still to forward after an event, 0 when armed
+		std::vector<TriggerCondition> conditions;
+		std::vector<double> previous;					// Last value of each condition's source
+		bool primed;									// previous holds a scan
+		unsigned long events;
+		unsigned long scansSeen;
+		unsigned long scansForwarded;
+
+	public:
+		const static int CONDITION_LEVEL = 0;
+		const static int CONDITION_EDGE = 1;
+		const static int CONDITION_WINDOW = 2;
+		const static int CONDITION_PATTERN = 3;
+
+		TriggerEngine();
+		void Configure(int newScanWidth, long preScans, long newPostScans, const TriggerCondition * newConditions, int numConditions);
+		void Disable();
+		bool IsActive();
+		int Process(const double * scan, const short * samples);
+		const short * GetOutput(int index, int count);
+		unsigned long GetEvents();
+		unsigned long GetScansSeen();
+		unsigned long GetScansForwarded();
+
+	private:
+		bool Fires(const double * scan);
+};
+#endif
@@ -0,0 +1,224 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: WorksheetConfig.cpp
+ * Desc: Encodes the worksheet's device identity into DriverParam
+**/
+
+/** Includes **/
+
+// Windows
+#include "stdafx.h"
+#include <windows.h>
+#include <string.h>
+
+// Class header file
+#include "WorksheetConfig.h"
+
+// Application
+#include "LabJackLayer.h"
+
+/** Magic bytes that mark DriverParam as written by this driver **/
+static const char MAGIC[4] = { 'L', 'J', 'D', 'Y' };
+
+/**
+ * Name: WorksheetConfig()
+ * Desc: Creates an empty configuration
+**/
+WorksheetConfig::WorksheetConfig()
+{
+	deviceType = 0;
+	serialNumber = 0;
+	localID = 0;
+	ethernet = FALSE;
+	memset(ipAddress, 0, sizeof(ipAddress));
+}
+
+/**
+ * Name: Capture(LabJackLayer * device)
+ * Desc: Takes the identity of the given open device
+**/
+void WorksheetConfig::Capture(LabJackLayer * device)
+{
+	deviceType = device->GetDeviceType();
+	serialNumber = device->GetSerialNumber();
+	localID = device->GetDeviceID();
+	ethernet = device->IsUsingEthernet();
+
+	memset(ipAddress, 0, sizeof(ipAddress));
+	if (ethernet)
+		strncpy(ipAddress, device->GetIPAddress(), ADDRESS_SIZE);
+}
+
+/**
+ * Name: Write(char * driverParam, int size)
+ * Desc: Encodes the configuration into DriverParam. Bytes past the
+ *		 payload are cleared.
+ * Retn: TRUE if it fit and FALSE otherwise
+**/
+bool WorksheetConfig::Write(char * driverParam, int size)
+{
+	BYTE * data = (BYTE *)driverParam;
+	BYTE * payload = data + HEADER_SIZE;
+	WORD checksum;
+
+	if (size < HEADER_SIZE + PAYLOAD_SIZE)
+		return FALSE;
+
+	memset(data, 0, size);
+
+	PutLong(payload, deviceType);
+	PutLong(payload + 4, serialNumber);
+	PutLong(payload + 8, localID);
+	payload[12] = ethernet ? CONNECTION_ETHERNET : CONNECTION_USB;
+	memcpy(payload + 13, ipAddress, ADDRESS_SIZE);
+
+	checksum = Checksum(payload, PAYLOAD_SIZE);
+	memcpy(data, MAGIC, sizeof(MAGIC));
+	data[4] = VERSION;
+	data[5] = PAYLOAD_SIZE;
+	data[6] = (BYTE)(checksum & 0xFF);
+	data[7] = (BYTE)(checksum >> 8);
+
+	return TRUE;
+}
+
+/**
+ * Name: Read(const char * driverParam, int size)
+ * Desc: Decodes a configuration written by this or a later version of
+ *		 the driver
+ * Retn: TRUE if DriverParam held a valid configuration and FALSE if it
+ *		 is blank, foreign or damaged (the configuration is unchanged)
+**/
+bool WorksheetConfig::Read(const char * driverParam, int size)
+{
+	const BYTE * data = (const BYTE *)driverParam;
+	const BYTE * payload = data + HEADER_SIZE;
+	int length;
+
+	if (size < HEADER_SIZE + PAYLOAD_SIZE || memcmp(data, MAGIC, sizeof(MAGIC)) != 0)
+		return FALSE;
+
+	length = data[5];
+	if (data[4] < 1 || length < PAYLOAD_SIZE || HEADER_SIZE + length > size)
+		return FALSE;
+
+	if (Checksum(payload, length) != (WORD)(data[6] | (data[7] << 8)))
+		return FALSE;
+
+	if (payload[12] != CONNECTION_USB && payload[12] != CONNECTION_ETHERNET)
+		return FALSE;
+
+	deviceType = GetLong(payload);
+	serialNumber = GetLong(payload + 4);
+	localID = GetLong(payload + 8);
+	ethernet = payload[12] == CONNECTION_ETHERNET;
+	memcpy(ipAddress, payload + 13, ADDRESS_SIZE);
+	ipAddress[ADDRESS_SIZE] = '\0';
+
+	return TRUE;
+}
+
+/**
+ * Name: Matches(LabJackLayer * device)
+ * Desc: Returns true if the given device is open and is the one this
+ *		 configuration describes
+**/
+bool WorksheetConfig::Matches(LabJackLayer * device)
+{
+	if (!device->IsOpen() || device->GetDeviceType() != deviceType || device->IsUsingEthernet() != ethernet)
+		return FALSE;
+
+	if (ethernet)
+		return strcmp(device->GetIPAddress(), ipAddress) == 0;
+
+	if (serialNumber != 0)
+		return device->GetSerialNumber() == serialNumber;
+
+	return device->GetDeviceID() == localID;
+}
+
+/**
+ * Name: GetDeviceType()
+ * Desc: Returns the LJ_dt of the worksheet's device
+**/
+long WorksheetConfig::GetDeviceType()
+{
+	return deviceType;
+}
+
+/**
+ * Name: GetSerialNumber()
+ * Desc: Returns the serial number of the worksheet's device or 0
+**/
+long WorksheetConfig::GetSerialNumber()
+{
+	return serialNumber;
+}
+
+/**
+ * Name: GetLocalID()
+ * Desc: Returns the local ID of the worksheet's device
+**/
+long WorksheetConfig::GetLocalID()
+{
+	return localID;
+}
+
+/**
+ * Name: IsEthernet()
+ * Desc: Returns true if the worksheet's device is used over ethernet
+**/
+bool WorksheetConfig::IsEthernet()
+{
+	return ethernet;
+}
+
+/**
+ * Name: GetIPAddress()
+ * Desc: Returns the IP address of the worksheet's device or ""
+**/
+const char * WorksheetConfig::GetIPAddress()
+{
+	return ipAddress;
+}
+
+/**
+ * Name: PutLong(BYTE * dest, long value)
+ * Desc: (private) Stores a long as four little endian bytes
+**/
+void WorksheetConfig::PutLong(BYTE * dest, long value)
+{
+	dest[0] = (BYTE)(value & 0xFF);
+	dest[1] = (BYTE)((value >> 8) & 0xFF);
+	dest[2] = (BYTE)((value >> 16) & 0xFF);
+	dest[3] = (BYTE)((value >> 24) & 0xFF);
+}
+
+/**
+ * Name: GetLong(const BYTE * src)
+ * Desc: (private) Reads a long stored by PutLong
+**/
+long WorksheetConfig::GetLong(const BYTE * src)
+{
+	return (long)((DWORD)src[0] | ((DWORD)src[1] << 8) | ((DWORD)src[2] << 16) | ((DWORD)src[3] << 24));
+}
+
+/**
+ * Name: Checksum(const BYTE * data, int length)
+ * Desc: (private) Fletcher-16 checksum of the payload
+**/
+WORD WorksheetConfig::Checksum(const BYTE * data, int length)
+{
+	WORD sum1 = 0, sum2 = 0;
+	int n;
+
+	for (n = 0; n < length; n++)
+	{
+		sum1 = (WORD)((sum1 + data[n]) % 255);
+		sum2 = (WORD)((sum2 + sum1) % 255);
+	}
+
+	return (WORD)((sum2 << 8) | sum1);
+}
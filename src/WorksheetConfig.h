@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2010 LabJack Corp.
+ * See License.txt for more information
+ *
+ * Name: WorksheetConfig.h
+ * Desc: Header file for WorksheetConfig object class
+**/
+
+#ifndef WORKSHEETCONFIG_H
+#define WORKSHEETCONFIG_H
+
+//	Windows
+#include "stdafx.h"
+#include <windows.h>
+
+class LabJackLayer;
+
+/**
+ * Name: WorksheetConfig
+ * Desc: The part of the driver configuration that belongs to a worksheet,
+ *		 kept in DRV_INFOSTRUCT::DriverParam so that each flow chart
+ *		 remembers the LabJack it was built for. The bytes are laid out
+ *		 explicitly, little endian:
+ *
+ *		 0	"LJDY"			magic
+ *		 4	version			VERSION of the writer
+ *		 5	length			bytes of payload that follow the header
+ *		 6	checksum		Fletcher-16 of the payload
+ *		 8	device type		long
+ *		 12	serial number	long, 0 if unknown
+ *		 16	local ID		long
+ *		 20	connection		CONNECTION_USB or CONNECTION_ETHERNET
+ *		 21	IP address		16 characters, zero padded
+ *
+ *		 Later versions append to the payload so older drivers can still
+ *		 read the fields they know.
+**/
+class WorksheetConfig {
+
+		// Constants
+		const static BYTE VERSION = 1;
+		const static int HEADER_SIZE = 8;
+		const static int PAYLOAD_SIZE = 29;				// Payload bytes of VERSION
+		const static int ADDRESS_SIZE = 16;
+		const static BYTE CONNECTION_USB = 0;
+		const static BYTE CONNECTION_ETHERNET = 1;
+
+		// Instance variables
+		long deviceType;
+		long serialNumber;
+		long localID;
+		bool ethernet;
+		char ipAddress[ADDRESS_SIZE + 1];
+
+	public:
+		WorksheetConfig();
+		void Capture(LabJackLayer * device);
+		bool Write(char * driverParam, int size);
+		bool Read(const char * driverParam, int size);
+		bool Matches(LabJackLayer * device);
+		long GetDeviceType();
+		long GetSerialNumber();
+		long GetLocalID();
+		bool IsEthernet();
+		const char * GetIPAddress();
+
+	private:
+		static void PutLong(BYTE * dest, long value);
+		static long GetLong(const BYTE * src);
+		static WORD Checksum(const BYTE * data, int length);
+};
+#endif